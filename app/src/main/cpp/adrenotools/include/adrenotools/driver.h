@@ -8,10 +8,20 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "priv.h"
 
+/**
+ * @brief Sets a persistent directory to cache the soname patched copy of libvulkan.so in, later adrenotools_open_libvulkan calls (including in future launches) reuse it rather than copying and patching the library again
+ * @note This should be called before adrenotools_open_libvulkan, when set `tmpLibDir` is ignored
+ * @param cacheDir A writable app-private directory that persists across launches, or nullptr to disable caching
+ */
+void adrenotools_set_library_cache_dir(const char *cacheDir);
+
 /**
  * @brief Opens a new libvulkan.so instance according to `flags`
+ * @note The namespaces and hooks set up for a set of parameters are kept for the lifetime of the process and reused by later calls with the same parameters (including the mapping handle), so reopening libvulkan after closing it only pays for the driver's own initialization
+ * @note Calls with different parameters get separate namespaces and libvulkan instances, so several custom drivers can be loaded side by side in one process. Each driver should be in its own directory as ADRENOTOOLS_DRIVER_PRELOAD loads every library in `customDriverDir`
  * @param dlopenMode The dlopen mode to use when opening libvulkan
  * @param featureFlags Which adrenotools driver features to enable
  * @param tmpLibDir A writable directory to hold patched libraries, only used on api < 29 due to the lack of memfd support. If nullptr is passed and the API version is < 29 memfd usage will be attempted and if unsupported nullptr will be returned
@@ -23,8 +33,75 @@ extern "C" {
  */
 void *adrenotools_open_libvulkan(int dlopenMode, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, void **userMappingHandle);
 
+/**
+ * @brief An adrenotools_open_libvulkan call running on a background thread, see adrenotools_open_libvulkan_async
+ */
+struct adrenotools_open_request;
+
+/**
+ * @brief Called on the background thread once an asynchronous open completes, successfully or not
+ * @note The request must not be destroyed from within the callback
+ */
+typedef void (*adrenotools_open_callback)(void *userData, struct adrenotools_open_request *request, enum adrenotools_open_status status);
+
+/**
+ * @brief Like adrenotools_open_libvulkan but performs the file checks, patching and library loading on a background thread so the calling thread can keep rendering
+ * @note String parameters are copied so don't need to outlive the call. The mapping handle, if ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT is set, is retrieved with adrenotools_open_request_get_mapping_handle
+ * @param callback Called once the open completes, may be nullptr if the request is polled or waited on instead
+ * @return The request, which must be destroyed with adrenotools_open_request_destroy, or nullptr if it couldn't be started
+ */
+struct adrenotools_open_request *adrenotools_open_libvulkan_async(int dlopenMode, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, adrenotools_open_callback callback, void *userData);
+
+/**
+ * @return The current status of the request without blocking, ADRENOTOOLS_OPEN_PENDING if it is still in progress
+ */
+enum adrenotools_open_status adrenotools_open_request_get_status(struct adrenotools_open_request *request);
+
+/**
+ * @brief Blocks until the request completes
+ * @return The final status of the request
+ */
+enum adrenotools_open_status adrenotools_open_request_wait(struct adrenotools_open_request *request);
+
+/**
+ * @brief Requests that an open be abandoned, this takes effect at the next stage boundary and a libvulkan instance that finishes loading regardless is closed again
+ * @return True if the request will complete with ADRENOTOOLS_OPEN_CANCELLED, false if it had already completed
+ */
+bool adrenotools_open_request_cancel(struct adrenotools_open_request *request);
+
+/**
+ * @return The loaded libvulkan instance if the request completed with ADRENOTOOLS_OPEN_SUCCESS, otherwise nullptr. This is owned by the caller and must be closed with dlclose
+ */
+void *adrenotools_open_request_get_libvulkan(struct adrenotools_open_request *request);
+
+/**
+ * @return The mapping handle for use with ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT if the request completed with ADRENOTOOLS_OPEN_SUCCESS, otherwise nullptr
+ */
+void *adrenotools_open_request_get_mapping_handle(struct adrenotools_open_request *request);
+
+/**
+ * @return The dynamic linker's error message if the request failed while loading a library, otherwise nullptr. This remains valid until the request is destroyed
+ */
+const char *adrenotools_open_request_get_error(struct adrenotools_open_request *request);
+
+/**
+ * @brief Cancels the request if it is still in progress, waits for it to complete and frees it
+ * @note A libvulkan instance returned by a successful request isn't closed
+ */
+void adrenotools_open_request_destroy(struct adrenotools_open_request *request);
+
+/**
+ * @brief Writes a report of how long each stage of adrenotools_open_libvulkan took, including the stages that run when the driver itself is loaded by libvulkan
+ * @note The report is JSON in the Chrome trace event format so it can be opened directly in chrome://tracing or Perfetto, timestamps are relative to the start of the first adrenotools_open_libvulkan call
+ * @param buffer The buffer to write the null-terminated report to, may be nullptr if `size` is zero
+ * @param size The size of `buffer` in bytes, the report is truncated if it doesn't fit
+ * @return The size of the buffer needed to hold the full report, including the null terminator
+ */
+size_t adrenotools_get_load_report(char *buffer, size_t size);
+
 /**
  * @brief Imports the given CPU mapped memory range into the GSL allocator. This should then be followed by a call to vkAllocateMemory with a matching size which will return a VkDeviceMemory view over the input region
+ * @note Up to 256 imports may be pending at once, each is claimed by the first vkAllocateMemory call with a matching size from any thread
  * @param handle Mapping handle that was returned by adrenotools_open_libvulkan
  * @param hostPtr The host pointer to import
  * @param size The size of the region to import
@@ -32,8 +109,27 @@ void *adrenotools_open_libvulkan(int dlopenMode, int featureFlags, const char *t
  */
 bool adrenotools_import_user_mem(void *handle, void *hostPtr, uint64_t size);
 
+/**
+ * @brief Like adrenotools_import_user_mem but allows restricting which thread's vkAllocateMemory call can claim the import, so several threads can import equally sized regions concurrently
+ * @param tag If non-zero, only an allocation made by the thread with this kernel TID (gettid()) will claim the import
+ * @param ticket Set to a value that can be passed to adrenotools_get_gpu_mapping_status and adrenotools_cancel_gpu_mapping
+ * @return True on success, false if the import failed or too many imports are pending
+ */
+bool adrenotools_import_user_mem_tagged(void *handle, void *hostPtr, uint64_t size, uint64_t tag, uint64_t *ticket);
+
+/**
+ * @brief Imports several CPU mapped memory ranges at once, each range must then be followed by a vkAllocateMemory call with a matching size as with adrenotools_import_user_mem
+ * @note All imports are issued before any GPU addresses are queried, ranges that fail don't affect the others
+ * @param ranges The ranges to import
+ * @param count The number of entries in `ranges` and `results`
+ * @param results Filled with the outcome of importing each range
+ * @return The number of ranges that were imported successfully
+ */
+uint32_t adrenotools_import_user_mem_batch(void *handle, const struct adrenotools_user_mem_range *ranges, uint32_t count, struct adrenotools_user_mem_import_result *results);
+
 /**
  * @brief Maps GPU memory and imports it into the GSL allocator. This should then be followed by a call to adrenotools_mem_cpu_map to map the memory on the CPU, then finally vkAllocateMemory with a matching size
+ * @note Only one allocation per thread can wait to be mapped, if the previous one on this thread was never passed to adrenotools_mem_cpu_map it is freed
  * @param handle Mapping handle that was returned by adrenotools_open_libvulkan
  * @param size Pointer to a variable containing the size of the region to import, will be updated to contain the required size of the region to allocate CPU side
  * @return true on success
@@ -41,19 +137,66 @@ bool adrenotools_import_user_mem(void *handle, void *hostPtr, uint64_t size);
 bool adrenotools_mem_gpu_allocate(void *handle, uint64_t *size);
 
 /**
- * @brief Maps the last mapping allocated using adrenotools_mem_gpu_allocate into the given host memory region, such that vkAllocateMemory can then be called
- * @param handle Mapping handle that was returned by adrenotools_open_libvulkan
+ * @brief Like adrenotools_mem_gpu_allocate but with a caller selected CPU cache policy, the default of ADRENOTOOLS_CACHE_MODE_WRITEBACK_COHERENT pays for hardware coherency that upload-only memory doesn't need
+ */
+bool adrenotools_mem_gpu_allocate_with_cache_mode(void *handle, uint64_t *size, enum adrenotools_cache_mode cacheMode);
+
+/**
+ * @brief Maps the last mapping allocated using adrenotools_mem_gpu_allocate on the calling thread into the given host memory region, such that vkAllocateMemory can then be called
+ * @param handle Mapping handle that was returned by adrenotools_open_libvulkan, this MUST be the handle the mapping was allocated with
  * @param hostPtr A pointer to where the mapping should be mapped
  * @param size The size of the mapping. MUST be equal to the size returned by adrenotools_mem_gpu_allocate
  */
 bool adrenotools_mem_cpu_map(void *handle, void *hostPtr, uint64_t size);
 
+/**
+ * @brief Performs CPU cache maintenance on ranges of imported or allocated memory, this is only needed for memory using ADRENOTOOLS_CACHE_MODE_WRITEBACK
+ * @note Overlapping and adjacent ranges within an object are merged and all ranges are synced with a single ioctl, on kernels lacking range syncs the entire objects are synced instead
+ * @param handle Mapping handle that was returned by adrenotools_open_libvulkan, if nullptr every object is looked up from the kernel
+ * @return True on success
+ */
+bool adrenotools_sync_ranges(void *handle, const struct adrenotools_sync_range *ranges, uint32_t count, enum adrenotools_sync_direction direction);
+
 /**
  * @note This function should be called after adrenotools_open_libvulkan and Vulkan driver init to check if the mapping import hook loaded successfully
- * @return True if the mapping was successfully imported (or initialization succeeded)
+ * @return True if the hook was initialized and no imported mappings are still waiting to be claimed
  */
 bool adrenotools_validate_gpu_mapping(void *handle);
 
+/**
+ * @brief Queries the state of a single import made with adrenotools_import_user_mem_tagged
+ * @return ADRENOTOOLS_GPU_MAPPING_INVALID if the hook failed to initialize or the ticket is unknown
+ */
+enum adrenotools_gpu_mapping_status adrenotools_get_gpu_mapping_status(void *handle, uint64_t ticket);
+
+/**
+ * @brief Withdraws an import that hasn't been claimed by vkAllocateMemory yet and frees the underlying GPU object
+ * @return True if the import was still pending and has been cancelled
+ */
+bool adrenotools_cancel_gpu_mapping(void *handle, uint64_t ticket);
+
+/**
+ * @brief Defers frees of imported GPU objects to a background thread, which issues them in batches instead of on the thread that called vkFreeMemory
+ * @note Once enabled this stays enabled for the lifetime of the process
+ * @param config See adrenotools_reclaimer_config
+ * @return True on success, false if deferred freeing is already enabled or the thread couldn't be started
+ */
+bool adrenotools_enable_deferred_free(void *handle, const struct adrenotools_reclaimer_config *config);
+
+/**
+ * @brief Immediately issues all deferred frees on the calling thread
+ * @return The number of objects that were released
+ */
+uint32_t adrenotools_flush_deferred_frees(void *handle);
+
+/**
+ * @brief Finds the live object created through `handle` (by import, GPU allocation or a sub-allocator block) that contains the given GPU address
+ * @note This is intended for debugging and scans all tracked objects
+ * @param mapping Set to the host pointer, base GPU address and size of the owning object, flags aren't tracked and are set to 0
+ * @return True if an owning object was found
+ */
+bool adrenotools_find_imported_range(void *handle, uint64_t gpuAddr, struct adrenotools_gpu_mapping *mapping);
+
 /**
  * @brief Provides a way to force the GPU to run at the maximum possible clocks (thermal constraints will still be applied)
  */
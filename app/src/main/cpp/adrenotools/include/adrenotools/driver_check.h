@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+
+/**
+ * @note The functions in this header have no Android dependencies, they can be built and run on a host against extracted driver packages and system images
+ */
+
+enum adrenotools_driver_issue_type {
+    ADRENOTOOLS_DRIVER_ISSUE_INVALID_LIBRARY, //!< `library` couldn't be parsed as an ELF for the current architecture, `name` is empty
+    ADRENOTOOLS_DRIVER_ISSUE_MISSING_LIBRARY, //!< `name` is needed by `library` but couldn't be found in any search path
+    ADRENOTOOLS_DRIVER_ISSUE_UNDEFINED_SYMBOL, //!< `name` is referenced by `library` but defined by nothing in its dependency closure
+};
+
+/**
+ * @brief Called once for every issue found by adrenotools_check_driver
+ * @param library The path of the library the issue was found in
+ */
+typedef void (*adrenotools_driver_issue_fn)(void *userData, enum adrenotools_driver_issue_type type, const char *library, const char *name);
+
+/**
+ * @brief Checks that a custom driver and all of its dependencies can be loaded, without loading anything
+ * @note The search paths used match those of the namespace the driver is loaded into on device: `customDriverDir` followed by the vendor and system library directories
+ * @param issueFn Called for every issue found, may be nullptr
+ * @return True if no issues were found
+ */
+bool adrenotools_check_driver(const char *customDriverDir, const char *customDriverName, adrenotools_driver_issue_fn issueFn, void *userData);
+
+/**
+ * @brief Like adrenotools_check_driver but with an explicit list of directories to resolve dependencies from after `customDriverDir`, for use on a host against extracted system images
+ * @note Undefined symbols are only reported if every library in the closure was found and has section headers, as otherwise the missing definitions could be anywhere
+ */
+bool adrenotools_check_driver_with_search_paths(const char *customDriverDir, const char *customDriverName, const char *const *searchPaths, uint32_t searchPathCount, adrenotools_driver_issue_fn issueFn, void *userData);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @note A driver store keeps many driver packages installed at once while storing each distinct library only once. Libraries are stored as objects named by a hash of their contents and reference counted by the packages using them
+ * @note Every package gets a view: a directory of hardlinks (or symlinks where hardlinks aren't permitted, e.g. in app data on Android 10+) to its objects with the package's file names, which can be passed as `customDriverDir`
+ * @note All functions lock the store so they can be called from any thread or process, the store should live in an app-private directory
+ */
+
+/**
+ * @brief Disk usage of a driver store, see adrenotools_store_get_usage
+ */
+struct adrenotools_store_usage {
+    uint32_t package_count;
+    uint32_t object_count;
+    uint64_t stored_bytes; //!< The size of all objects, i.e. the space the store actually takes up
+    uint64_t package_bytes; //!< The size of all packages' files as if each package were a separate copy
+};
+
+/**
+ * @brief Adds every file in `sourceDir` to the store as `packageName`, replacing the package if it already exists
+ * @note Only files with contents not already in the store are copied, everything else is linked to the existing objects. Objects only the replaced package used are deleted
+ * @param storeDir The root directory of the store, this is created if it doesn't exist but its parent must
+ * @param packageName A plain file name identifying the package, e.g. "ad0615"
+ * @param sourceDir A directory holding the package's files, e.g. one that an ADPKG was installed to with adrenotools_install_package. Subdirectories and files starting with '.' are ignored
+ * @param viewDir Set to the path of the package's view with a trailing slash, may be nullptr
+ * @param viewDirSize The size of `viewDir` in bytes
+ * @return True on success, on failure the previous version of the package (if any) is left in place
+ */
+bool adrenotools_store_add_package(const char *storeDir, const char *packageName, const char *sourceDir, char *viewDir, size_t viewDirSize);
+
+/**
+ * @brief Removes a package and its view from the store, deleting any objects no other package uses
+ * @note Drivers already loaded from the package are unaffected as their libraries stay mapped
+ * @return True if the package existed and was removed
+ */
+bool adrenotools_store_remove_package(const char *storeDir, const char *packageName);
+
+/**
+ * @brief Writes the path of a package's view with a trailing slash to `viewDir`
+ * @return True if the package exists in the store and the path fit in `viewDir`
+ */
+bool adrenotools_store_get_package_view(const char *storeDir, const char *packageName, char *viewDir, size_t viewDirSize);
+
+/**
+ * @brief Deletes everything in the store that no package references, this is only needed to clean up after a process was killed midway through changing the store
+ * @note Reference counts are rebuilt from the package views, so objects a view uses are kept even if the index lost track of them
+ * @return The number of bytes freed
+ */
+uint64_t adrenotools_store_collect_garbage(const char *storeDir);
+
+/**
+ * @return True if the store could be read, `usage` is zeroed otherwise unless it's nullptr
+ */
+bool adrenotools_store_get_usage(const char *storeDir, struct adrenotools_store_usage *usage);
+
+#ifdef __cplusplus
+}
+#endif
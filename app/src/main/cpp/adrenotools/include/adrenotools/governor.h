@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+#include "kgsl_context.h"
+
+/**
+ * @brief Drives the GPU turbo state from per-frame feedback, only forcing maximum clocks while the frame budget is at risk
+ * @note Functions on a single governor must not be called concurrently
+ */
+struct adrenotools_governor;
+
+struct adrenotools_governor_config {
+    uint64_t frame_budget_ns; //!< The target frame time
+    float boost_threshold; //!< Turbo is enabled once the smoothed frame time exceeds this fraction of the budget
+    float release_threshold; //!< Turbo is disabled once the smoothed frame time drops below this fraction of the budget, must be below `boost_threshold`
+    float busy_threshold; //!< Turbo is only enabled if the smoothed GPU busy fraction is at least this, so CPU bound frames don't raise GPU clocks
+    uint32_t smoothing_frames; //!< The approximate number of frames averaged over, 0 or 1 disables smoothing
+    uint64_t min_dwell_ns; //!< The minimum time between two turbo state changes, except for boosts caused by a missed frame which use `emergency_dwell_ns`
+    uint64_t emergency_dwell_ns; //!< The minimum time after a turbo state change before a single GPU bound frame over budget can enable turbo, must be at most `min_dwell_ns`
+};
+
+/**
+ * @brief Feedback for a single completed frame
+ */
+struct adrenotools_governor_frame {
+    uint64_t timestamp_ns; //!< When the frame completed, on any monotonic clock
+    uint64_t frame_time_ns;
+    float gpu_busy; //!< The fraction of the frame the GPU was busy for, in the range [0, 1]. Pass 1 if unknown
+};
+
+/**
+ * @brief Creates a governor that applies its decisions to the device, turbo starts disabled
+ * @param ctx The KGSL context to use, if nullptr the default context is used
+ * @return The new governor or nullptr on failure
+ */
+struct adrenotools_governor *adrenotools_governor_create(struct adrenotools_kgsl_context *ctx, const struct adrenotools_governor_config *config);
+
+/**
+ * @brief Destroys the governor, disabling turbo if it was enabled
+ */
+void adrenotools_governor_destroy(struct adrenotools_governor *governor);
+
+/**
+ * @brief Feeds a completed frame into the governor, the device is only touched when the turbo state changes
+ * @return The turbo state after the frame
+ */
+bool adrenotools_governor_report_frame(struct adrenotools_governor *governor, const struct adrenotools_governor_frame *frame);
+
+/**
+ * @brief Replays a recorded frame trace through the governor policy without touching the device, for tuning configs offline
+ * @param turbo Filled with the turbo state after each frame
+ * @return The number of turbo state changes over the trace
+ */
+uint32_t adrenotools_governor_simulate(const struct adrenotools_governor_config *config, const struct adrenotools_governor_frame *frames, uint32_t count, bool *turbo);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+
+#define ADRENOTOOLS_KGSL_DEVICE_PATH "/dev/kgsl-3d0"
+
+/**
+ * @brief A persistent handle to a KGSL device that is shared between all adrenotools memory APIs and the driver hooks, avoiding an open/close pair around every ioctl
+ */
+struct adrenotools_kgsl_context;
+
+/**
+ * @brief Replacement ioctl handler for use with adrenotools_kgsl_context_open_fake, allows running against a stand-in device without a GPU
+ * @return 0 on success, -1 with errno set on failure, matching ioctl(2)
+ */
+typedef int (*adrenotools_kgsl_ioctl_fn)(void *userData, unsigned long request, void *arg);
+
+/**
+ * @brief Opens a new KGSL device context
+ * @param devicePath The device node to open, if nullptr ADRENOTOOLS_KGSL_DEVICE_PATH is used
+ * @return The new context or nullptr if the device node couldn't be opened
+ */
+struct adrenotools_kgsl_context *adrenotools_kgsl_context_open(const char *devicePath);
+
+/**
+ * @brief Creates a KGSL device context that forwards all ioctls to `ioctlFn` rather than a device node
+ * @note CPU mappings of GPU memory are unsupported on such contexts
+ */
+struct adrenotools_kgsl_context *adrenotools_kgsl_context_open_fake(adrenotools_kgsl_ioctl_fn ioctlFn, void *userData);
+
+/**
+ * @brief Closes a context created with adrenotools_kgsl_context_open or adrenotools_kgsl_context_open_fake
+ * @note The context MUST NOT be the current default context
+ */
+void adrenotools_kgsl_context_close(struct adrenotools_kgsl_context *ctx);
+
+/**
+ * @brief Issues an ioctl on the device backing `ctx`
+ */
+int adrenotools_kgsl_context_ioctl(struct adrenotools_kgsl_context *ctx, unsigned long request, void *arg);
+
+/**
+ * @brief Returns the context used by the memory APIs and hooks, by default this is opened lazily on ADRENOTOOLS_KGSL_DEVICE_PATH
+ * @return The default context or nullptr if the device couldn't be opened, in which case the next call tries to open it again
+ */
+struct adrenotools_kgsl_context *adrenotools_kgsl_context_get_default(void);
+
+/**
+ * @brief Replaces the default context, passing nullptr restores the lazily opened device context
+ * @note This should be called before adrenotools_open_libvulkan as the hooks capture the default context at load time
+ */
+void adrenotools_kgsl_context_set_default(struct adrenotools_kgsl_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief The result of installing an ADPKG driver package, see tools/ADPKG.md for the format
+ */
+enum adrenotools_package_status {
+    ADRENOTOOLS_PACKAGE_SUCCESS,
+    ADRENOTOOLS_PACKAGE_ERROR_IO, //!< The package couldn't be read or the driver directory couldn't be written to
+    ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE, //!< The package isn't a zip, uses a feature that isn't supported (encryption, zip64, compression other than store and deflate) or is corrupt
+    ADRENOTOOLS_PACKAGE_ERROR_INVALID_META, //!< meta.json is missing, isn't valid JSON or lacks `minApi` or a plain file name as `libraryName`
+    ADRENOTOOLS_PACKAGE_ERROR_MISSING_LIBRARY, //!< The library named by `libraryName` isn't in the package
+    ADRENOTOOLS_PACKAGE_ERROR_UNSUPPORTED_API, //!< The package's `minApi` is higher than the device's API level
+};
+
+/**
+ * @brief An installed driver package, everything needed to load it with adrenotools_open_libvulkan
+ */
+struct adrenotools_package {
+    char custom_driver_dir[4096]; //!< The directory the package was installed to with a trailing slash, pass as `customDriverDir`
+    char custom_driver_name[256]; //!< The package's `libraryName`, pass as `customDriverName`
+    char name[256]; //!< The package's `name`, truncated if too long
+    char driver_version[64]; //!< The package's `driverVersion`, empty if it has none
+    uint32_t min_api;
+};
+
+/**
+ * @brief Installs an ADPKG zip into `driverDir`, decompressing each file as it's read so memory use is bounded regardless of the size of the package
+ * @note Files are only renamed into place once every file was extracted and verified against its CRC and meta.json was validated, and are synced to storage once after the last rename. Files with the same name already in `driverDir` are replaced, others are left alone. If any file can't be renamed into place, the files already replaced are restored
+ * @note Only files at the root of the package are installed (including meta.json), anything in subdirectories is ignored
+ * @param packagePath The path of the ADPKG zip, e.g. in external storage
+ * @param driverDir The directory to install the driver into, this is created if it doesn't exist but its parent must. It should be dedicated to this driver as ADRENOTOOLS_DRIVER_PRELOAD loads every library in it
+ * @param package Filled in with the installed package's details on success, may be nullptr
+ */
+enum adrenotools_package_status adrenotools_install_package(const char *packagePath, const char *driverDir, struct adrenotools_package *package);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+#include "kgsl_context.h"
+
+/**
+ * @brief Periodically samples a fixed set of GPU performance counters on a background thread into a lock-free ring buffer
+ * @note Samples are produced by a single thread and must be drained by a single thread at a time
+ */
+struct adrenotools_perfcounter_sampler;
+
+/**
+ * @brief A single hardware counter to sample
+ */
+struct adrenotools_perfcounter {
+    uint32_t group; //!< One of the KGSL_PERFCOUNTER_GROUP_* values
+    uint32_t countable; //!< The event to count within the group, these are GPU generation specific
+};
+
+struct adrenotools_perfcounter_sampler_config {
+    const struct adrenotools_perfcounter *counters;
+    uint32_t counter_count;
+    uint32_t interval_us; //!< The sampling period, if zero no thread is started and samples are only taken by adrenotools_perfcounter_sampler_sample
+    uint32_t capacity; //!< The number of samples the ring buffer can hold, this will be rounded up to a power of two. Samples taken while the buffer is full are dropped
+};
+
+/**
+ * @brief Returns the number of hardware counters available in a counter group
+ * @param ctx The KGSL context to use, if nullptr the default context is used
+ * @return True on success, false if the group doesn't exist on this GPU
+ */
+bool adrenotools_perfcounter_query_group(struct adrenotools_kgsl_context *ctx, uint32_t group, uint32_t *maxCounters);
+
+/**
+ * @brief Reserves all counters in `config` and starts sampling them
+ * @param ctx The KGSL context to use, if nullptr the default context is used
+ * @return The new sampler or nullptr if any counter couldn't be reserved
+ */
+struct adrenotools_perfcounter_sampler *adrenotools_perfcounter_sampler_create(struct adrenotools_kgsl_context *ctx, const struct adrenotools_perfcounter_sampler_config *config);
+
+/**
+ * @brief Stops sampling and releases all reserved counters
+ */
+void adrenotools_perfcounter_sampler_destroy(struct adrenotools_perfcounter_sampler *sampler);
+
+/**
+ * @brief Takes a single sample on the calling thread, this is intended for samplers created with an `interval_us` of zero
+ * @return True if the sample was read and stored
+ */
+bool adrenotools_perfcounter_sampler_sample(struct adrenotools_perfcounter_sampler *sampler);
+
+/**
+ * @brief Moves up to `maxSamples` of the oldest samples out of the ring buffer
+ * @param timestamps Filled with the CLOCK_MONOTONIC time in nanoseconds at which each sample was read
+ * @param values Filled with `counter_count` raw counter values per sample in the order of `config->counters`, counters are free-running so consecutive samples should be subtracted
+ * @return The number of samples written
+ */
+uint32_t adrenotools_perfcounter_sampler_drain(struct adrenotools_perfcounter_sampler *sampler, uint64_t *timestamps, uint64_t *values, uint32_t maxSamples);
+
+/**
+ * @return The number of samples dropped so far due to the ring buffer being full or counter reads failing
+ */
+uint64_t adrenotools_perfcounter_sampler_get_dropped(struct adrenotools_perfcounter_sampler *sampler);
+
+#ifdef __cplusplus
+}
+#endif
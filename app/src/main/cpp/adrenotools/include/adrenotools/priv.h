@@ -12,8 +12,12 @@ enum {
     ADRENOTOOLS_DRIVER_CUSTOM = 1 << 0,
     ADRENOTOOLS_DRIVER_FILE_REDIRECT = 1 << 1,
     ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT = 1 << 2,
+    ADRENOTOOLS_DRIVER_PRELOAD = 1 << 3, //!< Preloads all libraries in the custom driver directory in dependency order before loading the driver, requires ADRENOTOOLS_DRIVER_CUSTOM
 };
 
+/**
+ * @deprecated Mappings are no longer modified once queued and this is never written, poll adrenotools_get_gpu_mapping_status with the mapping's ticket instead
+ */
 #define ADRENOTOOLS_GPU_MAPPING_SUCCEEDED_MAGIC 0xDEADBEEF
 
 /**
@@ -21,7 +25,88 @@ enum {
  */
 struct adrenotools_gpu_mapping {
     void *host_ptr;
-    uint64_t gpu_addr; //!< The GPU address of the mapping to import, if mapping import/init succeeds this will be set to ADRENOTOOLS_GPU_MAPPING_SUCCEEDED_MAGIC
+    uint64_t gpu_addr; //!< The GPU address of the mapping to import
     uint64_t size;
     uint64_t flags;
-};
\ No newline at end of file
+};
+/**
+ * @brief The state of a single mapping passed to the GSL allocation hook, see adrenotools_get_gpu_mapping_status
+ */
+enum adrenotools_gpu_mapping_status {
+    ADRENOTOOLS_GPU_MAPPING_PENDING, //!< The mapping is waiting for a vkAllocateMemory call with a matching size
+    ADRENOTOOLS_GPU_MAPPING_CONSUMED, //!< The mapping was handed to the driver and is now backing a VkDeviceMemory
+    ADRENOTOOLS_GPU_MAPPING_EXPIRED, //!< The slot holding the mapping has been reused since, the mapping was either consumed or cancelled
+    ADRENOTOOLS_GPU_MAPPING_INVALID, //!< The ticket doesn't refer to a mapping
+};
+
+/**
+ * @brief The CPU cache policy of imported or allocated GPU memory
+ */
+enum adrenotools_cache_mode {
+    ADRENOTOOLS_CACHE_MODE_WRITEBACK_COHERENT, //!< Cached and kept coherent with the GPU by hardware, this is the default
+    ADRENOTOOLS_CACHE_MODE_WRITEBACK, //!< Cached but not coherent, adrenotools_sync_ranges must be used around CPU accesses
+    ADRENOTOOLS_CACHE_MODE_WRITECOMBINE, //!< Uncached with write combining, ideal for upload-only streams the CPU never reads back
+    ADRENOTOOLS_CACHE_MODE_UNCACHED,
+};
+
+/**
+ * @brief A CPU mapped memory range to import with adrenotools_import_user_mem_batch
+ */
+struct adrenotools_user_mem_range {
+    void *host_ptr;
+    uint64_t size;
+    uint64_t tag; //!< If non-zero, only an allocation made by the thread with this kernel TID will claim the import
+    enum adrenotools_cache_mode cache_mode;
+};
+
+/**
+ * @brief The outcome of importing a single adrenotools_user_mem_range
+ */
+struct adrenotools_user_mem_import_result {
+    uint64_t gpu_addr; //!< The GPU address the range was imported at
+    uint64_t ticket; //!< Can be passed to adrenotools_get_gpu_mapping_status and adrenotools_cancel_gpu_mapping
+    int32_t error; //!< 0 on success, otherwise a positive errno value describing why the import failed
+};
+
+/**
+ * @brief Configuration for deferring frees of imported GPU objects to a background thread, see adrenotools_enable_deferred_free
+ */
+struct adrenotools_reclaimer_config {
+    uint32_t queue_depth; //!< The maximum number of frees that can be waiting at once, frees beyond this are performed synchronously
+    uint32_t batch_size; //!< The background thread is woken as soon as this many frees have been queued
+    uint32_t flush_interval_ms; //!< The longest time a free can wait in the queue before being issued
+    uint32_t timestamp_context_id; //!< If non-zero, objects are released once this KGSL context retires all work queued at the time of the flush rather than immediately
+};
+
+/**
+ * @brief The direction of a cache maintenance operation performed by adrenotools_sync_ranges
+ */
+enum adrenotools_sync_direction {
+    ADRENOTOOLS_SYNC_TO_GPU = 1 << 0, //!< Cleans CPU caches so the GPU observes CPU writes
+    ADRENOTOOLS_SYNC_FROM_GPU = 1 << 1, //!< Invalidates CPU caches so the CPU observes GPU writes
+    ADRENOTOOLS_SYNC_BOTH = ADRENOTOOLS_SYNC_TO_GPU | ADRENOTOOLS_SYNC_FROM_GPU,
+};
+
+/**
+ * @brief A byte range within an object created by adrenotools to perform cache maintenance on
+ */
+struct adrenotools_sync_range {
+    uint64_t gpu_addr; //!< The base GPU address of the object, as returned at import or allocation time
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * @brief The outcome of opening libvulkan, see adrenotools_open_libvulkan_async
+ */
+enum adrenotools_open_status {
+    ADRENOTOOLS_OPEN_PENDING, //!< The open is still in progress
+    ADRENOTOOLS_OPEN_SUCCESS,
+    ADRENOTOOLS_OPEN_CANCELLED, //!< adrenotools_open_request_cancel was called before the open completed
+    ADRENOTOOLS_OPEN_ERROR_UNSUPPORTED, //!< linkernsbypass failed to load, this probably means the device is on api < 28. Host builds also return this for features they can't provide (file redirection and GPU mapping import)
+    ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS, //!< A parameter was passed for a feature that isn't enabled, or one needed by an enabled feature is missing
+    ADRENOTOOLS_OPEN_ERROR_FILE_NOT_FOUND, //!< The custom driver or the file redirect directory doesn't exist
+    ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED, //!< The hook namespace couldn't be set up, this is usually due to a wrong `hookLibDir`
+    ADRENOTOOLS_OPEN_ERROR_PATCH_FAILED, //!< The soname patched copy of libvulkan couldn't be created
+    ADRENOTOOLS_OPEN_ERROR_LOAD_FAILED, //!< libvulkan or the driver failed to load
+};
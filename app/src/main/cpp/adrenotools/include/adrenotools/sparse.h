@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief A range of GPU virtual address space that's reserved up front and backed with physical pages on demand, memory use scales with the number of resident pages rather than the size of the range
+ * @note All functions are thread-safe
+ */
+struct adrenotools_sparse_resource;
+
+/**
+ * @brief A page aligned byte range within a sparse resource
+ */
+struct adrenotools_sparse_range {
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * @brief Reserves a range of GPU virtual address space without any physical backing
+ * @param pageSize The granularity of commits, must be a power of two multiple of the CPU page size
+ * @return The new resource or nullptr on failure
+ */
+struct adrenotools_sparse_resource *adrenotools_sparse_reserve(uint64_t size, uint64_t pageSize);
+
+/**
+ * @brief Releases the address range and all physical pages backing it
+ * @note The GPU MUST NOT be accessing the range when this is called
+ */
+void adrenotools_sparse_release(struct adrenotools_sparse_resource *resource);
+
+/**
+ * @return The GPU address of the start of the reserved range
+ */
+uint64_t adrenotools_sparse_get_gpu_addr(struct adrenotools_sparse_resource *resource);
+
+/**
+ * @return The number of bytes of physical memory currently allocated for the resource, this includes decommitted pages whose memory is still held by other pages from the same commit
+ */
+uint64_t adrenotools_sparse_get_resident_size(struct adrenotools_sparse_resource *resource);
+
+/**
+ * @brief Backs all pages within `ranges` with physical memory, pages that are already resident are left untouched
+ * @note Each call allocates a single physical object and binds it with a single ioctl regardless of the number of ranges, so callers should batch as many ranges as possible into each call
+ * @note The contents of newly committed pages are undefined
+ * @return True on success, on failure no pages are committed
+ */
+bool adrenotools_sparse_commit(struct adrenotools_sparse_resource *resource, const struct adrenotools_sparse_range *ranges, uint32_t count);
+
+/**
+ * @brief Unbinds all pages within `ranges`, pages that aren't resident are ignored
+ * @note Like commits, all ranges are unbound with a single ioctl. The physical memory from a commit is only freed once all of its pages have been decommitted, so decommit with the same granularity as commits to keep memory use down
+ * @return True on success, on failure no pages are decommitted
+ */
+bool adrenotools_sparse_decommit(struct adrenotools_sparse_resource *resource, const struct adrenotools_sparse_range *ranges, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
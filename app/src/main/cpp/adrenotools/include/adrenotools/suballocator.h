@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#else
+#include <stdbool.h>
+#endif
+
+#include <stdint.h>
+
+/**
+ * @brief Hands out CPU and GPU mapped sub-ranges of large KGSL allocations, avoiding a kernel object and VMA per allocation
+ * @note All functions are thread-safe, allocation and freeing are O(1)
+ */
+struct adrenotools_suballocator;
+
+/**
+ * @brief A range of GPU memory handed out by adrenotools_suballocator_alloc
+ */
+struct adrenotools_suballocation {
+    void *host_ptr;
+    uint64_t gpu_addr;
+    uint64_t size; //!< The size that was requested
+    uint64_t priv; //!< Internal bookkeeping, must be passed back unmodified
+};
+
+struct adrenotools_suballocator_stats {
+    uint32_t block_count; //!< The number of KGSL objects backing the allocator
+    uint32_t allocation_count;
+    uint32_t free_range_count; //!< The number of disjoint free ranges across all blocks
+    uint64_t reserved_bytes; //!< The combined size of all blocks
+    uint64_t allocated_bytes; //!< The bytes reserved by live allocations, including alignment padding
+    uint64_t free_bytes;
+    uint64_t largest_free_bytes; //!< The size of the largest allocation that could currently be made without reserving a new block
+    float fragmentation; //!< 0 when all free memory is contiguous, approaching 1 as it gets split into many small ranges
+};
+
+/**
+ * @brief Creates a new sub-allocator
+ * @param handle Mapping handle that was returned by adrenotools_open_libvulkan, used by adrenotools_suballocator_import
+ * @param blockSize The size of each KGSL allocation to reserve, larger allocations will get a dedicated block
+ * @return The new allocator or nullptr on failure
+ */
+struct adrenotools_suballocator *adrenotools_suballocator_create(void *handle, uint64_t blockSize);
+
+/**
+ * @brief Destroys the allocator, unmapping and freeing all blocks
+ * @note No sub-allocations may be in use by the driver when this is called
+ */
+void adrenotools_suballocator_destroy(struct adrenotools_suballocator *allocator);
+
+/**
+ * @brief Allocates a CPU and GPU mapped range of memory, reserving a new block if necessary
+ * @param alignment The required alignment of both `host_ptr` and `gpu_addr`, must be a power of two no larger than 64 KiB. Ranges are always at least page aligned
+ * @return True on success
+ */
+bool adrenotools_suballocator_alloc(struct adrenotools_suballocator *allocator, uint64_t size, uint64_t alignment, struct adrenotools_suballocation *allocation);
+
+/**
+ * @brief Returns a range to the allocator, any VkDeviceMemory imported from it must have been freed first
+ */
+void adrenotools_suballocator_free(struct adrenotools_suballocator *allocator, const struct adrenotools_suballocation *allocation);
+
+/**
+ * @brief Releases all blocks that have no live allocations back to the kernel
+ * @return The number of bytes released
+ */
+uint64_t adrenotools_suballocator_trim(struct adrenotools_suballocator *allocator);
+
+void adrenotools_suballocator_get_stats(struct adrenotools_suballocator *allocator, struct adrenotools_suballocator_stats *stats);
+
+/**
+ * @brief Queues a sub-allocation for import into the GSL allocator, this should then be followed by a call to vkAllocateMemory with a size of `allocation->size` which will return a VkDeviceMemory view over the range
+ * @note Freeing the VkDeviceMemory doesn't free the range, adrenotools_suballocator_free must still be called afterwards
+ * @param tag See adrenotools_import_user_mem_tagged
+ * @param ticket See adrenotools_import_user_mem_tagged
+ * @return True on success, false if too many imports are pending
+ */
+bool adrenotools_suballocator_import(struct adrenotools_suballocator *allocator, const struct adrenotools_suballocation *allocation, uint64_t tag, uint64_t *ticket);
+
+#ifdef __cplusplus
+}
+#endif
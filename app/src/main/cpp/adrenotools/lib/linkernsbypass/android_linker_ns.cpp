@@ -1,27 +1,65 @@
 // SPDX-License-Identifier: BSD-2-Clause
 // Copyright © 2021 Billy Laws
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <errno.h>
 #include <dlfcn.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <link.h>
+#include <elf.h>
 #include <android/dlext.h>
 #include <android/log.h>
 #include <android/api-level.h>
+#include <sys/auxv.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include "elf_soname_patcher.h"
+#include "elf_view.h"
 #include "android_linker_ns.h"
 
+// Bionic's linker is used directly on Android, other platforms emulate it with dlmopen in android_linker_ns_host.cpp
+#ifdef __ANDROID__
 using loader_android_create_namespace_t = android_namespace_t *(*)(const char *, const char *, const char *, uint64_t, const char *, android_namespace_t *, const void *);
 static loader_android_create_namespace_t loader_android_create_namespace;
 
 static bool lib_loaded;
+#endif
+
+// Used as a unique ID for overwriting soname and creating target lib files, this is atomic so unique libraries can be created from any number of threads at once
+static std::atomic<uint32_t> TargetId{};
+
+static constexpr size_t UniqueIdChars{7}; //!< 36^7 exceeds 2^32 so every ID has a distinct encoding
+using UniqueId = std::array<char, UniqueIdChars + 1>;
 
+/**
+ * @brief Encodes an ID as a fixed-width base 36 string, used to overwrite the start of a soname
+ */
+static UniqueId encode_unique_id(uint32_t id) {
+    static constexpr char Digits[]{"0123456789abcdefghijklmnopqrstuvwxyz"};
+
+    UniqueId encoded{};
+    for (size_t i{UniqueIdChars}; i-- > 0; id /= 36)
+        encoded[i] = Digits[id % 36];
+
+    return encoded;
+}
+
+/**
+ * @brief Allocates a new process-unique ID, see encode_unique_id
+ */
+static UniqueId make_unique_id() {
+    return encode_unique_id(TargetId.fetch_add(1, std::memory_order_relaxed));
+}
 
 /* Public API */
+#ifdef __ANDROID__
 bool linkernsbypass_load_status() {
     return lib_loaded;
 }
@@ -53,6 +91,7 @@ android_get_exported_namespace_t android_get_exported_namespace;
 android_link_namespaces_all_libs_t android_link_namespaces_all_libs;
 
 android_link_namespaces_t android_link_namespaces;
+#endif
 
 bool linkernsbypass_link_namespace_to_default_all_libs(android_namespace_t *to) {
     // Creating a shared namespace with the default parent will give a copy of the default namespace that we can actually access
@@ -62,10 +101,9 @@ bool linkernsbypass_link_namespace_to_default_all_libs(android_namespace_t *to)
 }
 
 void *linkernsbypass_namespace_dlopen(const char *filename, int flags, android_namespace_t *ns) {
-    android_dlextinfo extInfo{
-        .flags = ANDROID_DLEXT_USE_NAMESPACE,
-        .library_namespace = ns
-    };
+    android_dlextinfo extInfo{};
+    extInfo.flags = ANDROID_DLEXT_USE_NAMESPACE;
+    extInfo.library_namespace = ns;
 
     return android_dlopen_ext(filename, flags, &extInfo);
 }
@@ -73,21 +111,21 @@ void *linkernsbypass_namespace_dlopen(const char *filename, int flags, android_n
 #ifndef __NR_memfd_create
     #if defined(__aarch64__)
         #define __NR_memfd_create 279
+    #elif defined(__x86_64__)
+        #define __NR_memfd_create 319
     #else
         #error Unsupported target architecture!
     #endif
 #endif
 
-void *linkernsbypass_namespace_dlopen_unique(const char *libPath, const char *libTargetDir, int flags, android_namespace_t *ns) {
-    static std::array<char, PATH_MAX> PathBuf{};
-
-    // Used as a unique ID for overwriting soname and creating target lib files
-    static uint16_t TargetId{};
+int linkernsbypass_create_unique_lib(const char *libPath, const char *libTargetDir) {
+    auto uniqueId{make_unique_id()};
 
     int libTargetFd{[&] () {
         if (libTargetDir) {
-            snprintf(PathBuf.data(), PathBuf.size(), "%s/%d_patched.so", libTargetDir, TargetId);
-            return open(PathBuf.data(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+            std::array<char, PATH_MAX> libTargetPath{};
+            snprintf(libTargetPath.data(), libTargetPath.size(), "%s/%s_patched.so", libTargetDir, uniqueId.data());
+            return open(libTargetPath.data(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
         } else {
             // If memfd isn't supported errno will contain ENOSYS after calling
             errno = 0;
@@ -99,41 +137,254 @@ void *linkernsbypass_namespace_dlopen_unique(const char *libPath, const char *li
         }
     }()};
     if (libTargetFd == -1)
-        return nullptr;
+        return -1;
 
-    // Partially overwrite soname with 3 digits (replacing lib...) with to make sure a cached so isn't loaded
-    std::array<char, 3> sonameOverwrite{};
-    snprintf(sonameOverwrite.data(), sonameOverwrite.size(), "%03u", TargetId++);
+    // Partially overwrite soname with the unique ID (replacing lib...) to make sure a cached so isn't loaded
+    if (!elf_soname_patch(libPath, libTargetFd, uniqueId.data())) {
+        close(libTargetFd);
+        return -1;
+    }
 
-    if (!elf_soname_patch(libPath, libTargetFd, sonameOverwrite.data()))
-        return nullptr;
+    return libTargetFd;
+}
 
+void *linkernsbypass_namespace_dlopen_fd(int libFd, int flags, android_namespace_t *ns) {
     // Load our patched library into the hook namespace
-    android_dlextinfo hookExtInfo{
-        .flags = ANDROID_DLEXT_USE_NAMESPACE | ANDROID_DLEXT_USE_LIBRARY_FD,
-        .library_fd = libTargetFd,
-        .library_namespace = ns
-    };
+    android_dlextinfo hookExtInfo{};
+    hookExtInfo.flags = ANDROID_DLEXT_USE_NAMESPACE | ANDROID_DLEXT_USE_LIBRARY_FD;
+    hookExtInfo.library_fd = libFd;
+    hookExtInfo.library_namespace = ns;
 
     // Make a path that looks about right
-    snprintf(PathBuf.data(), PathBuf.size(), "/proc/self/fd/%d", libTargetFd);
+    std::array<char, PATH_MAX> fdPath{};
+    snprintf(fdPath.data(), fdPath.size(), "/proc/self/fd/%d", libFd);
+
+    return android_dlopen_ext(fdPath.data(), flags, &hookExtInfo);
+}
+
+void *linkernsbypass_namespace_dlopen_unique(const char *libPath, const char *libTargetDir, int flags, android_namespace_t *ns) {
+    int libTargetFd{linkernsbypass_create_unique_lib(libPath, libTargetDir)};
+    if (libTargetFd == -1)
+        return nullptr;
+
+    return linkernsbypass_namespace_dlopen_fd(libTargetFd, flags, ns);
+}
+
+static uint64_t fnv1a_hash(uint64_t hash, const void *data, size_t size) {
+    auto bytes{reinterpret_cast<const uint8_t *>(data)};
+    for (size_t i{}; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+
+    return hash;
+}
+
+/**
+ * @brief Deletes all cached copies of a library with the given name prefix except `keepName`, these are left behind when the source library is updated
+ */
+static void prune_cached_libs(const char *cacheDir, const char *prefix, const char *keepName) {
+    auto dir{opendir(cacheDir)};
+    if (!dir)
+        return;
 
-    return android_dlopen_ext(PathBuf.data(), flags, &hookExtInfo);
+    size_t prefixLen{strlen(prefix)};
+    std::array<char, PATH_MAX> stalePath{};
+    while (auto entry{readdir(dir)}) {
+        if (strncmp(entry->d_name, prefix, prefixLen) || !strcmp(entry->d_name, keepName))
+            continue;
+
+        snprintf(stalePath.data(), stalePath.size(), "%s/%s", cacheDir, entry->d_name);
+        unlink(stalePath.data());
+    }
+
+    closedir(dir);
 }
 
+int linkernsbypass_create_unique_lib_cached(const char *libPath, const char *cacheDir) {
+    struct stat libStat{};
+    if (stat(libPath, &libStat))
+        return -1;
+
+    ElfView lib{libPath};
+    if (!lib.IsValid())
+        return -1;
+
+    auto buildId{lib.BuildId()};
+
+    // Anything that could change the contents of the patched library is part of the key, so stale entries are never reused. Nothing per-process may be, or whether an entry hits would depend on the order of calls in each launch
+    uint64_t key{0xCBF29CE484222325ULL};
+    key = fnv1a_hash(key, libPath, strlen(libPath));
+    key = fnv1a_hash(key, &libStat.st_size, sizeof(libStat.st_size));
+    key = fnv1a_hash(key, &libStat.st_mtim, sizeof(libStat.st_mtim));
+    key = fnv1a_hash(key, buildId.data(), buildId.size());
+
+    // Partially overwrite soname with an ID derived from the key (replacing lib...) to make sure a system copy of the library isn't loaded instead, this is the same in every launch
+    auto sonameOverwrite{encode_unique_id(static_cast<uint32_t>(key ^ (key >> 32)))};
+
+    auto libName{strrchr(libPath, '/')};
+    libName = libName ? libName + 1 : libPath;
+
+    std::array<char, NAME_MAX> prefix{}, cacheName{};
+    snprintf(prefix.data(), prefix.size(), "%s_%s_", sonameOverwrite.data(), libName);
+    snprintf(cacheName.data(), cacheName.size(), "%s%016llx", prefix.data(), static_cast<unsigned long long>(key));
+
+    std::array<char, PATH_MAX> cachePath{};
+    snprintf(cachePath.data(), cachePath.size(), "%s/%s", cacheDir, cacheName.data());
+
+    int libTargetFd{open(cachePath.data(), O_RDONLY | O_CLOEXEC)};
+    if (libTargetFd != -1) {
+        // Entries are synced and renamed into place only once fully written, but guard against the directory being tampered with. Patching only changes the soname so everything else must match the source library
+        struct stat cacheStat{};
+        bool valid{!fstat(libTargetFd, &cacheStat) && cacheStat.st_size == libStat.st_size};
+        if (valid) {
+            ElfView cached{libTargetFd};
+            valid = cached.IsValid() && !memcmp(&cached.Header(), &lib.Header(), sizeof(lib.Header())) &&
+                    std::ranges::equal(cached.BuildId(), buildId) && cached.Soname().starts_with(sonameOverwrite.data());
+        }
+
+        if (!valid) {
+            close(libTargetFd);
+            libTargetFd = -1;
+        }
+    }
+
+    if (libTargetFd == -1) {
+        std::array<char, PATH_MAX> tmpPath{};
+        snprintf(tmpPath.data(), tmpPath.size(), "%s.%d.tmp", cachePath.data(), getpid());
+
+        libTargetFd = open(tmpPath.data(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (libTargetFd == -1)
+            return -1;
+
+        if (!elf_soname_patch(libPath, libTargetFd, sonameOverwrite.data())) {
+            close(libTargetFd);
+            unlink(tmpPath.data());
+            return -1;
+        }
+
+        // The entry must be durable before it's visible under its final name, otherwise a crash could leave a truncated library to be loaded next launch. If either step fails the fd is still perfectly usable, the library will just be patched again next launch
+        if (!fsync(libTargetFd) && !rename(tmpPath.data(), cachePath.data()))
+            prune_cached_libs(cacheDir, prefix.data(), cacheName.data());
+        else
+            unlink(tmpPath.data());
+    }
+
+    return libTargetFd;
+}
+
+void *linkernsbypass_namespace_dlopen_unique_cached(const char *libPath, const char *cacheDir, int flags, android_namespace_t *ns) {
+    int libTargetFd{linkernsbypass_create_unique_lib_cached(libPath, cacheDir)};
+    if (libTargetFd == -1)
+        return nullptr;
+
+    auto handle{linkernsbypass_namespace_dlopen_fd(libTargetFd, flags, ns)};
+    close(libTargetFd);
+    return handle;
+}
+
+#ifdef __ANDROID__
 static void *align_ptr(void *ptr) {
     return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(ptr) & ~(PAGE_SIZE - 1));
 }
 
 /* Private */
-__attribute__((constructor)) static void resolve_linker_symbols() {
-    using loader_dlopen_t = void *(*)(const char *, int, const void *);
+/**
+ * @return The path of the linker from the executable's PT_INTERP, which is already mapped so nothing has to be read from disk
+ */
+static const char *find_linker_path() {
+    auto pHdrs{reinterpret_cast<const ElfW(Phdr) *>(getauxval(AT_PHDR))};
+    auto pHdrCount{getauxval(AT_PHNUM)};
+    if (!pHdrs)
+        return nullptr;
 
-    if (android_get_device_api_level() < 28)
-        return;
+    // PT_PHDR is needed to find the load bias of the executable
+    const ElfW(Phdr) *interp{};
+    uintptr_t bias{};
+    bool hasBias{};
+    for (size_t i{}; i < pHdrCount; i++) {
+        if (pHdrs[i].p_type == PT_PHDR) {
+            bias = reinterpret_cast<uintptr_t>(pHdrs) - pHdrs[i].p_vaddr;
+            hasBias = true;
+        } else if (pHdrs[i].p_type == PT_INTERP) {
+            interp = &pHdrs[i];
+        }
+    }
+
+    if (!interp || !hasBias)
+        return nullptr;
+
+    return reinterpret_cast<const char *>(bias + interp->p_vaddr);
+}
+
+/**
+ * @brief Resolves the linker's namespace functions by looking them up in its on-disk .dynsym through the hash tables (or .symtab if they're missing), no linker code is read or run and no page protections are changed
+ * @return If all of the functions were found, none are set otherwise
+ */
+static bool resolve_linker_symbols_from_file() {
+    // AT_BASE is the load bias of the linker
+    auto linkerBias{static_cast<uintptr_t>(getauxval(AT_BASE))};
+    auto linkerPath{find_linker_path()};
+    if (!linkerBias || !linkerPath)
+        return false;
+
+    ElfView linker{linkerPath};
+    if (!linker.IsValid())
+        return false;
+
+    // PT_INTERP may name a symlink to a different linker than the one that's mapped (e.g. the bootstrap linker on Android 10+), check the file matches memory before trusting its symbols
+    // The ELF and program headers are compared first so the notes, which carry the build ID, can then be safely read from memory at the addresses the file gives
+    const auto &eHdr{linker.Header()};
+    auto firstLoad{std::find_if(linker.ProgramHeaders().begin(), linker.ProgramHeaders().end(), [](const ElfW(Phdr) &pHdr) { return pHdr.p_type == PT_LOAD; })};
+    uint64_t headersSize{eHdr.e_phoff + static_cast<uint64_t>(eHdr.e_phnum) * eHdr.e_phentsize};
+    if (firstLoad == linker.ProgramHeaders().end() || firstLoad->p_offset != 0 || headersSize > firstLoad->p_filesz)
+        return false;
+
+    if (memcmp(reinterpret_cast<const void *>(linkerBias + firstLoad->p_vaddr), linker.Bytes().data(), headersSize))
+        return false;
+
+    for (const auto &pHdr : linker.ProgramHeaders()) {
+        if (pHdr.p_type != PT_NOTE)
+            continue;
+
+        auto notes{linker.AtOffset<uint8_t>(pHdr.p_offset, pHdr.p_filesz)};
+        if (!notes || memcmp(reinterpret_cast<const void *>(linkerBias + pHdr.p_vaddr), notes, pHdr.p_filesz))
+            return false;
+    }
+
+    auto find_function{[&](const char *name) -> uintptr_t {
+        auto symbol{linker.FindSymbol(name)};
+        if (!symbol)
+            symbol = linker.FindStaticSymbol(name);
+
+        if (!symbol || ELF64_ST_TYPE(symbol->st_info) != STT_FUNC)
+            return 0;
+
+        return linkerBias + symbol->st_value;
+    }};
+
+    auto linkNamespacesAllLibs{find_function("__loader_android_link_namespaces_all_libs")};
+    auto linkNamespaces{find_function("__loader_android_link_namespaces")};
+    auto createNamespace{find_function("__loader_android_create_namespace")};
+    auto getExportedNamespace{find_function("__loader_android_get_exported_namespace")};
+    if (!linkNamespacesAllLibs || !linkNamespaces || !createNamespace || !getExportedNamespace)
+        return false;
+
+    android_link_namespaces_all_libs = reinterpret_cast<android_link_namespaces_all_libs_t>(linkNamespacesAllLibs);
+    android_link_namespaces = reinterpret_cast<android_link_namespaces_t>(linkNamespaces);
+    loader_android_create_namespace = reinterpret_cast<loader_android_create_namespace_t>(createNamespace);
+    android_get_exported_namespace = reinterpret_cast<android_get_exported_namespace_t>(getExportedNamespace);
+    return true;
+}
+
+/**
+ * @brief Resolves the linker's namespace functions by finding __loader_dlopen through dlopen's code and using it to open the linker's libraries from the unrestricted namespace
+ * @note This is only used if the linker's symbols can't be read from disk as it needs to change page protections
+ * @return If all of the functions were found
+ */
+static bool resolve_linker_symbols_from_dlopen() {
+    using loader_dlopen_t = void *(*)(const char *, int, const void *);
 
     // ARM64 specific function walking to locate the internal dlopen handler
-    auto loader_dlopen{[]() {
+    auto loader_dlopen{[]() -> loader_dlopen_t {
         union BranchLinked {
             uint32_t raw;
 
@@ -148,45 +399,58 @@ __attribute__((constructor)) static void resolve_linker_symbols() {
         };
         static_assert(sizeof(BranchLinked) == 4, "BranchLinked is wrong size");
 
+        // dlopen is a short wrapper, if there's no BL within this many instructions it's not the one expected
+        constexpr size_t MaxWalkInstructions{16};
+
         // Some devices ship with --X mapping for exexecutables so work around that
-        mprotect(align_ptr(reinterpret_cast<void *>(&dlopen)), PAGE_SIZE, PROT_WRITE | PROT_READ | PROT_EXEC);
+        auto walkStart{reinterpret_cast<uintptr_t>(&dlopen)};
+        auto walkPage{align_ptr(reinterpret_cast<void *>(walkStart))};
+        mprotect(walkPage, walkStart + MaxWalkInstructions * sizeof(BranchLinked) - reinterpret_cast<uintptr_t>(walkPage), PROT_READ | PROT_EXEC);
 
         // dlopen is just a wrapper for __loader_dlopen that passes the return address as the third arg hence we can just walk it to find __loader_dlopen
-        auto blInstr{reinterpret_cast<BranchLinked *>(&dlopen)};
-        while (!blInstr->Verify())
-            blInstr++;
+        auto blInstr{reinterpret_cast<BranchLinked *>(walkStart)};
+        for (size_t i{}; i < MaxWalkInstructions; i++, blInstr++)
+            if (blInstr->Verify())
+                return reinterpret_cast<loader_dlopen_t>(blInstr + blInstr->offset);
 
-        return reinterpret_cast<loader_dlopen_t>(blInstr + blInstr->offset);
+        return nullptr;
     }()};
+    if (!loader_dlopen)
+        return false;
 
     // Protect the loader_dlopen function to remove the BTI attribute (since this is an internal function that isn't intended to be jumped indirectly to)
-    mprotect(align_ptr(reinterpret_cast<void *>(&loader_dlopen)), PAGE_SIZE, PROT_WRITE | PROT_READ | PROT_EXEC);
+    mprotect(align_ptr(reinterpret_cast<void *>(loader_dlopen)), PAGE_SIZE, PROT_READ | PROT_EXEC);
 
     // Passing dlopen as a caller address tricks the linker into using the internal unrestricted namespace letting us access libraries that are normally forbidden in the classloader namespace imposed on apps
     auto ldHandle{loader_dlopen("ld-android.so", RTLD_LAZY, reinterpret_cast<void *>(&dlopen))};
     if (!ldHandle)
-        return;
+        return false;
 
     android_link_namespaces_all_libs = reinterpret_cast<android_link_namespaces_all_libs_t>(dlsym(ldHandle, "__loader_android_link_namespaces_all_libs"));
     if (!android_link_namespaces_all_libs)
-        return;
+        return false;
 
     android_link_namespaces = reinterpret_cast<android_link_namespaces_t>(dlsym(ldHandle, "__loader_android_link_namespaces"));
     if (!android_link_namespaces)
-        return;
+        return false;
 
     auto libdlAndroidHandle{loader_dlopen("libdl_android.so", RTLD_LAZY, reinterpret_cast<void *>(&dlopen))};
     if (!libdlAndroidHandle)
-        return;
+        return false;
 
     loader_android_create_namespace = reinterpret_cast<loader_android_create_namespace_t>(dlsym(libdlAndroidHandle, "__loader_android_create_namespace"));
     if (!loader_android_create_namespace)
-        return;
+        return false;
 
     android_get_exported_namespace = reinterpret_cast<android_get_exported_namespace_t>(dlsym(libdlAndroidHandle, "__loader_android_get_exported_namespace"));
-    if (!android_get_exported_namespace)
+    return android_get_exported_namespace != nullptr;
+}
+
+__attribute__((constructor)) static void resolve_linker_symbols() {
+    if (android_get_device_api_level() < 28)
         return;
 
     // Lib is now safe to use
-    lib_loaded = true;
+    lib_loaded = resolve_linker_symbols_from_file() || resolve_linker_symbols_from_dlopen();
 }
+#endif
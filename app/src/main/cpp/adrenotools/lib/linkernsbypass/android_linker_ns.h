@@ -67,6 +67,25 @@ bool linkernsbypass_link_namespace_to_default_all_libs(struct android_namespace_
  */
 void *linkernsbypass_namespace_dlopen(const char *filename, int flags, struct android_namespace_t *ns);
 
+/**
+ * @brief Creates a copy of a library with a patched soname, such that it can be loaded as a unique instance
+ * @note This is safe to call from multiple threads at once, every call uses a distinct soname patch and target file
+ * @param libTargetDir A temporary directory to hold the soname patched library at `libPath`, will attempt to use memfd if nullptr
+ * @return A file descriptor for the patched library or -1 on failure, this is owned by the caller
+ */
+int linkernsbypass_create_unique_lib(const char *libPath, const char *libTargetDir);
+
+/**
+ * @brief Like linkernsbypass_create_unique_lib but backed by a persistent cache, see linkernsbypass_namespace_dlopen_unique_cached
+ */
+int linkernsbypass_create_unique_lib_cached(const char *libPath, const char *cacheDir);
+
+/**
+ * @brief Loads the library referred to by `libFd` into a namespace
+ * @note The file descriptor isn't closed
+ */
+void *linkernsbypass_namespace_dlopen_fd(int libFd, int flags, struct android_namespace_t *ns);
+
 /**
  * @brief Force loads a unique instance of a library into a namespace
  * @param libPath The path to the library to load with hooks applied
@@ -76,6 +95,14 @@ void *linkernsbypass_namespace_dlopen(const char *filename, int flags, struct an
  */
 void *linkernsbypass_namespace_dlopen_unique(const char *libPath, const char *libTargetDir, int flags, struct android_namespace_t *ns);
 
+/**
+ * @brief Like linkernsbypass_namespace_dlopen_unique but keeps the soname patched library in a persistent cache, later calls (including in future processes) reuse it instead of copying and patching the library again
+ * @note Cache entries are keyed on the path, size, mtime and build ID of `libPath`, stale entries for the same library are removed when a new one is written
+ * @note The patched soname is derived from the key rather than unique per call, so the same library shouldn't be loaded through the cache twice into namespaces that can see each other
+ * @param cacheDir A persistent writable directory to hold the cached libraries
+ */
+void *linkernsbypass_namespace_dlopen_unique_cached(const char *libPath, const char *cacheDir, int flags, struct android_namespace_t *ns);
+
 #ifdef __cplusplus
 }
 #endif
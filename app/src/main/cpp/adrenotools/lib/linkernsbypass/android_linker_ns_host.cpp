@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+/**
+ * @brief Emulates Android linker namespaces on top of glibc's dlmopen, so the rest of adrenotools can run on a Linux host
+ * @note Every namespace gets its own link map, created by the first library loaded into it. Libraries loaded by name are resolved with the namespace's search paths, then its links and then its parent if it's a shared namespace, this mirrors bionic for libraries loaded directly. Their dependencies are resolved by glibc as usual within the link map
+ * @note glibc can't make a library global in a link map other than the base one, but the first library loaded into a link map along with its dependencies are searched before anything else in it. RTLD_GLOBAL is therefore only honoured for the first library loaded into a namespace (or one already loaded into it), this is the host equivalent of the namespace's LD_PRELOAD list
+ * @note glibc only supports a handful of link maps (each has its own copy of libc, which needs static TLS), GLIBC_TUNABLES=glibc.rtld.optional_static_tls can be raised if loading many drivers side by side
+ */
+
+#include <array>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <dlfcn.h>
+#include <link.h>
+#include <unistd.h>
+#include <android/dlext.h>
+#include <android/log.h>
+#include "android_linker_ns.h"
+
+#define TAG "linkernsbypass"
+#define LOGE(fmt, ...) __android_log_print(ANDROID_LOG_ERROR, TAG, fmt, ##__VA_ARGS__)
+
+/**
+ * @brief A link from one namespace to another, see android_link_namespaces
+ */
+struct NamespaceLink {
+    android_namespace_t *to; //!< nullptr for the default namespace
+    bool allLibs;
+    std::array<char, 256> sharedLibs; //!< Colon separated list of library names, unused if allLibs is set
+};
+
+/**
+ * @note Namespaces are created by whichever copy of linkernsbypass a library links (e.g. adrenotools creates the hook namespace that hook_impl later loads drivers from), so this is kept free of anything owning heap memory and can be used from any copy
+ */
+struct android_namespace_t {
+    std::array<char, 128> name;
+    std::array<char, PATH_MAX> ldLibraryPath;
+    std::array<char, PATH_MAX> defaultLibraryPath;
+    uint64_t type;
+    android_namespace_t *parent; //!< nullptr for the default namespace
+
+    std::mutex mutex; //!< Protects everything below
+    bool hasLinkMap; //!< If the first library has been loaded, creating the link map
+    Lmid_t linkMap;
+    std::array<NamespaceLink, 8> links;
+    size_t linkCount;
+};
+
+/**
+ * @return The link map the calling library was loaded into, this is where bionic would load libraries requested without a namespace
+ */
+static Lmid_t caller_link_map() {
+    Dl_info info{};
+    link_map *map{};
+    Lmid_t lmid{LM_ID_BASE};
+    if (dladdr1(reinterpret_cast<void *>(&caller_link_map), &info, reinterpret_cast<void **>(&map), RTLD_DL_LINKMAP) && map)
+        dlinfo(map, RTLD_DI_LMID, &lmid);
+
+    return lmid;
+}
+
+/**
+ * @return If `name` is contained in the colon separated `list`
+ */
+static bool list_contains(const char *list, std::string_view name) {
+    std::string_view remaining{list};
+    while (!remaining.empty()) {
+        auto end{remaining.find(':')};
+        if (remaining.substr(0, end) == name)
+            return true;
+
+        if (end == std::string_view::npos)
+            break;
+
+        remaining.remove_prefix(end + 1);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Searches a colon separated list of directories for `filename`
+ * @return If the library was found, `path` is set to its full path
+ */
+static bool find_in_paths(const char *paths, const char *filename, std::array<char, PATH_MAX> &path) {
+    std::string_view remaining{paths};
+    while (!remaining.empty()) {
+        auto end{remaining.find(':')};
+        auto dir{remaining.substr(0, end)};
+        if (!dir.empty()) {
+            // Search paths are often passed with a trailing slash (e.g. customDriverDir)
+            bool slash{dir.back() == '/'};
+            snprintf(path.data(), path.size(), "%.*s%s%s", static_cast<int>(dir.size()), dir.data(), slash ? "" : "/", filename);
+            if (!access(path.data(), F_OK))
+                return true;
+        }
+
+        if (end == std::string_view::npos)
+            break;
+
+        remaining.remove_prefix(end + 1);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Loads a library into the namespace's own link map, creating it if this is the first library
+ * @param path The full path of the library to load
+ */
+static void *load_into_link_map(android_namespace_t *ns, const char *path, int flags) {
+    if (!ns)
+        return dlmopen(LM_ID_BASE, path, flags);
+
+    bool global{(flags & RTLD_GLOBAL) != 0};
+    flags &= ~RTLD_GLOBAL; // dlmopen rejects RTLD_GLOBAL for any link map other than the base one
+    if (!(flags & (RTLD_LAZY | RTLD_NOW)))
+        flags |= RTLD_NOW; // Bionic doesn't require a binding mode and always binds immediately
+
+    std::scoped_lock lock{ns->mutex};
+    if (!ns->hasLinkMap) {
+        auto handle{dlmopen(LM_ID_NEWLM, path, flags)};
+        if (!handle)
+            return nullptr;
+
+        if (dlinfo(handle, RTLD_DI_LMID, &ns->linkMap)) {
+            dlclose(handle);
+            return nullptr;
+        }
+
+        ns->hasLinkMap = true;
+        return handle;
+    }
+
+    if (global) {
+        // Libraries already loaded may well be part of the link map's first library's dependencies and thus global, anything else can't be made so
+        if (auto handle{dlmopen(ns->linkMap, path, flags | RTLD_NOLOAD)})
+            return handle;
+
+        LOGE("%s: can't load %s with RTLD_GLOBAL, only the first library loaded into a namespace can be global on this platform", ns->name.data(), path);
+        return nullptr;
+    }
+
+    return dlmopen(ns->linkMap, path, flags);
+}
+
+static void *namespace_dlopen(android_namespace_t *ns, const char *filename, int flags) {
+    if (!ns || strchr(filename, '/'))
+        return load_into_link_map(ns, filename, flags);
+
+    std::array<char, PATH_MAX> path{};
+    if (find_in_paths(ns->ldLibraryPath.data(), filename, path) || find_in_paths(ns->defaultLibraryPath.data(), filename, path))
+        return load_into_link_map(ns, path.data(), flags);
+
+    std::array<NamespaceLink, 8> links;
+    size_t linkCount;
+    {
+        std::scoped_lock lock{ns->mutex};
+        links = ns->links;
+        linkCount = ns->linkCount;
+    }
+
+    for (size_t i{}; i < linkCount; i++)
+        if (links[i].allLibs || list_contains(links[i].sharedLibs.data(), filename))
+            if (auto handle{namespace_dlopen(links[i].to, filename, flags)})
+                return handle;
+
+    // Shared namespaces can use everything their parent can, this is also how copies of the default namespace reach system libraries
+    if (ns->type & ANDROID_NAMESPACE_TYPE_SHARED)
+        return namespace_dlopen(ns->parent, filename, flags);
+
+    // Let glibc search the system library paths, loading the library into the namespace
+    return load_into_link_map(ns, filename, flags);
+}
+
+static bool link_namespaces(android_namespace_t *from, android_namespace_t *to, const char *sharedLibs, bool allLibs) {
+    if (!from)
+        return false; // Links from the default namespace aren't supported, it's always searched last
+
+    std::scoped_lock lock{from->mutex};
+    if (from->linkCount == from->links.size())
+        return false;
+
+    auto &link{from->links[from->linkCount]};
+    link = {.to = to, .allLibs = allLibs, .sharedLibs = {}};
+    if (sharedLibs && strlen(sharedLibs) >= link.sharedLibs.size())
+        return false;
+
+    if (sharedLibs)
+        strcpy(link.sharedLibs.data(), sharedLibs);
+
+    from->linkCount++;
+    return true;
+}
+
+static bool host_link_namespaces_all_libs(android_namespace_t *from, android_namespace_t *to) {
+    return link_namespaces(from, to, nullptr, true);
+}
+
+static bool host_link_namespaces(android_namespace_t *from, android_namespace_t *to, const char *sharedLibs) {
+    return link_namespaces(from, to, sharedLibs, false);
+}
+
+static android_namespace_t *host_get_exported_namespace(const char *) {
+    return nullptr; // Hosts have no vendor namespaces
+}
+
+/* Public API */
+bool linkernsbypass_load_status() {
+    return true;
+}
+
+struct android_namespace_t *android_create_namespace(const char *name,
+                                                     const char *ld_library_path,
+                                                     const char *default_library_path,
+                                                     uint64_t type,
+                                                     const char *,
+                                                     android_namespace_t *parent_namespace) {
+    // Never freed, like namespaces in bionic
+    auto ns{new android_namespace_t{}};
+    snprintf(ns->name.data(), ns->name.size(), "%s", name ? name : "");
+    snprintf(ns->ldLibraryPath.data(), ns->ldLibraryPath.size(), "%s", ld_library_path ? ld_library_path : "");
+    snprintf(ns->defaultLibraryPath.data(), ns->defaultLibraryPath.size(), "%s", default_library_path ? default_library_path : "");
+    ns->type = type;
+    ns->parent = parent_namespace;
+    return ns;
+}
+
+struct android_namespace_t *android_create_namespace_escape(const char *name,
+                                                            const char *ld_library_path,
+                                                            const char *default_library_path,
+                                                            uint64_t type,
+                                                            const char *permitted_when_isolated_path,
+                                                            android_namespace_t *parent_namespace) {
+    // There are no namespace restrictions to escape on hosts
+    return android_create_namespace(name, ld_library_path, default_library_path, type, permitted_when_isolated_path, parent_namespace);
+}
+
+android_get_exported_namespace_t android_get_exported_namespace{host_get_exported_namespace};
+
+android_link_namespaces_all_libs_t android_link_namespaces_all_libs{host_link_namespaces_all_libs};
+
+android_link_namespaces_t android_link_namespaces{host_link_namespaces};
+
+void *android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo) {
+    // dlopen(nullptr) always refers to the main executable, which lives in the base link map
+    if (!filename)
+        return dlmopen(LM_ID_BASE, nullptr, flags & ~RTLD_GLOBAL);
+
+    // dlopen isn't used as it may be hooked within the caller's link map
+    if (!extinfo || !(extinfo->flags & ANDROID_DLEXT_USE_NAMESPACE)) {
+        auto lmid{caller_link_map()};
+        return dlmopen(lmid, filename, lmid == LM_ID_BASE ? flags : flags & ~RTLD_GLOBAL);
+    }
+
+    if (extinfo->flags & ANDROID_DLEXT_USE_LIBRARY_FD) {
+        std::array<char, PATH_MAX> fdPath{};
+        snprintf(fdPath.data(), fdPath.size(), "/proc/self/fd/%d", extinfo->library_fd);
+        return load_into_link_map(extinfo->library_namespace, fdPath.data(), flags);
+    }
+
+    return namespace_dlopen(extinfo->library_namespace, filename, flags);
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+/**
+ * @brief Times ElfView over large libraries (e.g. 100MB+ vendor driver blobs), every table is walked and every defined symbol is looked up through each hash table, with a sample looked up by linear scan for comparison
+ * @note Usage: elf_view_bench [--iterations N] <library>...
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <sys/stat.h>
+#include "elf_view.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_us(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/**
+ * @brief Keeps results alive so the compiler can't drop the work that produced them
+ */
+static volatile size_t sink;
+
+static constexpr size_t LinearSampleCount{1000}; //!< The amount of symbols looked up with a linear scan
+
+/**
+ * @brief Looks up every defined symbol in the library through `find`
+ * @return The number of symbols that weren't found, which should be zero
+ */
+template<typename Find>
+static size_t lookup_all(const ElfView &elf, Find find) {
+    size_t missed{};
+    for (const auto &symbol : elf.Symbols()) {
+        if (!symbol.st_name || symbol.st_shndx == SHN_UNDEF)
+            continue;
+
+        if (!find(elf.SymbolName(symbol)))
+            missed++;
+    }
+
+    return missed;
+}
+
+static bool bench_library(const char *path, int iterations) {
+    struct stat libStat{};
+    if (stat(path, &libStat)) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    double mapUs{}, tablesUs{}, gnuUs{}, sysvUs{}, linearUs{};
+    size_t symbolCount{}, definedCount{}, neededCount{}, noteCount{}, gnuMissed{}, sysvMissed{};
+    size_t linearSampled{};
+    bool hasGnuHash{}, hasSysvHash{};
+
+    for (int i{}; i < iterations; i++) {
+        auto start{Clock::now()};
+        ElfView elf{path};
+        mapUs += elapsed_us(start);
+        if (!elf.IsValid()) {
+            fprintf(stderr, "%s: not a valid ELF64 library\n", path);
+            return false;
+        }
+
+        start = Clock::now();
+        size_t checksum{};
+        for (const auto &pHdr : elf.ProgramHeaders())
+            checksum += pHdr.p_type;
+        for (const auto &sHdr : elf.Sections())
+            checksum += elf.SectionName(sHdr).size();
+        neededCount = 0;
+        for (auto needed : elf.Needed())
+            checksum += needed.size(), neededCount++;
+        noteCount = 0;
+        for (const auto &note : elf.Notes())
+            checksum += note.desc.size(), noteCount++;
+        symbolCount = elf.Symbols().size();
+        definedCount = 0;
+        for (const auto &symbol : elf.Symbols())
+            if (symbol.st_name && symbol.st_shndx != SHN_UNDEF)
+                definedCount++;
+        sink = checksum;
+        tablesUs += elapsed_us(start);
+
+        // Looking up a symbol by hash is the common case when resolving against a driver, measure it against a linear scan of .dynsym
+        start = Clock::now();
+        gnuMissed = lookup_all(elf, [&](std::string_view name) { return elf.FindSymbolGnu(name) != nullptr; });
+        gnuUs += elapsed_us(start);
+
+        start = Clock::now();
+        sysvMissed = lookup_all(elf, [&](std::string_view name) { return elf.FindSymbolSysv(name) != nullptr; });
+        sysvUs += elapsed_us(start);
+
+        hasGnuHash = elf.HasGnuHash();
+        hasSysvHash = elf.HasSysvHash();
+
+        // A linear scan of every symbol is quadratic and takes minutes on large blobs, so only a sample of symbols is looked up and only once
+        if (i == 0) {
+            size_t stride{std::max<size_t>(1, symbolCount / LinearSampleCount)};
+            start = Clock::now();
+            for (size_t index{}; index < symbolCount; index += stride) {
+                const auto &wanted{elf.Symbols()[index]};
+                if (!wanted.st_name || wanted.st_shndx == SHN_UNDEF)
+                    continue;
+
+                auto name{elf.SymbolName(wanted)};
+                for (const auto &symbol : elf.Symbols())
+                    if (symbol.st_shndx != SHN_UNDEF && elf.SymbolName(symbol) == name) {
+                        sink = symbol.st_value;
+                        break;
+                    }
+                linearSampled++;
+            }
+            linearUs = elapsed_us(start);
+        }
+    }
+
+    printf("%s: %.1f MiB, %zu symbols (%zu defined), %zu needed, %zu notes\n", path, static_cast<double>(libStat.st_size) / (1024 * 1024), symbolCount, definedCount, neededCount, noteCount);
+    printf("  map            %10.1f us\n", mapUs / iterations);
+    printf("  walk tables    %10.1f us\n", tablesUs / iterations);
+    if (hasGnuHash)
+        printf("  gnu lookups    %10.1f us (%.3f us/symbol, %zu missed)\n", gnuUs / iterations, definedCount ? gnuUs / iterations / static_cast<double>(definedCount) : 0.0, gnuMissed);
+    else
+        printf("  gnu lookups           n/a (no DT_GNU_HASH)\n");
+    if (hasSysvHash)
+        printf("  sysv lookups   %10.1f us (%.3f us/symbol, %zu missed)\n", sysvUs / iterations, definedCount ? sysvUs / iterations / static_cast<double>(definedCount) : 0.0, sysvMissed);
+    else
+        printf("  sysv lookups          n/a (no DT_HASH)\n");
+    printf("  linear lookups %10.1f us (%.3f us/symbol, %zu sampled)\n", linearUs, linearSampled ? linearUs / static_cast<double>(linearSampled) : 0.0, linearSampled);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int iterations{10};
+    int firstPath{1};
+    if (argc > 2 && std::string_view{argv[1]} == "--iterations") {
+        iterations = std::max(1, atoi(argv[2]));
+        firstPath = 3;
+    }
+
+    if (firstPath >= argc) {
+        fprintf(stderr, "Usage: %s [--iterations N] <library>...\n", argv[0]);
+        return 1;
+    }
+
+    bool success{true};
+    for (int i{firstPath}; i < argc; i++)
+        success &= bench_library(argv[i], iterations);
+
+    return success ? 0 : 1;
+}
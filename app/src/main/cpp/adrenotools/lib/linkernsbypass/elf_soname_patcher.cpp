@@ -2,66 +2,287 @@
 // Copyright © 2021 Billy Laws
 
 #include <initializer_list>
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <errno.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <link.h>
-#include <elf.h>
 #include "elf_soname_patcher.h"
+#include "elf_view.h"
 
-bool elf_soname_patch(const char *libPath, int targetFd, const char *sonamePatch) {
-    struct stat libStat{};
-    if (stat(libPath, &libStat))
-        return false;
+#ifndef __NR_copy_file_range
+    #if defined(__aarch64__)
+        #define __NR_copy_file_range 285
+    #else
+        #error Unsupported target architecture!
+    #endif
+#endif
+
+/**
+ * @brief Copies `size` bytes from the start of `srcFd` to `dstFd` inside the kernel, avoiding a bounce through a userspace buffer
+ */
+static bool copy_file(int srcFd, int dstFd, off_t size) {
+    // copy_file_range can share extents on filesystems that support it, but fails with EXDEV across filesystems on older kernels
+    loff_t srcOffset{}, dstOffset{};
+    while (srcOffset < size) {
+        auto copied{syscall(__NR_copy_file_range, srcFd, &srcOffset, dstFd, &dstOffset, static_cast<size_t>(size - srcOffset), 0)};
+        if (copied <= 0)
+            break;
+    }
+
+    if (srcOffset == size)
+        return true;
 
-    if (ftruncate(targetFd, libStat.st_size) == -1)
+    // sendfile has supported arbitrary destination fds since 2.6.33, resume from wherever copy_file_range stopped
+    off_t offset{srcOffset};
+    if (lseek(dstFd, offset, SEEK_SET) != offset)
         return false;
 
-    // Map the memory so we can read our elf into it
-    auto mappedLib{reinterpret_cast<uint8_t *>(mmap(nullptr, libStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, targetFd, 0))};
-    if (!mappedLib)
+    while (offset < size) {
+        auto sent{sendfile(dstFd, srcFd, &offset, static_cast<size_t>(size - offset))};
+        if (sent <= 0)
+            return false;
+    }
+
+    return true;
+}
+
+bool elf_soname_patch(const char *libPath, int targetFd, const char *sonamePatch) {
+    int libFd{open(libPath, O_RDONLY | O_CLOEXEC)};
+    if (libFd == -1)
         return false;
 
-    int libFd{open(libPath, O_RDONLY)};
-    if (libFd == false)
+    bool success{[&]() {
+        struct stat libStat{};
+        if (fstat(libFd, &libStat))
+            return false;
+
+        if (ftruncate(targetFd, libStat.st_size) == -1)
+            return false;
+
+        // Only the headers and .dynamic are paged in to find the soname
+        auto sonameOffset{static_cast<off_t>(ElfView{libFd}.SonameOffset())};
+        if (sonameOffset < 0)
+            return false;
+
+        if (!copy_file(libFd, targetFd, libStat.st_size))
+            return false;
+
+        // Only the bytes of the soname itself are read back and rewritten, leaving the rest of the copy untouched
+        std::array<char, 256> soname{};
+        auto sonameRead{pread(targetFd, soname.data(), soname.size(), sonameOffset)};
+        if (sonameRead <= 0)
+            return false;
+
+        // Partially replace the old soname with the soname patch
+        size_t charIdx{};
+        for (; charIdx < static_cast<size_t>(sonameRead) && soname[charIdx] != 0 && sonamePatch[charIdx] != 0; charIdx++)
+            soname[charIdx] = sonamePatch[charIdx];
+
+        // A truncated patch could collide with another patched copy, so the whole patch must fit
+        if (sonamePatch[charIdx] != 0)
+            return false;
+
+        return pwrite(targetFd, soname.data(), charIdx, sonameOffset) == static_cast<ssize_t>(charIdx);
+    }()};
+
+    close(libFd);
+    return success;
+}
+
+template<typename T>
+static bool pwrite_object(int fd, const T &object, off_t offset) {
+    return pwrite(fd, &object, sizeof(T), offset) == sizeof(T);
+}
+
+/**
+ * @brief Appends `name` to the new string table if no rename has added it yet
+ * @return The offset of the name in the new string table
+ */
+static Elf64_Word append_string(std::vector<char> &strings, size_t oldSize, std::string_view name) {
+    // Identical names are merged so renaming many libraries to the same shim only adds it once
+    for (size_t offset{oldSize}; offset < strings.size(); offset += strlen(strings.data() + offset) + 1)
+        if (name == strings.data() + offset)
+            return static_cast<Elf64_Word>(offset);
+
+    auto offset{static_cast<Elf64_Word>(strings.size())};
+    strings.insert(strings.end(), name.begin(), name.end());
+    strings.push_back('\0');
+    return offset;
+}
+
+bool elf_rename_libraries_fd(int fd, const struct elf_library_rename *renames, size_t renameCount) {
+    ElfView elf{fd};
+    if (!elf.IsValid())
         return false;
 
-    // Read lib elf into target file
-    if (read(libFd, mappedLib, libStat.st_size) != libStat.st_size)
+    auto findRename{[&](std::string_view name) -> const char * {
+        for (size_t i{}; i < renameCount; i++)
+            if (name == renames[i].from)
+                return renames[i].to;
+
+        return nullptr;
+    }};
+
+    // The old table is kept intact at the start of the new one, so every existing reference into it (symbol names, version names) stays valid
+    auto oldStrings{elf.DynamicStrings()};
+    if (oldStrings.empty())
         return false;
 
-    // No longer needed
-    close(libFd);
+    std::vector<char> strings{oldStrings.begin(), oldStrings.end()};
+
+    // Every change is worked out from the view before anything is written, as writes may show through its private mapping
+    auto fileOffset{[&](const void *object) {
+        return static_cast<off_t>(reinterpret_cast<const uint8_t *>(object) - elf.Bytes().data());
+    }};
+
+    struct Patch {
+        off_t offset; //!< The file offset of the field to replace
+        Elf64_Xword value;
+        size_t size; //!< The size of the field, the value is truncated to it (ElfView only accepts little endian files)
+    };
+    std::vector<Patch> patches;
+
+    for (const auto &entry : elf.DynamicEntries()) {
+        if (entry.d_tag != DT_SONAME && entry.d_tag != DT_NEEDED)
+            continue;
+
+        if (auto newName{findRename(elf.DynamicString(entry.d_un.d_val))})
+            patches.push_back({fileOffset(&entry.d_un.d_val), append_string(strings, oldStrings.size(), newName), sizeof(entry.d_un.d_val)});
+    }
+
+    // Version requirements name the library they're satisfied by, which the loader checks against the soname of what DT_NEEDED loaded
+    const Elf64_Dyn *verneedEntry{}, *verneedNumEntry{};
+    for (const auto &entry : elf.DynamicEntries()) {
+        if (entry.d_tag == DT_VERNEED)
+            verneedEntry = &entry;
+        else if (entry.d_tag == DT_VERNEEDNUM)
+            verneedNumEntry = &entry;
+    }
+
+    if (verneedEntry && verneedNumEntry) {
+        Elf64_Addr address{verneedEntry->d_un.d_ptr};
+        for (Elf64_Xword i{}; i < verneedNumEntry->d_un.d_val; i++) {
+            auto verneed{elf.AtAddress<Elf64_Verneed>(address)};
+            if (!verneed)
+                return false;
+
+            if (auto newName{findRename(elf.DynamicString(verneed->vn_file))})
+                patches.push_back({fileOffset(&verneed->vn_file), append_string(strings, oldStrings.size(), newName), sizeof(verneed->vn_file)});
 
-    auto eHdr{reinterpret_cast<ElfW(Ehdr) *>(mappedLib)};
-    auto sHdrEntries{reinterpret_cast<ElfW(Shdr) *>(mappedLib + eHdr->e_shoff)};
-
-    // Iterate over section headers to find the .dynamic section
-    for (ElfW(Half) i{}; i < eHdr->e_shnum; i++) {
-        auto &sHdr{sHdrEntries[i]};
-        if (sHdr.sh_type == SHT_DYNAMIC) {
-            auto strTab{reinterpret_cast<char *>(mappedLib + sHdrEntries[sHdr.sh_link].sh_offset)};
-            auto dynHdrEntries{reinterpret_cast<ElfW(Dyn) *>(mappedLib + sHdr.sh_offset)};
-
-            // Iterate over .dynamic entries to find DT_SONAME
-            for (ElfW(Xword) k{}; k < (sHdr.sh_size / sHdr.sh_entsize); k++) {
-                auto &dynHdrEntry{dynHdrEntries[k]};
-                if (dynHdrEntry.d_tag == DT_SONAME) {
-                    char *soname{strTab + dynHdrEntry.d_un.d_val};
-
-                    // Partially replace the old soname with the soname patch
-                    size_t charIdx{};
-                    for (; soname[charIdx] != 0 && sonamePatch[charIdx] != 0; charIdx++)
-                        soname[charIdx] = sonamePatch[charIdx];
-
-                    return true;
-                }
-            }
+            if (!verneed->vn_next)
+                break;
+
+            address += verneed->vn_next;
         }
     }
 
-    return false;
+    if (patches.empty())
+        return true;
+
+    // The new string table gets its own read-only segment after all the others, it must be aligned like them so its file offset and address are congruent
+    Elf64_Addr loadEnd{};
+    Elf64_Xword loadAlign{0x1000};
+    const Elf64_Phdr *spareSlot{};
+    for (const auto &pHdr : elf.ProgramHeaders()) {
+        if (pHdr.p_type == PT_LOAD) {
+            loadEnd = std::max(loadEnd, pHdr.p_vaddr + pHdr.p_memsz);
+            loadAlign = std::max(loadAlign, pHdr.p_align);
+        } else if (pHdr.p_type == PT_NULL || (pHdr.p_type == PT_NOTE && (!spareSlot || spareSlot->p_type != PT_NULL))) {
+            spareSlot = &pHdr;
+        }
+    }
+
+    // Growing the program header table would mean moving it, so an unused or PT_NOTE slot is taken for the segment instead, loaders don't need notes
+    if (!spareSlot)
+        return false;
+
+    auto alignUp{[&](uint64_t value) { return (value + loadAlign - 1) & ~(loadAlign - 1); }};
+    Elf64_Phdr stringsLoad{
+        .p_type = PT_LOAD,
+        .p_flags = PF_R,
+        .p_offset = alignUp(elf.Bytes().size()),
+        .p_vaddr = alignUp(loadEnd),
+        .p_paddr = alignUp(loadEnd),
+        .p_filesz = strings.size(),
+        .p_memsz = strings.size(),
+        .p_align = loadAlign,
+    };
+
+    // Loaders expect PT_LOAD segments in ascending address order, so the new one goes after the last of them and anything in between shifts up into the freed slot
+    std::vector<Elf64_Phdr> pHdrs{elf.ProgramHeaders().begin(), elf.ProgramHeaders().end()};
+    size_t slotIndex{static_cast<size_t>(spareSlot - &elf.ProgramHeaders()[0])};
+    pHdrs.erase(pHdrs.begin() + static_cast<std::ptrdiff_t>(slotIndex));
+    auto lastLoad{std::find_if(pHdrs.rbegin(), pHdrs.rend(), [](const Elf64_Phdr &pHdr) { return pHdr.p_type == PT_LOAD; })};
+    pHdrs.insert(lastLoad.base(), stringsLoad);
+
+    for (const auto &entry : elf.DynamicEntries()) {
+        if (entry.d_tag == DT_STRTAB)
+            patches.push_back({fileOffset(&entry.d_un.d_ptr), stringsLoad.p_vaddr, sizeof(entry.d_un.d_ptr)});
+        else if (entry.d_tag == DT_STRSZ)
+            patches.push_back({fileOffset(&entry.d_un.d_val), strings.size(), sizeof(entry.d_un.d_val)});
+    }
+
+    // Keep .dynstr pointing at the table in use for tools that read sections rather than .dynamic
+    std::vector<std::pair<off_t, Elf64_Shdr>> sHdrPatches;
+    for (const auto &sHdr : elf.Sections()) {
+        if (sHdr.sh_type != SHT_STRTAB || static_cast<off_t>(sHdr.sh_offset) != fileOffset(oldStrings.data()))
+            continue;
+
+        auto newSHdr{sHdr};
+        newSHdr.sh_offset = stringsLoad.p_offset;
+        newSHdr.sh_addr = stringsLoad.p_vaddr;
+        newSHdr.sh_size = strings.size();
+        sHdrPatches.emplace_back(fileOffset(&sHdr), newSHdr);
+    }
+
+    auto phOffset{static_cast<off_t>(elf.Header().e_phoff)};
+    auto phEntSize{elf.Header().e_phentsize};
+    if (pwrite(fd, strings.data(), strings.size(), static_cast<off_t>(stringsLoad.p_offset)) != static_cast<ssize_t>(strings.size()))
+        return false;
+
+    for (size_t i{}; i < pHdrs.size(); i++)
+        if (!pwrite_object(fd, pHdrs[i], phOffset + static_cast<off_t>(i * phEntSize)))
+            return false;
+
+    for (const auto &patch : patches)
+        if (pwrite(fd, &patch.value, patch.size, patch.offset) != static_cast<ssize_t>(patch.size))
+            return false;
+
+    for (const auto &[offset, sHdr] : sHdrPatches)
+        if (!pwrite_object(fd, sHdr, offset))
+            return false;
+
+    return true;
+}
+
+bool elf_rename_libraries(const char *libPath, int targetFd, const struct elf_library_rename *renames, size_t renameCount) {
+    int libFd{open(libPath, O_RDONLY | O_CLOEXEC)};
+    if (libFd == -1)
+        return false;
+
+    bool success{[&]() {
+        struct stat libStat{};
+        if (fstat(libFd, &libStat))
+            return false;
+
+        if (ftruncate(targetFd, libStat.st_size) == -1)
+            return false;
+
+        if (!copy_file(libFd, targetFd, libStat.st_size))
+            return false;
+
+        return elf_rename_libraries_fd(targetFd, renames, renameCount);
+    }()};
+
+    close(libFd);
+    return success;
 }
@@ -7,15 +7,39 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 /**
- * @brief  Overwrites a portion of the soname in an elf by loading it into shared memory and modifying .dynstr
- * @note   IMPORTANT: The supplied soname patch will overwrite the first strlen(sonamePatch) chars of the soname
+ * @brief  Overwrites a portion of the soname in an elf by copying it to `targetFd` in-kernel and rewriting only the soname bytes in .dynstr
+ * @note   IMPORTANT: The supplied soname patch will overwrite the first strlen(sonamePatch) chars of the soname, patching fails if the soname is shorter than the patch
  * @param  elfPath Full path to the elf to patch
  * @param  targetFd FD to use for storing the patched library
  * @return True on success
  */
 bool elf_soname_patch(const char *elfPath, int targetFd, const char *newSoname);
 
+/**
+ * @brief A library name to replace with elf_rename_libraries
+ */
+struct elf_library_rename {
+    const char *from; //!< The name as it appears in DT_SONAME or DT_NEEDED
+    const char *to; //!< The name to replace it with, this can be any length
+};
+
+/**
+ * @brief Renames the libraries an elf names in DT_SONAME, DT_NEEDED and its version requirements in one pass, in place
+ * @note New names are appended to a copy of .dynstr at the end of the file in a new read-only PT_LOAD segment, .dynamic is then pointed at it. The segment takes the place of a PT_NULL or PT_NOTE program header, so renaming fails if the elf has neither (e.g. if it has already been renamed once)
+ * @param fd A readable and writable FD of the elf, such as a memfd the elf was extracted into
+ * @param renames Names that aren't present in the elf are ignored
+ * @return True on success, the elf is left untouched if nothing needed renaming
+ */
+bool elf_rename_libraries_fd(int fd, const struct elf_library_rename *renames, size_t renameCount);
+
+/**
+ * @brief Like elf_rename_libraries_fd but copies the elf at `elfPath` into `targetFd` in-kernel first
+ */
+bool elf_rename_libraries(const char *elfPath, int targetFd, const struct elf_library_rename *renames, size_t renameCount);
+
 #ifdef __cplusplus
 }
 #endif
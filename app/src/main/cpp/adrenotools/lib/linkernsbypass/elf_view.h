@@ -0,0 +1,729 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <elf.h>
+
+/**
+ * @brief A read-only view of an ELF64 file backed by a private mapping of it, nothing is allocated and only the pages that are accessed get read from disk
+ * @note Everything returned points into the mapping and is only valid for the lifetime of the view. Every access is bounds checked, malformed files give empty ranges and nullptrs rather than reads outside the file
+ * @note This is header-only as it's used by both adrenotools and hook_impl, which live in separate linker namespaces
+ */
+class ElfView {
+  public:
+    /**
+     * @brief A table of entries with a stride taken from the file (e.g. e_phentsize), which may be larger than the entry itself
+     */
+    template<typename T>
+    class Table {
+      private:
+        const uint8_t *base{};
+        size_t count{};
+        size_t stride{sizeof(T)};
+
+      public:
+        class Iterator {
+          private:
+            const uint8_t *entry{};
+            size_t stride{sizeof(T)};
+
+          public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T *;
+            using reference = const T &;
+
+            Iterator() = default;
+
+            Iterator(const uint8_t *entry, size_t stride) : entry{entry}, stride{stride} {}
+
+            const T &operator*() const {
+                return *reinterpret_cast<const T *>(entry);
+            }
+
+            const T *operator->() const {
+                return reinterpret_cast<const T *>(entry);
+            }
+
+            Iterator &operator++() {
+                entry += stride;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto copy{*this};
+                entry += stride;
+                return copy;
+            }
+
+            bool operator==(const Iterator &other) const {
+                return entry == other.entry;
+            }
+        };
+
+        Table() = default;
+
+        Table(const uint8_t *base, size_t count, size_t stride) : base{base}, count{count}, stride{stride} {}
+
+        Iterator begin() const {
+            return {base, stride};
+        }
+
+        Iterator end() const {
+            return {base + count * stride, stride};
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        bool empty() const {
+            return !count;
+        }
+
+        const T &operator[](size_t index) const {
+            return *reinterpret_cast<const T *>(base + index * stride);
+        }
+    };
+
+    template<typename Iterator>
+    struct Range {
+        Iterator first;
+        Iterator last;
+
+        Iterator begin() const {
+            return first;
+        }
+
+        Iterator end() const {
+            return last;
+        }
+    };
+
+    /**
+     * @brief Iterates over the DT_NEEDED entries of .dynamic, yielding the names of the libraries
+     */
+    class NeededIterator {
+      private:
+        const ElfView *elf{};
+        Table<Elf64_Dyn>::Iterator entry, end;
+
+        void SkipToNeeded() {
+            while (entry != end && entry->d_tag != DT_NEEDED)
+                ++entry;
+        }
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = std::string_view;
+
+        NeededIterator() = default;
+
+        NeededIterator(const ElfView *elf, Table<Elf64_Dyn>::Iterator entry, Table<Elf64_Dyn>::Iterator end) : elf{elf}, entry{entry}, end{end} {
+            SkipToNeeded();
+        }
+
+        std::string_view operator*() const {
+            return elf->DynamicString(entry->d_un.d_val);
+        }
+
+        NeededIterator &operator++() {
+            ++entry;
+            SkipToNeeded();
+            return *this;
+        }
+
+        NeededIterator operator++(int) {
+            auto copy{*this};
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const NeededIterator &other) const {
+            return entry == other.entry;
+        }
+    };
+
+    struct Note {
+        Elf64_Word type;
+        std::string_view name; //!< Doesn't include the terminating NUL
+        std::span<const uint8_t> desc;
+    };
+
+    /**
+     * @brief Iterates over the notes in every PT_NOTE segment
+     */
+    class NoteIterator {
+      private:
+        const ElfView *elf{};
+        size_t segment{}; //!< Index of the program header being walked, equal to the program header count at the end
+        uint64_t offset{}, nextOffset{}, segmentEnd{}, alignment{4};
+        Note note{};
+
+        static uint64_t Align(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        /**
+         * @brief Parses the note at `offset`, moving on to the next PT_NOTE segment when this one runs out
+         */
+        void Parse() {
+            auto pHdrs{elf->ProgramHeaders()};
+            while (segment < pHdrs.size()) {
+                if (offset + sizeof(Elf64_Nhdr) <= segmentEnd) {
+                    auto nHdr{elf->AtOffset<Elf64_Nhdr>(offset)};
+                    uint64_t nameOffset{offset + sizeof(Elf64_Nhdr)};
+                    uint64_t descOffset{Align(nameOffset + (nHdr ? nHdr->n_namesz : 0), alignment)};
+                    nextOffset = Align(descOffset + (nHdr ? nHdr->n_descsz : 0), alignment);
+                    if (nHdr && nextOffset <= segmentEnd) {
+                        auto name{elf->AtOffset<char>(nameOffset, nHdr->n_namesz)};
+                        note = {
+                            .type = nHdr->n_type,
+                            .name = {name, nHdr->n_namesz ? strnlen(name, nHdr->n_namesz) : 0},
+                            .desc = {elf->AtOffset<uint8_t>(descOffset, nHdr->n_descsz), nHdr->n_descsz},
+                        };
+                        return;
+                    }
+                }
+
+                // Either the segment is exhausted or the rest of it is malformed, skip to the next one
+                while (++segment < pHdrs.size() && pHdrs[segment].p_type != PT_NOTE);
+                if (segment < pHdrs.size())
+                    Enter(pHdrs[segment]);
+            }
+        }
+
+        void Enter(const Elf64_Phdr &pHdr) {
+            // ELF64 notes are usually 4 byte aligned despite the gABI, only segments aligned to 8 (e.g. GNU properties) use 8 byte padding
+            offset = pHdr.p_offset;
+            segmentEnd = elf->AtOffset<uint8_t>(pHdr.p_offset, pHdr.p_filesz) ? pHdr.p_offset + pHdr.p_filesz : 0;
+            alignment = pHdr.p_align == 8 ? 8 : 4;
+        }
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Note;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Note *;
+        using reference = const Note &;
+
+        NoteIterator() = default;
+
+        NoteIterator(const ElfView *elf, size_t segment) : elf{elf}, segment{segment} {
+            auto pHdrs{elf->ProgramHeaders()};
+            while (this->segment < pHdrs.size() && pHdrs[this->segment].p_type != PT_NOTE)
+                this->segment++;
+
+            if (this->segment < pHdrs.size()) {
+                Enter(pHdrs[this->segment]);
+                Parse();
+            }
+        }
+
+        const Note &operator*() const {
+            return note;
+        }
+
+        const Note *operator->() const {
+            return &note;
+        }
+
+        NoteIterator &operator++() {
+            offset = nextOffset;
+            Parse();
+            return *this;
+        }
+
+        NoteIterator operator++(int) {
+            auto copy{*this};
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const NoteIterator &other) const {
+            return segment == other.segment && (segment == elf->ProgramHeaders().size() || offset == other.offset);
+        }
+    };
+
+  private:
+    const uint8_t *data{};
+    size_t size{};
+
+    Table<Elf64_Phdr> pHdrs;
+    Table<Elf64_Shdr> sHdrs;
+    Table<Elf64_Dyn> dynamic; //!< Entries of PT_DYNAMIC up to (not including) DT_NULL
+    const char *dynStr{};
+    size_t dynStrSize{};
+    Table<Elf64_Sym> dynSym;
+    const uint32_t *gnuHash{}; //!< DT_GNU_HASH, only set if all of its fixed size parts are in bounds
+    const uint32_t *sysvHash{}; //!< DT_HASH, only set if its buckets and chains are in bounds
+
+    /**
+     * @brief Returns a table of `count` entries at `offset` if it lies entirely within the file and is suitably aligned
+     */
+    template<typename T>
+    Table<T> TableAt(uint64_t offset, uint64_t count, uint64_t stride) const {
+        if (!count || stride < sizeof(T) || offset % alignof(T) || stride % alignof(T))
+            return {};
+
+        if (offset > size || count > (size - offset) / stride + 1 || (count - 1) * stride + sizeof(T) > size - offset)
+            return {};
+
+        return {data + offset, static_cast<size_t>(count), static_cast<size_t>(stride)};
+    }
+
+    /**
+     * @brief Translates a virtual address to a file offset through the PT_LOAD segment containing it
+     */
+    bool VirtualToOffset(Elf64_Addr addr, uint64_t length, uint64_t &offset) const {
+        for (const auto &pHdr : pHdrs) {
+            if (pHdr.p_type == PT_LOAD && addr >= pHdr.p_vaddr && addr - pHdr.p_vaddr <= pHdr.p_filesz && length <= pHdr.p_filesz - (addr - pHdr.p_vaddr)) {
+                offset = pHdr.p_offset + (addr - pHdr.p_vaddr);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const Elf64_Dyn *FindDynamic(Elf64_Sxword tag) const {
+        for (const auto &entry : dynamic)
+            if (entry.d_tag == tag)
+                return &entry;
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Reads everything needed for the dynamic string table, symbol table and hash tables, this only touches .dynamic and the hash table headers
+     */
+    void ParseDynamic() {
+        for (const auto &pHdr : pHdrs) {
+            if (pHdr.p_type != PT_DYNAMIC)
+                continue;
+
+            auto entries{TableAt<Elf64_Dyn>(pHdr.p_offset, pHdr.p_filesz / sizeof(Elf64_Dyn), sizeof(Elf64_Dyn))};
+            size_t count{};
+            while (count < entries.size() && entries[count].d_tag != DT_NULL)
+                count++;
+
+            if (count)
+                dynamic = {reinterpret_cast<const uint8_t *>(&entries[0]), count, sizeof(Elf64_Dyn)};
+            break;
+        }
+
+        auto strTab{FindDynamic(DT_STRTAB)}, strSize{FindDynamic(DT_STRSZ)};
+        if (strTab && strSize) {
+            dynStr = AtAddress<char>(strTab->d_un.d_ptr, strSize->d_un.d_val);
+            dynStrSize = dynStr ? strSize->d_un.d_val : 0;
+        }
+
+        if (auto hash{FindDynamic(DT_HASH)}) {
+            if (auto header{AtAddress<uint32_t>(hash->d_un.d_ptr, 2)})
+                sysvHash = AtAddress<uint32_t>(hash->d_un.d_ptr, 2ULL + header[0] + header[1]);
+        }
+
+        if (auto hash{FindDynamic(DT_GNU_HASH)}) {
+            // The chains are of unknown length so they're bounds checked as they're walked
+            if (auto header{AtAddress<uint32_t>(hash->d_un.d_ptr, 4)})
+                gnuHash = AtAddress<uint32_t>(hash->d_un.d_ptr, 4ULL + header[2] * (sizeof(Elf64_Addr) / sizeof(uint32_t)) + header[0]);
+        }
+
+        auto symTab{FindDynamic(DT_SYMTAB)}, symEnt{FindDynamic(DT_SYMENT)};
+        if (!symTab)
+            return;
+
+        uint64_t symTabOffset{};
+        if (!VirtualToOffset(symTab->d_un.d_ptr, sizeof(Elf64_Sym), symTabOffset))
+            return;
+
+        dynSym = TableAt<Elf64_Sym>(symTabOffset, CountDynamicSymbols(), symEnt ? symEnt->d_un.d_val : sizeof(Elf64_Sym));
+    }
+
+    /**
+     * @brief Works out the size of .dynsym, which .dynamic doesn't record directly
+     */
+    uint64_t CountDynamicSymbols() const {
+        for (const auto &sHdr : sHdrs)
+            if (sHdr.sh_type == SHT_DYNSYM && sHdr.sh_entsize)
+                return sHdr.sh_size / sHdr.sh_entsize;
+
+        if (sysvHash)
+            return sysvHash[1]; // nchain is the number of symbols
+
+        if (!gnuHash)
+            return 0;
+
+        // The symbol with the highest index is found by following the chain of the highest bucket to its end
+        uint32_t bucketCount{gnuHash[0]}, symOffset{gnuHash[1]};
+        auto buckets{gnuHash + 4 + gnuHash[2] * (sizeof(Elf64_Addr) / sizeof(uint32_t))};
+        uint32_t last{};
+        for (uint32_t i{}; i < bucketCount; i++)
+            last = buckets[i] > last ? buckets[i] : last;
+
+        if (last < symOffset)
+            return symOffset;
+
+        auto chains{buckets + bucketCount};
+        for (;; last++) {
+            auto chain{GnuChain(chains, last - symOffset)};
+            if (!chain)
+                return 0;
+
+            if (*chain & 1)
+                return last + 1ULL;
+        }
+    }
+
+    /**
+     * @return The GNU hash chain entry at `index` or nullptr if it's outside the file
+     */
+    const uint32_t *GnuChain(const uint32_t *chains, uint64_t index) const {
+        uint64_t offset{static_cast<uint64_t>(reinterpret_cast<const uint8_t *>(chains) - data)};
+        if (index > size / sizeof(uint32_t) || offset + (index + 1) * sizeof(uint32_t) > size)
+            return nullptr;
+
+        return chains + index;
+    }
+
+    const Elf64_Sym *MatchSymbol(uint64_t index, std::string_view name) const {
+        if (index >= dynSym.size())
+            return nullptr;
+
+        const auto &symbol{dynSym[index]};
+        return symbol.st_shndx != SHN_UNDEF && DynamicString(symbol.st_name) == name ? &symbol : nullptr;
+    }
+
+    void Map(int fd) {
+        struct stat fdStat{};
+        if (fd == -1 || fstat(fd, &fdStat) || fdStat.st_size < static_cast<off_t>(sizeof(Elf64_Ehdr)))
+            return;
+
+        auto mapping{mmap(nullptr, static_cast<size_t>(fdStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (mapping == MAP_FAILED)
+            return;
+
+        data = reinterpret_cast<const uint8_t *>(mapping);
+        size = static_cast<size_t>(fdStat.st_size);
+
+        const auto &eHdr{Header()};
+        if (memcmp(eHdr.e_ident, ELFMAG, SELFMAG) || eHdr.e_ident[EI_CLASS] != ELFCLASS64 || eHdr.e_ident[EI_DATA] != ELFDATA2LSB) {
+            munmap(mapping, size);
+            data = nullptr;
+            size = 0;
+            return;
+        }
+
+        pHdrs = TableAt<Elf64_Phdr>(eHdr.e_phoff, eHdr.e_phnum, eHdr.e_phentsize);
+
+        // With more than SHN_LORESERVE sections the real count is stored in the first section header
+        if (eHdr.e_shoff)
+            sHdrs = TableAt<Elf64_Shdr>(eHdr.e_shoff, eHdr.e_shnum ? eHdr.e_shnum : 1, eHdr.e_shentsize);
+        if (!eHdr.e_shnum)
+            sHdrs = sHdrs.empty() ? Table<Elf64_Shdr>{} : TableAt<Elf64_Shdr>(eHdr.e_shoff, sHdrs[0].sh_size, eHdr.e_shentsize);
+
+        ParseDynamic();
+    }
+
+  public:
+    /**
+     * @note The file descriptor isn't closed, the mapping stays valid after it is
+     */
+    explicit ElfView(int fd) {
+        Map(fd);
+    }
+
+    explicit ElfView(const char *path) {
+        int fd{open(path, O_RDONLY | O_CLOEXEC)};
+        if (fd == -1)
+            return;
+
+        Map(fd);
+        close(fd);
+    }
+
+    ElfView(const ElfView &) = delete;
+    ElfView &operator=(const ElfView &) = delete;
+
+    ~ElfView() {
+        if (data)
+            munmap(const_cast<uint8_t *>(data), size);
+    }
+
+    bool IsValid() const {
+        return data != nullptr;
+    }
+
+    /**
+     * @note Only valid to call if IsValid() is true
+     */
+    const Elf64_Ehdr &Header() const {
+        return *reinterpret_cast<const Elf64_Ehdr *>(data);
+    }
+
+    std::span<const uint8_t> Bytes() const {
+        return {data, size};
+    }
+
+    /**
+     * @return `count` objects at `offset` or nullptr if they don't lie entirely within the file or are misaligned
+     */
+    template<typename T>
+    const T *AtOffset(uint64_t offset, uint64_t count = 1) const {
+        if (offset > size || count > (size - offset) / sizeof(T) || offset % alignof(T))
+            return nullptr;
+
+        return reinterpret_cast<const T *>(data + offset);
+    }
+
+    /**
+     * @return `count` objects at the virtual address `addr` or nullptr if they aren't entirely within the file backed part of a PT_LOAD segment
+     */
+    template<typename T>
+    const T *AtAddress(Elf64_Addr addr, uint64_t count = 1) const {
+        uint64_t offset{};
+        if (count > UINT64_MAX / sizeof(T) || !VirtualToOffset(addr, count * sizeof(T), offset))
+            return nullptr;
+
+        return AtOffset<T>(offset, count);
+    }
+
+    Table<Elf64_Phdr> ProgramHeaders() const {
+        return pHdrs;
+    }
+
+    /**
+     * @note Section headers are optional for loading, stripped libraries may not have any
+     */
+    Table<Elf64_Shdr> Sections() const {
+        return sHdrs;
+    }
+
+    std::string_view SectionName(const Elf64_Shdr &sHdr) const {
+        uint32_t strIndex{IsValid() ? Header().e_shstrndx : 0U};
+        if (strIndex == SHN_XINDEX && !sHdrs.empty())
+            strIndex = sHdrs[0].sh_link;
+
+        if (strIndex == SHN_UNDEF || strIndex >= sHdrs.size())
+            return {};
+
+        const auto &strTab{sHdrs[strIndex]};
+        auto strings{AtOffset<char>(strTab.sh_offset, strTab.sh_size)};
+        if (!strings || sHdr.sh_name >= strTab.sh_size)
+            return {};
+
+        return {strings + sHdr.sh_name, strnlen(strings + sHdr.sh_name, strTab.sh_size - sHdr.sh_name)};
+    }
+
+    /**
+     * @brief The entries of PT_DYNAMIC, found through the program headers so this works on stripped libraries
+     */
+    Table<Elf64_Dyn> DynamicEntries() const {
+        return dynamic;
+    }
+
+    /**
+     * @return The string at `offset` in the dynamic string table or an empty string if it's out of bounds
+     */
+    std::string_view DynamicString(uint64_t offset) const {
+        if (offset >= dynStrSize)
+            return {};
+
+        return {dynStr + offset, strnlen(dynStr + offset, dynStrSize - offset)};
+    }
+
+    /**
+     * @brief The whole dynamic string table (DT_STRTAB), names in it are referenced by their offset from the start
+     */
+    std::span<const char> DynamicStrings() const {
+        return {dynStr, dynStrSize};
+    }
+
+    Range<NeededIterator> Needed() const {
+        return {{this, dynamic.begin(), dynamic.end()}, {this, dynamic.end(), dynamic.end()}};
+    }
+
+    std::string_view Soname() const {
+        auto soname{FindDynamic(DT_SONAME)};
+        return soname ? DynamicString(soname->d_un.d_val) : std::string_view{};
+    }
+
+    /**
+     * @return The file offset of the soname string, used to patch it in a copy of the file, or -1 if there is no soname
+     */
+    int64_t SonameOffset() const {
+        auto soname{FindDynamic(DT_SONAME)};
+        if (!soname || DynamicString(soname->d_un.d_val).empty())
+            return -1;
+
+        return static_cast<int64_t>(reinterpret_cast<const uint8_t *>(dynStr) - data + soname->d_un.d_val);
+    }
+
+    /**
+     * @brief The dynamic symbol table (.dynsym), its size comes from the section headers if present or the hash tables otherwise
+     */
+    Table<Elf64_Sym> Symbols() const {
+        return dynSym;
+    }
+
+    std::string_view SymbolName(const Elf64_Sym &symbol) const {
+        return DynamicString(symbol.st_name);
+    }
+
+    bool HasGnuHash() const {
+        return gnuHash != nullptr;
+    }
+
+    bool HasSysvHash() const {
+        return sysvHash != nullptr;
+    }
+
+    /**
+     * @brief Looks up a symbol defined by the library using DT_GNU_HASH, DT_HASH or a linear scan of .dynsym in that order of preference
+     * @note Symbol versions are ignored, the first definition with a matching name is returned
+     * @return The symbol or nullptr if it isn't defined
+     */
+    const Elf64_Sym *FindSymbol(std::string_view name) const {
+        if (gnuHash)
+            return FindSymbolGnu(name);
+        else if (sysvHash)
+            return FindSymbolSysv(name);
+
+        for (size_t i{}; i < dynSym.size(); i++)
+            if (auto symbol{MatchSymbol(i, name)})
+                return symbol;
+
+        return nullptr;
+    }
+
+    /**
+     * @return The symbol or nullptr if it isn't defined or the library has no DT_GNU_HASH
+     */
+    const Elf64_Sym *FindSymbolGnu(std::string_view name) const {
+        if (!gnuHash)
+            return nullptr;
+
+        uint32_t hash{5381};
+        for (char c : name)
+            hash = hash * 33 + static_cast<uint8_t>(c);
+
+        uint32_t bucketCount{gnuHash[0]}, symOffset{gnuHash[1]}, bloomSize{gnuHash[2]}, bloomShift{gnuHash[3]};
+        if (!bucketCount || !bloomSize)
+            return nullptr;
+
+        // The bloom filter rejects most symbols that aren't defined without touching the buckets
+        uint64_t bloomWord;
+        memcpy(&bloomWord, gnuHash + 4 + (hash / 64 % bloomSize) * 2, sizeof(bloomWord));
+        uint64_t bloomMask{(1ULL << (hash % 64)) | (1ULL << ((hash >> bloomShift) % 64))};
+        if ((bloomWord & bloomMask) != bloomMask)
+            return nullptr;
+
+        auto buckets{gnuHash + 4 + bloomSize * 2};
+        auto chains{buckets + bucketCount};
+        uint64_t index{buckets[hash % bucketCount]};
+        if (index < symOffset)
+            return nullptr;
+
+        for (; index < dynSym.size(); index++) {
+            auto chain{GnuChain(chains, index - symOffset)};
+            if (!chain)
+                return nullptr;
+
+            if ((*chain | 1) == (hash | 1))
+                if (auto symbol{MatchSymbol(index, name)})
+                    return symbol;
+
+            if (*chain & 1)
+                break;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * @return The symbol or nullptr if it isn't defined or the library has no DT_HASH
+     */
+    const Elf64_Sym *FindSymbolSysv(std::string_view name) const {
+        if (!sysvHash)
+            return nullptr;
+
+        uint32_t hash{};
+        for (char c : name) {
+            hash = (hash << 4) + static_cast<uint8_t>(c);
+            hash ^= (hash >> 24) & 0xF0;
+        }
+        hash &= 0x0FFFFFFF;
+
+        uint32_t bucketCount{sysvHash[0]}, chainCount{sysvHash[1]};
+        if (!bucketCount)
+            return nullptr;
+
+        auto buckets{sysvHash + 2};
+        auto chains{buckets + bucketCount};
+
+        // Bounding the walk by the chain count stops malformed (cyclic) chains from looping forever
+        uint32_t index{buckets[hash % bucketCount]};
+        for (uint32_t steps{}; index != STN_UNDEF && index < chainCount && steps < chainCount; index = chains[index], steps++)
+            if (auto symbol{MatchSymbol(index, name)})
+                return symbol;
+
+        return nullptr;
+    }
+
+    /**
+     * @brief Looks up a symbol in the static symbol table (.symtab) with a linear scan, unlike .dynsym this also has symbols that aren't exported
+     * @return The symbol or nullptr if it isn't defined or the library has been stripped of .symtab
+     */
+    const Elf64_Sym *FindStaticSymbol(std::string_view name) const {
+        for (const auto &sHdr : sHdrs) {
+            if (sHdr.sh_type != SHT_SYMTAB || sHdr.sh_link >= sHdrs.size())
+                continue;
+
+            const auto &strTab{sHdrs[sHdr.sh_link]};
+            auto strings{AtOffset<char>(strTab.sh_offset, strTab.sh_size)};
+            uint64_t stride{sHdr.sh_entsize ? sHdr.sh_entsize : sizeof(Elf64_Sym)};
+            if (!strings)
+                continue;
+
+            for (const auto &symbol : TableAt<Elf64_Sym>(sHdr.sh_offset, sHdr.sh_size / stride, stride)) {
+                if (symbol.st_shndx == SHN_UNDEF || !symbol.st_name || symbol.st_name >= strTab.sh_size)
+                    continue;
+
+                if (std::string_view{strings + symbol.st_name, strnlen(strings + symbol.st_name, strTab.sh_size - symbol.st_name)} == name)
+                    return &symbol;
+            }
+        }
+
+        return nullptr;
+    }
+
+    Range<NoteIterator> Notes() const {
+        return {{this, 0}, {this, pHdrs.size()}};
+    }
+
+    /**
+     * @return The GNU build ID, empty if the library has none
+     */
+    std::span<const uint8_t> BuildId() const {
+        for (const auto &note : Notes())
+            if (note.type == NT_GNU_BUILD_ID && note.name == "GNU")
+                return note.desc;
+
+        return {};
+    }
+};
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+/**
+ * @brief Host stand-in for the NDK's android/api-level.h, hosts report the newest API level since they support everything that's gated on it (e.g. memfd)
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __ANDROID_API_FUTURE__ 10000
+
+static inline int android_get_device_api_level(void) {
+    return __ANDROID_API_FUTURE__;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+/**
+ * @brief Host stand-in for the NDK's android/dlext.h, android_dlopen_ext is implemented by the host backend in android_linker_ns_host.cpp
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// https://cs.android.com/android/platform/superproject/+/main:bionic/libc/include/android/dlext.h
+enum {
+    ANDROID_DLEXT_RESERVED_ADDRESS = 0x1,
+    ANDROID_DLEXT_RESERVED_ADDRESS_HINT = 0x2,
+    ANDROID_DLEXT_WRITE_RELRO = 0x4,
+    ANDROID_DLEXT_USE_RELRO = 0x8,
+    ANDROID_DLEXT_USE_LIBRARY_FD = 0x10,
+    ANDROID_DLEXT_USE_LIBRARY_FD_OFFSET = 0x20,
+    ANDROID_DLEXT_FORCE_LOAD = 0x40,
+    ANDROID_DLEXT_USE_NAMESPACE = 0x200,
+    ANDROID_DLEXT_RESERVED_ADDRESS_RECURSIVE = 0x400,
+};
+
+struct android_namespace_t;
+
+typedef struct {
+    uint64_t flags;
+    void *reserved_addr;
+    size_t reserved_size;
+    int relro_fd;
+    int library_fd;
+    int64_t library_fd_offset;
+    struct android_namespace_t *library_namespace;
+} android_dlextinfo;
+
+/**
+ * @note This is hidden so each library binds to its own copy of the backend, a hook library defining android_dlopen_ext can then never intercept the backend's own loads
+ */
+__attribute__((visibility("hidden"))) void *android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+/**
+ * @brief Host stand-in for the NDK's android/log.h, messages are written to stderr rather than logcat
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+__attribute__((format(printf, 3, 4))) static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    static const char Priorities[] = "??VDIWEFS";
+
+    va_list args;
+    va_start(args, fmt);
+    int written = fprintf(stderr, "%c/%s: ", Priorities[prio >= 0 && prio <= ANDROID_LOG_SILENT ? prio : 0], tag);
+    written += vfprintf(stderr, fmt, args);
+    written += fprintf(stderr, "\n");
+    va_end(args);
+    return written;
+}
+
+#ifdef __cplusplus
+}
+#endif
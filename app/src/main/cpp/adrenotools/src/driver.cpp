@@ -1,25 +1,167 @@
 // SPDX-License-Identifier: BSD-2-Clause
 // Copyright © 2021 Billy Laws
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <cerrno>
 #include <android/api-level.h>
 #include <android/log.h>
 #include <android_linker_ns.h>
-#include "hook/kgsl.h"
+#include "hook/kgsl_device.h"
+#include "hook/gpu_mapping_handle.h"
 #include "hook/hook_impl_params.h"
 #include <adrenotools/driver.h>
 #include <unistd.h>
 
-void *adrenotools_open_libvulkan(int dlopenFlags, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, void **userMappingHandle) {
+#ifndef ADRENOTOOLS_LIBVULKAN_PATH
+#define ADRENOTOOLS_LIBVULKAN_PATH "/system/lib64/libvulkan.so" //!< The loader to patch and load, host builds set this to the desktop Vulkan loader
+#endif
+
+static std::string libraryCacheDir; //!< Set by adrenotools_set_library_cache_dir, empty if caching is disabled
+static LoadTrace loadTrace; //!< Spans for each stage of adrenotools_open_libvulkan, including those recorded by hook_impl
+
+void adrenotools_set_library_cache_dir(const char *cacheDir) {
+    libraryCacheDir = cacheDir ? cacheDir : "";
+}
+
+/**
+ * @brief The hook namespace and soname patched libvulkan set up by adrenotools_open_libvulkan for one set of parameters
+ * @note These are kept for the lifetime of the process so reopening libvulkan with the same parameters (e.g. after the app recreates its Vulkan device) only needs to dlopen libvulkan again, hook_impl similarly reuses the driver namespace
+ */
+struct LibvulkanInstance {
+    int featureFlags; //!< The parameters the instance is created for, used to look up instances
+    std::string tmpLibDir;
+    std::string hookLibDir;
+    std::string customDriverDir;
+    std::string customDriverName;
+    std::string fileRedirectDir;
+    size_t index; //!< Unique for each instance, used to name its hook namespace
+
+    std::promise<adrenotools_open_status> createdPromise;
+    std::shared_future<adrenotools_open_status> created{createdPromise.get_future().share()}; //!< Ready once the instance has been created, the fields below are only valid if this succeeded
+    HookImplParams *params; //!< The parameters the hooks were set up with
+    android_namespace_t *hookNs;
+    int libvulkanFd; //!< Reloading from the same file returns the already loaded libvulkan if the app hasn't closed it yet
+};
+
+static std::mutex libvulkanInstanceMutex; //!< Only protects the list of instances, instances are created and loaded without holding it so separate parameters can be opened concurrently
+static std::vector<std::shared_ptr<LibvulkanInstance>> libvulkanInstances;
+static size_t nextLibvulkanInstanceIndex;
+
+static bool ParamsMatch(const LibvulkanInstance &instance, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir) {
+    return instance.featureFlags == featureFlags &&
+           instance.tmpLibDir == (tmpLibDir ? tmpLibDir : "") &&
+           instance.hookLibDir == hookLibDir &&
+           instance.customDriverDir == (customDriverDir ? customDriverDir : "") &&
+           instance.customDriverName == (customDriverName ? customDriverName : "") &&
+           instance.fileRedirectDir == (fileRedirectDir ? fileRedirectDir : "");
+}
+
+/**
+ * @brief Creates the hook namespace, loads the hooks into it and prepares a soname patched libvulkan to load
+ */
+static adrenotools_open_status CreateLibvulkanInstance(int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, void **userMappingHandle, LibvulkanInstance &instance) {
+    android_namespace_t *hookNs;
+    {
+        LoadTrace::ScopedSpan span{&loadTrace, "hook namespace creation"};
+
+        // Create a namespace that can isolate our hook from the classloader namespace, each set of parameters (e.g. each custom driver) gets its own so several drivers can be loaded side by side
+        auto hookNsName{"adrenotools-libvulkan-" + std::to_string(instance.index)};
+        hookNs = android_create_namespace(hookNsName.c_str(), hookLibDir, nullptr, ANDROID_NAMESPACE_TYPE_SHARED, nullptr, nullptr);
+
+        // Link it to the default namespace so the hook can use libandroid etc
+        if (!linkernsbypass_link_namespace_to_default_all_libs(hookNs))
+            return ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED;
+    }
+
+    void *hookImpl;
+    {
+        LoadTrace::ScopedSpan span{&loadTrace, "libhook_impl load"};
+
+#ifdef __ANDROID__
+        // Preload the hook implementation, otherwise we get a weird issue where despite being in NEEDED of the hook lib the hook's symbols will overwrite ours and cause an infinite loop
+        hookImpl = linkernsbypass_namespace_dlopen("libhook_impl.so", RTLD_NOW, hookNs);
+#else
+        // Only the first library loaded into a namespace can be global with the host backend, so the hook is loaded first and the implementation comes along as its dependency
+        // The backend's own loads never bind to the hook so the loop above can't happen
+        hookImpl = linkernsbypass_namespace_dlopen("libmain_hook.so", RTLD_NOW | RTLD_GLOBAL, hookNs);
+#endif
+        if (!hookImpl)
+            return ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED;
+    }
+
+    // Pass parameters to the hook implementation
+    auto initHookParam{reinterpret_cast<void (*)(const void *)>(dlsym(hookImpl, "init_hook_param"))};
+    if (!initHookParam)
+        return ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED;
+
+    auto mappingHandle{[&]() -> GpuMappingHandle * {
+        if (featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) {
+            // This will be leaked, but it's not a big deal since it's only a few hundred KiB
+            auto mapping{new GpuMappingHandle{}};
+            *userMappingHandle = mapping;
+            return mapping;
+        } else {
+            return nullptr;
+        }
+    }()};
+
+    auto params{new HookImplParams(featureFlags, tmpLibDir, hookLibDir, customDriverDir, customDriverName, fileRedirectDir, mappingHandle, adrenotools_kgsl_context_get_default(), &loadTrace, hookNs)};
+    initHookParam(params);
+
+    {
+        LoadTrace::ScopedSpan span{&loadTrace, "libmain_hook load"};
+
+        // Load the libvulkan hook into the isolated namespace
+        if (!linkernsbypass_namespace_dlopen("libmain_hook.so", RTLD_GLOBAL, hookNs))
+            return ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED;
+    }
+
+    // The soname patch is done separately from loading so the patched library can be kept around and loaded again
+    int libvulkanFd;
+    {
+        LoadTrace::ScopedSpan span{&loadTrace, "libvulkan soname patch"};
+        if (!libraryCacheDir.empty())
+            libvulkanFd = linkernsbypass_create_unique_lib_cached(ADRENOTOOLS_LIBVULKAN_PATH, libraryCacheDir.c_str());
+        else
+            libvulkanFd = linkernsbypass_create_unique_lib(ADRENOTOOLS_LIBVULKAN_PATH, tmpLibDir);
+
+        if (libvulkanFd == -1)
+            return ADRENOTOOLS_OPEN_ERROR_PATCH_FAILED;
+    }
+
+    instance.params = params;
+    instance.hookNs = hookNs;
+    instance.libvulkanFd = libvulkanFd;
+    return ADRENOTOOLS_OPEN_SUCCESS;
+}
+
+/**
+ * @brief Implements adrenotools_open_libvulkan and adrenotools_open_libvulkan_async
+ * @param cancelled Checked between stages, if set the open is abandoned. May be nullptr
+ */
+static adrenotools_open_status OpenLibvulkan(int dlopenFlags, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, void **userMappingHandle, const std::atomic<bool> *cancelled, void *&libvulkan) {
+    LoadTrace::ScopedSpan openSpan{&loadTrace, "adrenotools_open_libvulkan"};
+
     // Bail out if linkernsbypass failed to load, this probably means we're on api < 28
     if (!linkernsbypass_load_status())
-        return nullptr;
+        return ADRENOTOOLS_OPEN_ERROR_UNSUPPORTED;
 
     // Always use memfd on Q+ since it's guaranteed to work
     if (android_get_device_api_level() >= 29)
@@ -27,184 +169,612 @@ void *adrenotools_open_libvulkan(int dlopenFlags, int featureFlags, const char *
 
     // Verify that params for specific features are only passed if they are enabled
     if (!(featureFlags & ADRENOTOOLS_DRIVER_FILE_REDIRECT) && fileRedirectDir)
-        return nullptr;
+        return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
 
     if (!(featureFlags & ADRENOTOOLS_DRIVER_CUSTOM) && (customDriverDir || customDriverName))
-        return nullptr;
+        return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
 
     if (!(featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) && userMappingHandle)
-        return nullptr;
+        return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
+
+    if (!(featureFlags & ADRENOTOOLS_DRIVER_CUSTOM) && (featureFlags & ADRENOTOOLS_DRIVER_PRELOAD))
+        return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
+
+#ifndef __ANDROID__
+    // Both of these rely on global hooks loaded after libhook_impl in the driver namespace, which the host backend can't provide
+    if (featureFlags & (ADRENOTOOLS_DRIVER_FILE_REDIRECT | ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT))
+        return ADRENOTOOLS_OPEN_ERROR_UNSUPPORTED;
+#endif
 
     // Verify that params for enabled features are correct
     struct stat buf{};
 
     if (featureFlags & ADRENOTOOLS_DRIVER_CUSTOM) {
         if (!customDriverName || !customDriverDir)
-            return nullptr;
+            return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
 
         if (stat((std::string(customDriverDir) + customDriverName).c_str(), &buf) != 0)
-            return nullptr;
+            return ADRENOTOOLS_OPEN_ERROR_FILE_NOT_FOUND;
     }
 
     // Verify that params for enabled features are correct
     if (featureFlags & ADRENOTOOLS_DRIVER_FILE_REDIRECT) {
         if (!fileRedirectDir)
-            return nullptr;
+            return ADRENOTOOLS_OPEN_ERROR_INVALID_PARAMS;
 
         if (stat(fileRedirectDir, &buf) != 0)
-            return nullptr;
+            return ADRENOTOOLS_OPEN_ERROR_FILE_NOT_FOUND;
     }
 
-    // Create a namespace that can isolate our hook from the classloader namespace
-    auto hookNs{android_create_namespace("adrenotools-libvulkan", hookLibDir, nullptr, ANDROID_NAMESPACE_TYPE_SHARED, nullptr, nullptr)};
+    std::shared_ptr<LibvulkanInstance> instance;
+    bool creator{};
+    {
+        // The lock is only held to look up or insert the instance, creation is done once by whichever open inserted it and everyone else waits on it
+        std::scoped_lock lock{libvulkanInstanceMutex};
+        auto existing{std::find_if(libvulkanInstances.begin(), libvulkanInstances.end(), [&](const std::shared_ptr<LibvulkanInstance> &entry) {
+            return ParamsMatch(*entry, featureFlags, tmpLibDir, hookLibDir, customDriverDir, customDriverName, fileRedirectDir);
+        })};
+
+        if (existing != libvulkanInstances.end()) {
+            instance = *existing;
+        } else {
+            if (cancelled && cancelled->load(std::memory_order_acquire))
+                return ADRENOTOOLS_OPEN_CANCELLED;
+
+            instance = std::make_shared<LibvulkanInstance>();
+            instance->featureFlags = featureFlags;
+            instance->tmpLibDir = tmpLibDir ? tmpLibDir : "";
+            instance->hookLibDir = hookLibDir;
+            instance->customDriverDir = customDriverDir ? customDriverDir : "";
+            instance->customDriverName = customDriverName ? customDriverName : "";
+            instance->fileRedirectDir = fileRedirectDir ? fileRedirectDir : "";
+            instance->index = nextLibvulkanInstanceIndex++;
+            libvulkanInstances.push_back(instance);
+            creator = true;
+        }
+    }
 
-    // Link it to the default namespace so the hook can use libandroid etc
-    if (!linkernsbypass_link_namespace_to_default_all_libs(hookNs))
-        return nullptr;
+    if (creator) {
+        auto status{CreateLibvulkanInstance(featureFlags, tmpLibDir, hookLibDir, customDriverDir, customDriverName, fileRedirectDir, userMappingHandle, *instance)};
+        if (status != ADRENOTOOLS_OPEN_SUCCESS) {
+            // Failed instances aren't kept so a later open can retry, opens already waiting on this one fail along with it
+            std::scoped_lock lock{libvulkanInstanceMutex};
+            std::erase(libvulkanInstances, instance);
+        }
+
+        instance->createdPromise.set_value(status);
+        if (status != ADRENOTOOLS_OPEN_SUCCESS)
+            return status;
+    } else {
+        if (auto status{instance->created.get()}; status != ADRENOTOOLS_OPEN_SUCCESS)
+            return status;
 
-    // Preload the hook implementation, otherwise we get a weird issue where despite being in NEEDED of the hook lib the hook's symbols will overwrite ours and cause an infinite loop
-    auto hookImpl{linkernsbypass_namespace_dlopen("libhook_impl.so", RTLD_NOW, hookNs)};
-    if (!hookImpl)
+        if (userMappingHandle)
+            *userMappingHandle = instance->params->mappingHandle;
+    }
+
+    // The instance is kept even if cancelled here, so a later open can reuse it
+    if (cancelled && cancelled->load(std::memory_order_acquire))
+        return ADRENOTOOLS_OPEN_CANCELLED;
+
+    // This span also covers the driver load done by hook_impl
+    LoadTrace::ScopedSpan span{&loadTrace, "libvulkan load"};
+    libvulkan = linkernsbypass_namespace_dlopen_fd(instance->libvulkanFd, dlopenFlags, instance->hookNs);
+    return libvulkan ? ADRENOTOOLS_OPEN_SUCCESS : ADRENOTOOLS_OPEN_ERROR_LOAD_FAILED;
+}
+
+void *adrenotools_open_libvulkan(int dlopenFlags, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, void **userMappingHandle) {
+    void *libvulkan{};
+    OpenLibvulkan(dlopenFlags, featureFlags, tmpLibDir, hookLibDir, customDriverDir, customDriverName, fileRedirectDir, userMappingHandle, nullptr, libvulkan);
+    return libvulkan;
+}
+
+struct adrenotools_open_request {
+    int dlopenFlags;
+    int featureFlags;
+    std::optional<std::string> tmpLibDir; //!< The string parameters are optional as nullptr is meaningful to adrenotools_open_libvulkan
+    std::optional<std::string> hookLibDir;
+    std::optional<std::string> customDriverDir;
+    std::optional<std::string> customDriverName;
+    std::optional<std::string> fileRedirectDir;
+    adrenotools_open_callback callback;
+    void *userData;
+
+    std::atomic<bool> cancelled{};
+    std::mutex mutex{}; //!< Serializes completion against cancellation so a cancelled request never hands out a libvulkan instance
+    std::condition_variable completedCondition{};
+    std::atomic<adrenotools_open_status> status{ADRENOTOOLS_OPEN_PENDING}; //!< The fields below are only valid once this is no longer pending
+    void *libvulkan{};
+    void *mappingHandle{};
+    std::string error{};
+    std::thread thread{};
+
+    static std::optional<std::string> Copy(const char *string) {
+        return string ? std::optional<std::string>{string} : std::nullopt;
+    }
+
+    static const char *Get(const std::optional<std::string> &string) {
+        return string ? string->c_str() : nullptr;
+    }
+
+    void Run() {
+        // Clear any stale error so only one from this open is reported
+        dlerror();
+
+        void *handle{};
+        auto result{OpenLibvulkan(dlopenFlags, featureFlags, Get(tmpLibDir), Get(hookLibDir), Get(customDriverDir), Get(customDriverName), Get(fileRedirectDir),
+                                  (featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) ? &mappingHandle : nullptr, &cancelled, handle)};
+
+        if (result == ADRENOTOOLS_OPEN_ERROR_HOOK_LOAD_FAILED || result == ADRENOTOOLS_OPEN_ERROR_LOAD_FAILED)
+            if (const char *dlError{dlerror()})
+                error = dlError;
+
+        {
+            std::scoped_lock lock{mutex};
+            if (result == ADRENOTOOLS_OPEN_SUCCESS && cancelled.load(std::memory_order_relaxed)) {
+                dlclose(handle);
+                handle = nullptr;
+                result = ADRENOTOOLS_OPEN_CANCELLED;
+            }
+
+            if (result != ADRENOTOOLS_OPEN_SUCCESS)
+                mappingHandle = nullptr;
+
+            libvulkan = handle;
+            status.store(result, std::memory_order_release);
+        }
+
+        completedCondition.notify_all();
+        if (callback)
+            callback(userData, this, result);
+    }
+};
+
+adrenotools_open_request *adrenotools_open_libvulkan_async(int dlopenFlags, int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir, const char *customDriverName, const char *fileRedirectDir, adrenotools_open_callback callback, void *userData) {
+    std::unique_ptr<adrenotools_open_request> request{new (std::nothrow) adrenotools_open_request{
+        .dlopenFlags = dlopenFlags,
+        .featureFlags = featureFlags,
+        .tmpLibDir = adrenotools_open_request::Copy(tmpLibDir),
+        .hookLibDir = adrenotools_open_request::Copy(hookLibDir),
+        .customDriverDir = adrenotools_open_request::Copy(customDriverDir),
+        .customDriverName = adrenotools_open_request::Copy(customDriverName),
+        .fileRedirectDir = adrenotools_open_request::Copy(fileRedirectDir),
+        .callback = callback,
+        .userData = userData,
+    }};
+    if (!request)
         return nullptr;
 
-    // Pass parameters to the hook implementation
-    auto initHookParam{reinterpret_cast<void (*)(const void *)>(dlsym(hookImpl, "init_hook_param"))};
-    if (!initHookParam)
+    // Thread creation failures are reported as exceptions, which must not cross the C ABI
+    try {
+        request->thread = std::thread{&adrenotools_open_request::Run, request.get()};
+    } catch (const std::system_error &) {
         return nullptr;
+    }
 
+    return request.release();
+}
 
-    auto importMapping{[&]() -> adrenotools_gpu_mapping * {
-        if (featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) {
-            // This will be leaked, but it's not a big deal since it's only a few bytes
-            adrenotools_gpu_mapping *mapping{new adrenotools_gpu_mapping{}};
-            *userMappingHandle = mapping;
-            return mapping;
-        } else {
-            return nullptr;
-        }
-    }()};
+adrenotools_open_status adrenotools_open_request_get_status(adrenotools_open_request *request) {
+    return request->status.load(std::memory_order_acquire);
+}
 
-    initHookParam(new HookImplParams(featureFlags, tmpLibDir, hookLibDir, customDriverDir, customDriverName, fileRedirectDir, importMapping));
+adrenotools_open_status adrenotools_open_request_wait(adrenotools_open_request *request) {
+    std::unique_lock lock{request->mutex};
+    request->completedCondition.wait(lock, [&] { return request->status.load(std::memory_order_relaxed) != ADRENOTOOLS_OPEN_PENDING; });
+    return request->status.load(std::memory_order_relaxed);
+}
+
+bool adrenotools_open_request_cancel(adrenotools_open_request *request) {
+    std::scoped_lock lock{request->mutex};
+    if (request->status.load(std::memory_order_relaxed) != ADRENOTOOLS_OPEN_PENDING)
+        return false;
 
-    // Load the libvulkan hook into the isolated namespace
-    if (!linkernsbypass_namespace_dlopen("libmain_hook.so", RTLD_GLOBAL, hookNs))
+    request->cancelled.store(true, std::memory_order_release);
+    return true;
+}
+
+void *adrenotools_open_request_get_libvulkan(adrenotools_open_request *request) {
+    return adrenotools_open_request_get_status(request) == ADRENOTOOLS_OPEN_SUCCESS ? request->libvulkan : nullptr;
+}
+
+void *adrenotools_open_request_get_mapping_handle(adrenotools_open_request *request) {
+    return adrenotools_open_request_get_status(request) == ADRENOTOOLS_OPEN_SUCCESS ? request->mappingHandle : nullptr;
+}
+
+const char *adrenotools_open_request_get_error(adrenotools_open_request *request) {
+    if (adrenotools_open_request_get_status(request) == ADRENOTOOLS_OPEN_PENDING || request->error.empty())
         return nullptr;
 
-    return linkernsbypass_namespace_dlopen_unique("/system/lib64/libvulkan.so", tmpLibDir, dlopenFlags, hookNs);
+    return request->error.c_str();
+}
+
+void adrenotools_open_request_destroy(adrenotools_open_request *request) {
+    adrenotools_open_request_cancel(request);
+    request->thread.join();
+    delete request;
+}
+
+/**
+ * @brief Appends printf formatted text to a fixed-size buffer, keeping track of the size that would be needed to hold all of it
+ */
+template<typename... Args>
+static void AppendReport(char *buffer, size_t size, size_t &offset, const char *format, Args... args) {
+    int written{snprintf(offset < size ? buffer + offset : nullptr, offset < size ? size - offset : 0, format, args...)};
+    if (written > 0)
+        offset += static_cast<size_t>(written);
 }
 
+size_t adrenotools_get_load_report(char *buffer, size_t size) {
+    size_t offset{};
+    AppendReport(buffer, size, offset, "{\"traceEvents\":[");
+
+    uint32_t spanCount{loadTrace.GetSpanCount()};
+    uint64_t originNs{spanCount ? loadTrace.GetSpan(0).startNs : 0};
+    uint64_t nowNs{LoadTrace::Now()};
+    for (uint32_t i{}; i < spanCount; i++) {
+        const auto &span{loadTrace.GetSpan(i)};
+
+        // Spans that are still open are reported up until now
+        uint64_t endNs{span.endNs.load(std::memory_order_acquire)};
+        if (!endNs)
+            endNs = nowNs;
+
+        // Names are fixed internal strings so need no JSON escaping, times are in microseconds as the format requires
+        AppendReport(buffer, size, offset, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                     i ? "," : "", span.name,
+                     static_cast<double>(span.startNs - originNs) / 1000.0,
+                     static_cast<double>(endNs - span.startNs) / 1000.0,
+                     getpid(), span.tid);
+    }
+
+    AppendReport(buffer, size, offset, "],\"displayTimeUnit\":\"ms\",\"droppedSpans\":%u}", loadTrace.GetDroppedCount());
+    return offset + 1;
+}
+
+/**
+ * @return The KGSL allocation flags corresponding to the given cache mode
+ */
+static uint64_t GetCacheModeFlags(adrenotools_cache_mode cacheMode) {
+    switch (cacheMode) {
+        case ADRENOTOOLS_CACHE_MODE_WRITEBACK:
+            return KGSL_CACHEMODE_WRITEBACK << KGSL_CACHEMODE_SHIFT;
+        case ADRENOTOOLS_CACHE_MODE_WRITECOMBINE:
+            return KGSL_CACHEMODE_WRITECOMBINE << KGSL_CACHEMODE_SHIFT;
+        case ADRENOTOOLS_CACHE_MODE_UNCACHED:
+            return KGSL_CACHEMODE_UNCACHED << KGSL_CACHEMODE_SHIFT;
+        case ADRENOTOOLS_CACHE_MODE_WRITEBACK_COHERENT:
+        default:
+            return KGSL_CACHEMODE_WRITEBACK << KGSL_CACHEMODE_SHIFT | KGSL_MEMFLAGS_IOCOHERENT;
+    }
+}
+
+/**
+ * @brief A mapping allocated by adrenotools_mem_gpu_allocate on this thread, waiting for adrenotools_mem_cpu_map
+ */
+struct StagedGpuAllocation {
+    void *handle; //!< The mapping handle the allocation was made for, it can only be mapped through the same handle
+    adrenotools_gpu_mapping mapping;
+    uint32_t id;
+};
+
+thread_local StagedGpuAllocation stagedGpuAllocation;
+
 bool adrenotools_import_user_mem(void *handle, void *hostPtr, uint64_t size) {
-    auto importMapping{reinterpret_cast<adrenotools_gpu_mapping *>(handle)};
+    uint64_t ticket{};
+    return adrenotools_import_user_mem_tagged(handle, hostPtr, size, 0, &ticket);
+}
 
-    kgsl_gpuobj_import_useraddr addr{
-        .virtaddr = reinterpret_cast<uint64_t>(hostPtr),
+bool adrenotools_import_user_mem_tagged(void *handle, void *hostPtr, uint64_t size, uint64_t tag, uint64_t *ticket) {
+    adrenotools_user_mem_range range{
+        .host_ptr = hostPtr,
+        .size = size,
+        .tag = tag,
+        .cache_mode = ADRENOTOOLS_CACHE_MODE_WRITEBACK_COHERENT,
     };
+    adrenotools_user_mem_import_result result{};
+
+    if (!adrenotools_import_user_mem_batch(handle, &range, 1, &result))
+        return false;
 
-    kgsl_gpuobj_import userMemImport{
-        .priv = reinterpret_cast<uint64_t>(&addr),
-        .priv_len = size,
-        .flags = KGSL_CACHEMODE_WRITEBACK << KGSL_CACHEMODE_SHIFT | KGSL_MEMFLAGS_IOCOHERENT,
-        .type = KGSL_USER_MEM_TYPE_ADDR,
+    *ticket = result.ticket;
+    return true;
+}
 
+static adrenotools_user_mem_import_result ImportError(int error) {
+    return {
+        .gpu_addr = 0,
+        .ticket = 0,
+        .error = error,
     };
+}
 
-    kgsl_gpuobj_info info{};
+uint32_t adrenotools_import_user_mem_batch(void *handle, const adrenotools_user_mem_range *ranges, uint32_t count, adrenotools_user_mem_import_result *results) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
 
-    int kgslFd{open("/dev/kgsl-3d0", O_RDWR)};
-    if (kgslFd < 0)
-        return false;
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx) {
+        for (uint32_t i{}; i < count; i++)
+            results[i] = ImportError(ENODEV);
+
+        return 0;
+    }
 
-    int ret{ioctl(kgslFd, IOCTL_KGSL_GPUOBJ_IMPORT, &userMemImport)};
-    if (ret)
-        goto err;
+    // Issue all imports up front, the object IDs are stashed in the result tickets until the GPU addresses are known
+    // errno is cleared before and saved straight after each ioctl, so a failure that doesn't set it (e.g. from a fake context) can't report one left over from an earlier range
+    for (uint32_t i{}; i < count; i++) {
+        uint32_t id{};
+        errno = 0;
+        bool success{kgslCtx->ImportUserMem(ranges[i].host_ptr, ranges[i].size, GetCacheModeFlags(ranges[i].cache_mode), id)};
+        int error{errno};
+        if (success)
+            results[i] = {.gpu_addr = 0, .ticket = id, .error = 0};
+        else
+            results[i] = ImportError(error ? error : EINVAL);
+    }
 
-    info.id = userMemImport.id;
-    ret = ioctl(kgslFd, IOCTL_KGSL_GPUOBJ_INFO, &info);
-    if (ret)
-        goto err;
+    uint32_t imported{};
+    for (uint32_t i{}; i < count; i++) {
+        auto &result{results[i]};
+        if (result.error)
+            continue;
+
+        auto id{static_cast<uint32_t>(result.ticket)};
+        kgsl_gpuobj_info info{};
+        errno = 0;
+        if (!kgslCtx->GetGpuobjInfo(id, info)) {
+            int error{errno};
+            result = ImportError(error ? error : EINVAL);
+            kgslCtx->FreeGpuobj(id);
+            continue;
+        }
 
-    importMapping->host_ptr = hostPtr;
-    importMapping->gpu_addr = info.gpuaddr;
-    importMapping->size = size;
-    importMapping->flags = 0xc2600; //!< Unknown flags, but they are required for the mapping to work
+        adrenotools_gpu_mapping mapping{
+            .host_ptr = ranges[i].host_ptr,
+            .gpu_addr = info.gpuaddr,
+            .size = ranges[i].size,
+            .flags = GslMappingFlags,
+        };
+
+        // This must happen before the mapping is published as the driver may free it immediately after, if the index is full the free hook falls back to looking up the object ID from the kernel
+        bool indexed{mappingHandle->objects.Insert(info.gpuaddr, id, ranges[i].size, ranges[i].host_ptr)};
+
+        uint64_t ticket{};
+        if (!mappingHandle->queue.Push(mapping, ranges[i].tag, id, false, ticket)) {
+            GpuObjectIndex::Object object;
+            if (indexed)
+                mappingHandle->objects.Remove(info.gpuaddr, object);
+
+            result = ImportError(EBUSY);
+            kgslCtx->FreeGpuobj(id);
+            continue;
+        }
 
-    close(kgslFd);
-    return true;
+        result = {
+            .gpu_addr = info.gpuaddr,
+            .ticket = ticket,
+            .error = 0,
+        };
+        imported++;
+    }
 
-err:
-    close(kgslFd);
-    return false;
+    return imported;
 }
 
 bool adrenotools_mem_gpu_allocate(void *handle, uint64_t *size) {
-    auto mapping{reinterpret_cast<adrenotools_gpu_mapping *>(handle)};
+    return adrenotools_mem_gpu_allocate_with_cache_mode(handle, size, ADRENOTOOLS_CACHE_MODE_WRITEBACK_COHERENT);
+}
 
-    kgsl_gpuobj_alloc gpuobjAlloc{
-        .size = *size,
-        .flags = KGSL_CACHEMODE_WRITEBACK << KGSL_CACHEMODE_SHIFT | KGSL_MEMFLAGS_IOCOHERENT,
-    };
+bool adrenotools_mem_gpu_allocate_with_cache_mode(void *handle, uint64_t *size, enum adrenotools_cache_mode cacheMode) {
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx)
+        return false;
 
-    kgsl_gpuobj_info info{};
+    // An allocation that was never mapped would otherwise be leaked by being overwritten
+    if (stagedGpuAllocation.mapping.gpu_addr) {
+        kgslCtx->FreeGpuobj(stagedGpuAllocation.id);
+        stagedGpuAllocation = {};
+    }
+
+    uint32_t id{};
+    if (!kgslCtx->AllocGpuobj(*size, GetCacheModeFlags(cacheMode), id, *size))
+        return false;
 
-    int kgslFd{open("/dev/kgsl-3d0", O_RDWR)};
-    if (kgslFd < 0)
+    kgsl_gpuobj_info info{};
+    if (!kgslCtx->GetGpuobjInfo(id, info)) {
+        kgslCtx->FreeGpuobj(id);
         return false;
+    }
+
+    // The mapping isn't published until it's been mapped on the CPU, otherwise the hook could hand out a mapping with no host pointer
+    stagedGpuAllocation = {
+        .handle = handle,
+        .mapping = {
+            .host_ptr = nullptr,
+            .gpu_addr = info.gpuaddr,
+            .size = *size,
+            .flags = GslMappingFlags,
+        },
+        .id = id,
+    };
+    return true;
+}
 
-    int ret{ioctl(kgslFd, IOCTL_KGSL_GPUOBJ_ALLOC, &gpuobjAlloc)};
-    if (ret)
-        goto err;
+bool adrenotools_mem_cpu_map(void *handle, void *hostPtr, uint64_t size) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
 
-    *size = gpuobjAlloc.mmapsize;
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    auto &mapping{stagedGpuAllocation.mapping};
+    if (!kgslCtx || !mapping.gpu_addr || stagedGpuAllocation.handle != handle || mapping.size != size)
+        return false;
 
-    info.id = gpuobjAlloc.id;
+    mapping.host_ptr = kgslCtx->Map(hostPtr, size, mapping.gpu_addr, MAP_FIXED);
+    if (!mapping.host_ptr)
+        return false;
 
-    ret = ioctl(kgslFd, IOCTL_KGSL_GPUOBJ_INFO, &info);
-    if (ret)
-        goto err;
+    bool indexed{mappingHandle->objects.Insert(mapping.gpu_addr, stagedGpuAllocation.id, size, mapping.host_ptr)};
 
-    mapping->host_ptr = nullptr;
-    mapping->gpu_addr = info.gpuaddr;
-    mapping->size = *size;
-    mapping->flags = 0xc2600; //!< Unknown flags, but they are required for the mapping to work
+    uint64_t ticket{};
+    if (!mappingHandle->queue.Push(mapping, 0, stagedGpuAllocation.id, false, ticket)) {
+        GpuObjectIndex::Object object;
+        if (indexed)
+            mappingHandle->objects.Remove(mapping.gpu_addr, object);
 
-    close(kgslFd);
-    return true;
+        return false;
+    }
 
-err:
-    close(kgslFd);
-    return false;
+    stagedGpuAllocation = {};
+    return true;
 }
 
+bool adrenotools_sync_ranges(void *handle, const adrenotools_sync_range *ranges, uint32_t count, enum adrenotools_sync_direction direction) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
 
-bool adrenotools_mem_cpu_map(void *handle, void *hostPtr, uint64_t size) {
-    auto mapping{reinterpret_cast<adrenotools_gpu_mapping *>(handle)};
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx)
+        return false;
+
+    // The sync directions are defined to match KGSL_GPUMEM_CACHE_CLEAN and KGSL_GPUMEM_CACHE_INV
+    auto op{static_cast<uint32_t>(direction)};
+
+    std::vector<kgsl_gpuobj_sync_obj> objs;
+    objs.reserve(count);
+    for (uint32_t i{}; i < count; i++) {
+        const auto &range{ranges[i]};
+        if (!range.size)
+            continue;
 
-    int kgslFd{open("/dev/kgsl-3d0", O_RDWR)};
-    if (kgslFd < 0)
+        GpuObjectIndex::Object object;
+        if (mappingHandle && mappingHandle->objects.Find(range.gpu_addr, object)) {
+            objs.push_back({.offset = range.offset, .length = range.size, .id = object.id, .op = op});
+        } else {
+            // The kernel returns the object containing the address, which may start before it
+            kgsl_gpumem_get_info info{};
+            if (!kgslCtx->GetGpumemInfo(range.gpu_addr, info))
+                return false;
+
+            objs.push_back({.offset = range.gpu_addr - info.gpuaddr + range.offset, .length = range.size, .id = info.id, .op = op});
+        }
+    }
+
+    // Merge overlapping and adjacent ranges within the same object so the kernel walks each page at most once
+    std::sort(objs.begin(), objs.end(), [](const auto &a, const auto &b) {
+        return a.id != b.id ? a.id < b.id : a.offset < b.offset;
+    });
+
+    size_t merged{};
+    for (size_t i{}; i < objs.size(); i++) {
+        if (merged && objs[merged - 1].id == objs[i].id && objs[i].offset <= objs[merged - 1].offset + objs[merged - 1].length)
+            objs[merged - 1].length = std::max(objs[merged - 1].length, objs[i].offset + objs[i].length - objs[merged - 1].offset);
+        else
+            objs[merged++] = objs[i];
+    }
+    objs.resize(merged);
+
+    if (objs.empty())
+        return true;
+
+    if (kgslCtx->SyncGpuobjs(objs.data(), static_cast<uint32_t>(objs.size())))
+        return true;
+    else if (errno != ENOTTY)
         return false;
 
-    mapping->host_ptr = mmap(hostPtr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, kgslFd, mapping->gpu_addr);
-    close(kgslFd);
-    return mapping->host_ptr != nullptr;
+    // Kernels without IOCTL_KGSL_GPUOBJ_SYNC can only sync entire objects
+    std::vector<uint32_t> ids;
+    ids.reserve(objs.size());
+    for (const auto &obj : objs)
+        if (ids.empty() || ids.back() != obj.id)
+            ids.push_back(obj.id);
+
+    return kgslCtx->SyncCacheBulk(ids.data(), static_cast<uint32_t>(ids.size()), op);
 }
 
 bool adrenotools_validate_gpu_mapping(void *handle) {
-    auto importMapping{reinterpret_cast<adrenotools_gpu_mapping *>(handle)};
-    return importMapping->gpu_addr == ADRENOTOOLS_GPU_MAPPING_SUCCEEDED_MAGIC;
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+    return mappingHandle->queue.hookReady.load(std::memory_order_acquire) && mappingHandle->queue.IsDrained();
 }
 
-void adrenotools_set_turbo(bool turbo) {
-    uint32_t enable{turbo ? 0U : 1U};
-    kgsl_device_getproperty prop{
-        .type = KGSL_PROP_PWRCTRL,
-        .value = reinterpret_cast<void *>(&enable),
-        .sizebytes = sizeof(enable),
+enum adrenotools_gpu_mapping_status adrenotools_get_gpu_mapping_status(void *handle, uint64_t ticket) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+    if (!mappingHandle->queue.hookReady.load(std::memory_order_acquire))
+        return ADRENOTOOLS_GPU_MAPPING_INVALID;
+
+    return mappingHandle->queue.GetStatus(ticket);
+}
+
+bool adrenotools_cancel_gpu_mapping(void *handle, uint64_t ticket) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+
+    uint64_t gpuAddr{};
+    uint32_t id{};
+    bool borrowed{};
+    if (!mappingHandle->queue.Cancel(ticket, gpuAddr, id, borrowed))
+        return false;
+
+    if (borrowed)
+        return true;
+
+    GpuObjectIndex::Object object;
+    mappingHandle->objects.Remove(gpuAddr, object);
+
+    if (auto kgslCtx{adrenotools_kgsl_context_get_default()})
+        kgslCtx->FreeGpuobj(id);
+
+    return true;
+}
+
+bool adrenotools_enable_deferred_free(void *handle, const adrenotools_reclaimer_config *config) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx || mappingHandle->reclaimer.load(std::memory_order_acquire))
+        return false;
+
+    // Like the mapping handle this lives for the rest of the process, the hooks may still be using it at any point
+    auto reclaimer{new (std::nothrow) GpuObjectReclaimer{kgslCtx, *config}};
+    if (!reclaimer)
+        return false;
+
+    if (!reclaimer->IsValid()) {
+        delete reclaimer;
+        return false;
+    }
+
+    GpuObjectReclaimer *expected{};
+    if (!mappingHandle->reclaimer.compare_exchange_strong(expected, reclaimer, std::memory_order_acq_rel)) {
+        delete reclaimer;
+        return false;
+    }
+
+    return true;
+}
+
+uint32_t adrenotools_flush_deferred_frees(void *handle) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+
+    auto reclaimer{mappingHandle->reclaimer.load(std::memory_order_acquire)};
+    return reclaimer ? reclaimer->Flush() : 0;
+}
+
+bool adrenotools_find_imported_range(void *handle, uint64_t gpuAddr, struct adrenotools_gpu_mapping *mapping) {
+    auto mappingHandle{reinterpret_cast<GpuMappingHandle *>(handle)};
+
+    GpuObjectIndex::Object object;
+    if (!mappingHandle->objects.FindOwner(gpuAddr, object))
+        return false;
+
+    *mapping = {
+        .host_ptr = object.hostPtr,
+        .gpu_addr = object.gpuAddr,
+        .size = object.size,
+        .flags = 0,
     };
+    return true;
+}
 
-    int kgslFd{open("/dev/kgsl-3d0", O_RDWR)};
-    if (kgslFd < 0)
-        return;
+void adrenotools_set_turbo(bool turbo) {
+    uint32_t enable{turbo ? 0U : 1U};
 
-    ioctl(kgslFd, IOCTL_KGSL_SETPROPERTY, &prop);
-    close (kgslFd);
+    if (auto kgslCtx{adrenotools_kgsl_context_get_default()})
+        kgslCtx->SetProperty(KGSL_PROP_PWRCTRL, &enable, sizeof(enable));
 }
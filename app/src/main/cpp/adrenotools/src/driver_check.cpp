@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <deque>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+#include <elf_view.h>
+#include <adrenotools/driver_check.h>
+
+// The directories searched after the driver directory, these mirror the sphal and default namespaces the driver namespace is parented to
+static constexpr const char *DefaultSearchPaths[]{
+    "/odm/lib64",
+    "/vendor/lib64",
+    "/vendor/lib64/hw",
+    "/system/lib64",
+    "/apex/com.android.runtime/lib64/bionic",
+};
+
+static std::string JoinPath(const std::string &dir, const std::string &name) {
+    if (dir.empty() || dir.back() == '/')
+        return dir + name;
+
+    return dir + '/' + name;
+}
+
+bool adrenotools_check_driver(const char *customDriverDir, const char *customDriverName, adrenotools_driver_issue_fn issueFn, void *userData) {
+    return adrenotools_check_driver_with_search_paths(customDriverDir, customDriverName, DefaultSearchPaths, sizeof(DefaultSearchPaths) / sizeof(DefaultSearchPaths[0]), issueFn, userData);
+}
+
+bool adrenotools_check_driver_with_search_paths(const char *customDriverDir, const char *customDriverName, const char *const *searchPaths, uint32_t searchPathCount, adrenotools_driver_issue_fn issueFn, void *userData) {
+    bool ok{true};
+    auto report{[&](adrenotools_driver_issue_type type, const std::string &library, const std::string &name) {
+        ok = false;
+        if (issueFn)
+            issueFn(userData, type, library.c_str(), name.c_str());
+    }};
+
+    std::vector<std::string> searchDirs{customDriverDir};
+    for (uint32_t i{}; i < searchPathCount; i++)
+        searchDirs.emplace_back(searchPaths[i]);
+
+    auto resolve{[&](const std::string &name) -> std::string {
+        // Absolute DT_NEEDED entries are rare but are loaded as-is by the linker
+        std::vector<std::string> candidates;
+        if (!name.empty() && name.front() == '/')
+            candidates.push_back(name);
+        else
+            for (const auto &dir : searchDirs)
+                candidates.push_back(JoinPath(dir, name));
+
+        for (const auto &candidate : candidates) {
+            struct stat buf{};
+            if (!stat(candidate.c_str(), &buf) && S_ISREG(buf.st_mode))
+                return candidate;
+        }
+
+        return {};
+    }};
+
+    struct Library {
+        std::string path;
+        std::vector<std::string> undefined;
+    };
+
+    // Walk the dependency closure breadth first as the linker does, libraries are deduplicated by the name they were requested as
+    std::vector<Library> libraries;
+    std::unordered_set<std::string> visited{customDriverName};
+    std::unordered_set<std::string> defined;
+    bool symbolsComplete{true}; //!< Cleared if any library's symbols couldn't be read, as undefined symbols can't be checked reliably then
+    std::deque<std::string> pending{JoinPath(customDriverDir, customDriverName)};
+
+    while (!pending.empty()) {
+        auto path{std::move(pending.front())};
+        pending.pop_front();
+
+        ElfView elf{path.c_str()};
+        if (!elf.IsValid()) {
+            report(ADRENOTOOLS_DRIVER_ISSUE_INVALID_LIBRARY, path, {});
+            symbolsComplete = false;
+            continue;
+        }
+
+        // Record all globally visible symbols the library defines and all non-weak symbols it expects other libraries to define
+        Library library{.path = path, .undefined = {}};
+        for (const auto &symbol : elf.Symbols()) {
+            auto binding{ELF64_ST_BIND(symbol.st_info)};
+            if (!symbol.st_name || (binding != STB_GLOBAL && binding != STB_WEAK && binding != STB_GNU_UNIQUE))
+                continue;
+
+            if (symbol.st_shndx != SHN_UNDEF)
+                defined.emplace(elf.SymbolName(symbol));
+            else if (binding == STB_GLOBAL)
+                library.undefined.emplace_back(elf.SymbolName(symbol));
+        }
+
+        // A library with dynamic entries but no symbols couldn't have its symbol table located
+        if (elf.Symbols().empty() && !elf.DynamicEntries().empty())
+            symbolsComplete = false;
+
+        libraries.push_back(std::move(library));
+
+        for (auto neededName : elf.Needed()) {
+            std::string dependency{neededName};
+            if (!visited.insert(dependency).second)
+                continue;
+
+            auto dependencyPath{resolve(dependency)};
+            if (dependencyPath.empty()) {
+                report(ADRENOTOOLS_DRIVER_ISSUE_MISSING_LIBRARY, path, dependency);
+                symbolsComplete = false;
+                continue;
+            }
+
+            pending.push_back(std::move(dependencyPath));
+        }
+    }
+
+    if (!symbolsComplete)
+        return ok;
+
+    for (const auto &library : libraries)
+        for (const auto &symbol : library.undefined)
+            if (!defined.contains(symbol))
+                report(ADRENOTOOLS_DRIVER_ISSUE_UNDEFINED_SYMBOL, library.path, symbol);
+
+    return ok;
+}
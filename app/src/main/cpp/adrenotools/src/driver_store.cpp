@@ -0,0 +1,704 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <adrenotools/driver_store.h>
+
+/**
+ * @brief The layout of a store directory:
+ * objects/<key>: A library stored once, named by the hash of its contents, these are read-only as they're shared between packages
+ * packages/<name>/: A package's view, linking its file names to objects
+ * packages/<name>/.manifest: The objects the view references, this lives in the view so it's always swapped along with it
+ * index: The size and reference count of every object
+ * lock: Held with flock while the store is used
+ */
+static constexpr const char *ObjectsDir{"objects/"};
+static constexpr const char *PackagesDir{"packages/"};
+static constexpr const char *IndexFile{"index"};
+static constexpr const char *LockFile{"lock"};
+static constexpr const char *ManifestFile{".manifest"};
+static constexpr const char *TempSuffix{".tmp"};
+
+static constexpr size_t BufferSize{64 * 1024};
+static constexpr size_t KeyLength{32}; //!< The length of an object key, 128 bits of hash as hex
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+namespace {
+    struct ObjectInfo {
+        uint64_t size;
+        uint32_t references; //!< The number of files across all packages with this object's contents
+    };
+
+    using ObjectIndex = std::map<std::string, ObjectInfo, std::less<>>;
+
+    /**
+     * @brief A file in a package and the object it links to
+     */
+    struct ManifestEntry {
+        std::string key;
+        std::string name;
+    };
+
+    /**
+     * @brief Holds the store's lock for its lifetime, flock locks are per open file so this excludes other threads as well as other processes
+     */
+    class StoreLock {
+      private:
+        int fd;
+
+      public:
+        explicit StoreLock(const std::string &storeDir) : fd{open((storeDir + LockFile).c_str(), O_CREAT | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR)} {
+            while (fd != -1 && flock(fd, LOCK_EX)) {
+                if (errno != EINTR) {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+        }
+
+        StoreLock(const StoreLock &) = delete;
+        StoreLock &operator=(const StoreLock &) = delete;
+
+        ~StoreLock() {
+            if (fd != -1)
+                close(fd);
+        }
+
+        bool IsLocked() const {
+            return fd != -1;
+        }
+    };
+
+    /**
+     * @brief Streaming XXH64, a fast non-cryptographic 64-bit hash
+     * @note https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+     */
+    class Xxh64 {
+      private:
+        static constexpr uint64_t Prime1{0x9E3779B185EBCA87ULL};
+        static constexpr uint64_t Prime2{0xC2B2AE3D27D4EB4FULL};
+        static constexpr uint64_t Prime3{0x165667B19E3779F9ULL};
+        static constexpr uint64_t Prime4{0x85EBCA77C2B2AE63ULL};
+        static constexpr uint64_t Prime5{0x27D4EB2F165667C5ULL};
+        static constexpr size_t StripeSize{32};
+
+        uint64_t seed;
+        uint64_t lanes[4];
+        uint8_t pending[StripeSize]{};
+        size_t pendingSize{};
+        uint64_t totalSize{};
+
+        static uint64_t RotateLeft(uint64_t value, int amount) {
+            return (value << amount) | (value >> (64 - amount));
+        }
+
+        template<typename T>
+        static T Read(const uint8_t *data) {
+            T value;
+            memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        static uint64_t Round(uint64_t accumulator, uint64_t input) {
+            return RotateLeft(accumulator + input * Prime2, 31) * Prime1;
+        }
+
+        static uint64_t MergeRound(uint64_t accumulator, uint64_t lane) {
+            return (accumulator ^ Round(0, lane)) * Prime1 + Prime4;
+        }
+
+        void ConsumeStripe(const uint8_t *stripe) {
+            for (size_t i{}; i < 4; i++)
+                lanes[i] = Round(lanes[i], Read<uint64_t>(stripe + i * sizeof(uint64_t)));
+        }
+
+      public:
+        explicit Xxh64(uint64_t seed) : seed{seed}, lanes{seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1} {}
+
+        void Update(const uint8_t *data, size_t size) {
+            totalSize += size;
+            if (pendingSize) {
+                size_t fill{std::min(size, StripeSize - pendingSize)};
+                memcpy(pending + pendingSize, data, fill);
+                pendingSize += fill;
+                data += fill;
+                size -= fill;
+                if (pendingSize < StripeSize)
+                    return;
+
+                ConsumeStripe(pending);
+                pendingSize = 0;
+            }
+
+            for (; size >= StripeSize; data += StripeSize, size -= StripeSize)
+                ConsumeStripe(data);
+
+            memcpy(pending, data, size);
+            pendingSize = size;
+        }
+
+        uint64_t Digest() const {
+            uint64_t hash;
+            if (totalSize >= StripeSize) {
+                hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+                for (auto lane : lanes)
+                    hash = MergeRound(hash, lane);
+            } else {
+                hash = seed + Prime5;
+            }
+
+            hash += totalSize;
+
+            const uint8_t *data{pending};
+            size_t size{pendingSize};
+            for (; size >= 8; data += 8, size -= 8)
+                hash = RotateLeft(hash ^ Round(0, Read<uint64_t>(data)), 27) * Prime1 + Prime4;
+
+            if (size >= 4) {
+                hash = RotateLeft(hash ^ (Read<uint32_t>(data) * Prime1), 23) * Prime2 + Prime3;
+                data += 4;
+                size -= 4;
+            }
+
+            for (; size; data++, size--)
+                hash = RotateLeft(hash ^ (*data * Prime5), 11) * Prime1;
+
+            hash ^= hash >> 33;
+            hash *= Prime2;
+            hash ^= hash >> 29;
+            hash *= Prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+    };
+}
+
+/**
+ * @return If `name` can be used as a file name within a directory without escaping it or colliding with the store's own files
+ */
+static bool IsPlainName(std::string_view name) {
+    return !name.empty() && name.front() != '.' && name.find('/') == std::string_view::npos;
+}
+
+static std::string WithTrailingSlash(const char *dir) {
+    std::string path{dir};
+    if (!path.empty() && path.back() != '/')
+        path.push_back('/');
+
+    return path;
+}
+
+/**
+ * @brief Hashes a file's contents, two XXH64 hashes with different seeds are combined to make accidental collisions between libraries practically impossible
+ */
+static bool HashFile(int fd, std::vector<uint8_t> &buffer, std::string &key, uint64_t &size) {
+    Xxh64 low{0}, high{0x9E3779B97F4A7C15ULL};
+    size = 0;
+    while (true) {
+        auto bytesRead{read(fd, buffer.data(), buffer.size())};
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead < 0)
+            return false;
+        if (bytesRead == 0)
+            break;
+
+        low.Update(buffer.data(), static_cast<size_t>(bytesRead));
+        high.Update(buffer.data(), static_cast<size_t>(bytesRead));
+        size += static_cast<uint64_t>(bytesRead);
+    }
+
+    char hex[KeyLength + 1];
+    snprintf(hex, sizeof(hex), "%016" PRIx64 "%016" PRIx64, high.Digest(), low.Digest());
+    key = hex;
+    return true;
+}
+
+/**
+ * @brief Copies a file to `dstPath` through a temporary file, so `dstPath` only ever holds complete contents
+ * @note Objects are read-only, so they can't be opened for writing again if one is left behind by a crash. Any leftover temporary file is removed first and the finished copy is renamed over `dstPath`
+ */
+static bool CopyFile(int srcFd, const std::string &dstPath, uint64_t size) {
+    auto tempPath{dstPath + TempSuffix};
+    unlink(tempPath.c_str());
+    int dstFd{open(tempPath.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, S_IRUSR)};
+    if (dstFd == -1)
+        return false;
+
+    off_t offset{};
+    bool success{true};
+    while (static_cast<uint64_t>(offset) < size) {
+        auto sent{sendfile(dstFd, srcFd, &offset, static_cast<size_t>(size - static_cast<uint64_t>(offset)))};
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0) {
+            success = false;
+            break;
+        }
+    }
+
+    close(dstFd);
+    if (success && !rename(tempPath.c_str(), dstPath.c_str()))
+        return true;
+
+    unlink(tempPath.c_str());
+    return false;
+}
+
+static bool ReadIndex(const std::string &storeDir, ObjectIndex &index) {
+    index.clear();
+    auto file{fopen((storeDir + IndexFile).c_str(), "re")};
+    if (!file)
+        return errno == ENOENT;
+
+    char key[KeyLength + 1];
+    uint64_t size;
+    uint32_t references;
+    while (fscanf(file, "%32s %" SCNu64 " %" SCNu32, key, &size, &references) == 3)
+        index.insert_or_assign(key, ObjectInfo{.size = size, .references = references});
+
+    bool success{!ferror(file)};
+    fclose(file);
+    return success;
+}
+
+/**
+ * @brief Atomically replaces a small file in the store with `contents`
+ */
+static bool WriteFileAtomic(const std::string &path, const std::string &contents) {
+    auto tempPath{path + TempSuffix};
+    int fd{open(tempPath.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR)};
+    if (fd == -1)
+        return false;
+
+    bool success{write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()) && !fsync(fd)};
+    close(fd);
+    if (success && !rename(tempPath.c_str(), path.c_str()))
+        return true;
+
+    unlink(tempPath.c_str());
+    return false;
+}
+
+static bool WriteIndex(const std::string &storeDir, const ObjectIndex &index) {
+    std::string contents;
+    char line[KeyLength + 64];
+    for (const auto &[key, info] : index) {
+        snprintf(line, sizeof(line), "%s %" PRIu64 " %" PRIu32 "\n", key.c_str(), info.size, info.references);
+        contents += line;
+    }
+
+    return WriteFileAtomic(storeDir + IndexFile, contents);
+}
+
+static bool ReadManifest(const std::string &viewDir, std::vector<ManifestEntry> &manifest) {
+    manifest.clear();
+    auto file{fopen((viewDir + ManifestFile).c_str(), "re")};
+    if (!file)
+        return false;
+
+    // Each line is a key followed by a space and the file name, which is the rest of the line
+    char line[KeyLength + 1 + NAME_MAX + 2];
+    while (fgets(line, sizeof(line), file)) {
+        std::string_view entry{line};
+        if (!entry.empty() && entry.back() == '\n')
+            entry.remove_suffix(1);
+
+        if (entry.size() <= KeyLength + 1 || entry[KeyLength] != ' ')
+            continue;
+
+        manifest.push_back({.key = std::string{entry.substr(0, KeyLength)}, .name = std::string{entry.substr(KeyLength + 1)}});
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * @brief Deletes a view or a staging directory, these only ever contain files and links
+ */
+static void RemoveDirectory(const std::string &dir) {
+    if (auto dirp{opendir(dir.c_str())}) {
+        while (auto entry{readdir(dirp)})
+            if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+                unlink((dir + entry->d_name).c_str());
+
+        closedir(dirp);
+    }
+
+    rmdir(dir.c_str());
+}
+
+/**
+ * @brief Recounts every object's references from the views, which are what actually use the objects. This fixes counts left too high by a crash
+ * @note The views are authoritative even for objects the index doesn't list (e.g. if it was lost), these are added back to the index as deleting them would leave the views dangling
+ */
+static void RecountReferences(const std::string &storeDir, ObjectIndex &index) {
+    for (auto &[key, info] : index)
+        info.references = 0;
+
+    std::string objectsPath{storeDir + ObjectsDir};
+    std::string packagesPath{storeDir + PackagesDir};
+    auto dir{opendir(packagesPath.c_str())};
+    if (!dir)
+        return;
+
+    while (auto entry{readdir(dir)}) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        // Staging views are left behind if a process dies midway through adding or removing a package, the store's lock is held so none can be in use
+        std::string viewPath{packagesPath + entry->d_name + '/'};
+        std::vector<ManifestEntry> manifest;
+        if (!IsPlainName(entry->d_name) || !ReadManifest(viewPath, manifest)) {
+            RemoveDirectory(viewPath);
+            continue;
+        }
+
+        for (const auto &manifestEntry : manifest) {
+            auto object{index.find(manifestEntry.key)};
+            if (object == index.end()) {
+                struct stat objectStat{};
+                if (stat((objectsPath + manifestEntry.key).c_str(), &objectStat))
+                    continue;
+
+                object = index.insert_or_assign(manifestEntry.key, ObjectInfo{.size = static_cast<uint64_t>(objectStat.st_size), .references = 0}).first;
+            }
+
+            object->second.references++;
+        }
+    }
+
+    closedir(dir);
+}
+
+/**
+ * @brief Reads the index, rebuilding it from the views if it's missing so the objects they use aren't treated as unreferenced
+ */
+static bool LoadIndex(const std::string &storeDir, ObjectIndex &index) {
+    if (!ReadIndex(storeDir, index))
+        return false;
+
+    if (access((storeDir + IndexFile).c_str(), F_OK) && errno == ENOENT)
+        RecountReferences(storeDir, index);
+
+    return true;
+}
+
+/**
+ * @brief Drops a reference to every object in `manifest`, deleting objects that are no longer referenced
+ */
+static void ReleaseObjects(const std::string &storeDir, ObjectIndex &index, const std::vector<ManifestEntry> &manifest) {
+    for (const auto &entry : manifest) {
+        auto object{index.find(entry.key)};
+        if (object == index.end())
+            continue;
+
+        if (object->second.references > 1) {
+            object->second.references--;
+            continue;
+        }
+
+        unlink((storeDir + ObjectsDir + entry.key).c_str());
+        index.erase(object);
+    }
+}
+
+/**
+ * @brief Creates the store's directories if needed and locks it
+ * @return The store directory with a trailing slash or an empty string on failure
+ */
+static std::string OpenStore(const char *storeDir) {
+    if (!storeDir || !*storeDir)
+        return {};
+
+    auto dir{WithTrailingSlash(storeDir)};
+    for (const auto &path : {dir, dir + ObjectsDir, dir + PackagesDir})
+        if (mkdir(path.c_str(), S_IRWXU) && errno != EEXIST)
+            return {};
+
+    return dir;
+}
+
+static bool WritePath(const std::string &path, char *buffer, size_t size) {
+    if (!buffer)
+        return true;
+
+    if (path.size() >= size)
+        return false;
+
+    memcpy(buffer, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool adrenotools_store_add_package(const char *storeDir, const char *packageName, const char *sourceDir, char *viewDir, size_t viewDirSize) {
+    if (!packageName || !IsPlainName(packageName) || !sourceDir)
+        return false;
+
+    auto store{OpenStore(storeDir)};
+    if (store.empty())
+        return false;
+
+    StoreLock lock{store};
+    ObjectIndex index;
+    if (!lock.IsLocked() || !LoadIndex(store, index))
+        return false;
+
+    auto source{WithTrailingSlash(sourceDir)};
+    auto viewPath{store + PackagesDir + packageName + '/'};
+    auto stagingPath{store + PackagesDir + '.' + packageName + TempSuffix + '/'};
+    RemoveDirectory(stagingPath);
+    if (mkdir(stagingPath.c_str(), S_IRWXU))
+        return false;
+
+    // The package is built up in a staging view, which only replaces the current view once everything it references is in the store
+    std::vector<ManifestEntry> manifest;
+    std::vector<std::string> newObjects; //!< Objects this package added to the index, these are removed again if it fails to be added
+    bool success{[&]() {
+        auto dir{opendir(source.c_str())};
+        if (!dir)
+            return false;
+
+        std::vector<uint8_t> buffer(BufferSize);
+        bool filesAdded{[&]() {
+            while (auto entry{readdir(dir)}) {
+                if (!IsPlainName(entry->d_name))
+                    continue;
+
+                int fd{open((source + entry->d_name).c_str(), O_RDONLY | O_CLOEXEC)};
+                if (fd == -1)
+                    return false;
+
+                std::string key;
+                uint64_t size{};
+                struct stat fileStat{};
+                bool added{[&]() {
+                    if (fstat(fd, &fileStat))
+                        return false;
+
+                    if (!S_ISREG(fileStat.st_mode))
+                        return true;
+
+                    if (!HashFile(fd, buffer, key, size))
+                        return false;
+
+                    // Only contents the store hasn't seen before are copied, this is where switching between similar drivers saves time and space. An object on disk that isn't in the index may be left over from a crash so it's copied again, as is a listed object that has gone missing
+                    auto objectPath{store + ObjectsDir + key};
+                    auto object{index.find(key)};
+                    if (object == index.end() || access(objectPath.c_str(), F_OK)) {
+                        if (!CopyFile(fd, objectPath, size))
+                            return false;
+
+                        // Re-creating a listed object must keep the references other packages hold to it
+                        if (object == index.end()) {
+                            newObjects.push_back(key);
+                            index.insert_or_assign(key, ObjectInfo{.size = size, .references = 0});
+                        }
+                    }
+
+                    // Hardlinks to app data are denied on Android 10+, relative symlinks work everywhere and keep working if the store is moved
+                    auto linkPath{stagingPath + entry->d_name};
+                    if (link(objectPath.c_str(), linkPath.c_str()) && symlink(("../../" + std::string{ObjectsDir} + key).c_str(), linkPath.c_str()))
+                        return false;
+
+                    manifest.push_back({.key = key, .name = entry->d_name});
+                    return true;
+                }()};
+
+                close(fd);
+                if (!added)
+                    return false;
+            }
+
+            return true;
+        }()};
+
+        closedir(dir);
+        if (!filesAdded)
+            return false;
+
+        std::string manifestContents;
+        for (const auto &entry : manifest)
+            manifestContents += entry.key + ' ' + entry.name + '\n';
+
+        return WriteFileAtomic(stagingPath + ManifestFile, manifestContents);
+    }()};
+
+    if (!success) {
+        RemoveDirectory(stagingPath);
+        for (const auto &key : newObjects) {
+            unlink((store + ObjectsDir + key).c_str());
+            index.erase(key);
+        }
+
+        return false;
+    }
+
+    // New objects must be durable before the index refers to them, a single sync covers all of them
+    int storeFd{open(store.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (storeFd != -1) {
+        syncfs(storeFd);
+        close(storeFd);
+    }
+
+    // References are taken before the new view is swapped in and dropped after the old one is swapped out, so a crash in between only ever leaks objects until the next garbage collection
+    for (const auto &entry : manifest)
+        index[entry.key].references++;
+
+    if (!WriteIndex(store, index)) {
+        RemoveDirectory(stagingPath);
+        return false;
+    }
+
+    std::vector<ManifestEntry> oldManifest;
+    bool replacing{ReadManifest(viewPath, oldManifest)};
+    if (replacing) {
+        // Views are exchanged atomically so the package is never missing, the old view ends up at the staging path
+        if (syscall(__NR_renameat2, AT_FDCWD, stagingPath.c_str(), AT_FDCWD, viewPath.c_str(), RENAME_EXCHANGE)) {
+            RemoveDirectory(viewPath);
+            if (rename(stagingPath.c_str(), viewPath.c_str()))
+                return false;
+        }
+    } else {
+        RemoveDirectory(viewPath);
+        if (rename(stagingPath.c_str(), viewPath.c_str()))
+            return false;
+    }
+
+    if (replacing) {
+        ReleaseObjects(store, index, oldManifest);
+        WriteIndex(store, index);
+        RemoveDirectory(stagingPath);
+    }
+
+    return WritePath(viewPath, viewDir, viewDirSize);
+}
+
+bool adrenotools_store_remove_package(const char *storeDir, const char *packageName) {
+    if (!packageName || !IsPlainName(packageName))
+        return false;
+
+    auto store{OpenStore(storeDir)};
+    if (store.empty())
+        return false;
+
+    StoreLock lock{store};
+    ObjectIndex index;
+    if (!lock.IsLocked() || !LoadIndex(store, index))
+        return false;
+
+    auto viewPath{store + PackagesDir + packageName + '/'};
+    auto removingPath{store + PackagesDir + '.' + packageName + TempSuffix + '/'};
+    std::vector<ManifestEntry> manifest;
+    if (!ReadManifest(viewPath, manifest))
+        return false;
+
+    RemoveDirectory(removingPath);
+    if (rename(viewPath.c_str(), removingPath.c_str()))
+        return false;
+
+    ReleaseObjects(store, index, manifest);
+    WriteIndex(store, index);
+    RemoveDirectory(removingPath);
+    return true;
+}
+
+bool adrenotools_store_get_package_view(const char *storeDir, const char *packageName, char *viewDir, size_t viewDirSize) {
+    if (!storeDir || !packageName || !IsPlainName(packageName))
+        return false;
+
+    auto viewPath{WithTrailingSlash(storeDir) + PackagesDir + packageName + '/'};
+    if (access((viewPath + ManifestFile).c_str(), F_OK))
+        return false;
+
+    return WritePath(viewPath, viewDir, viewDirSize);
+}
+
+uint64_t adrenotools_store_collect_garbage(const char *storeDir) {
+    auto store{OpenStore(storeDir)};
+    if (store.empty())
+        return 0;
+
+    StoreLock lock{store};
+    ObjectIndex index;
+    if (!lock.IsLocked() || !ReadIndex(store, index))
+        return 0;
+
+    RecountReferences(store, index);
+
+    uint64_t freedBytes{};
+    std::string objectsPath{store + ObjectsDir};
+    if (auto dir{opendir(objectsPath.c_str())}) {
+        while (auto entry{readdir(dir)}) {
+            if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+                continue;
+
+            auto object{index.find(std::string_view{entry->d_name})};
+            if (object != index.end() && object->second.references)
+                continue;
+
+            struct stat objectStat{};
+            auto objectPath{objectsPath + entry->d_name};
+            if (!stat(objectPath.c_str(), &objectStat) && !unlink(objectPath.c_str()))
+                freedBytes += static_cast<uint64_t>(objectStat.st_size);
+        }
+
+        closedir(dir);
+    }
+
+    std::erase_if(index, [](const auto &object) { return !object.second.references; });
+    WriteIndex(store, index);
+    unlink((store + IndexFile + TempSuffix).c_str());
+    return freedBytes;
+}
+
+bool adrenotools_store_get_usage(const char *storeDir, struct adrenotools_store_usage *usage) {
+    if (!usage)
+        return false;
+
+    *usage = {};
+    auto store{OpenStore(storeDir)};
+    if (store.empty())
+        return false;
+
+    StoreLock lock{store};
+    ObjectIndex index;
+    if (!lock.IsLocked() || !LoadIndex(store, index))
+        return false;
+
+    for (const auto &[key, info] : index) {
+        usage->object_count++;
+        usage->stored_bytes += info.size;
+        usage->package_bytes += info.size * info.references;
+    }
+
+    std::string packagesPath{store + PackagesDir};
+    if (auto dir{opendir(packagesPath.c_str())}) {
+        while (auto entry{readdir(dir)})
+            if (IsPlainName(entry->d_name) && !access((packagesPath + entry->d_name + '/' + ManifestFile).c_str(), F_OK))
+                usage->package_count++;
+
+        closedir(dir);
+    }
+
+    return true;
+}
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <new>
+#include "hook/kgsl_device.h"
+#include <adrenotools/governor.h>
+
+/**
+ * @brief The turbo policy, this is kept separate from the device so it can be replayed offline
+ */
+class GovernorPolicy {
+  private:
+    adrenotools_governor_config config;
+    float alpha; //!< The weight of each new frame in the moving averages
+    float smoothedFrameTime{};
+    float smoothedBusy{};
+    bool primed{}; //!< If the moving averages have been seeded by a frame
+    bool turbo{};
+    uint64_t lastChange{};
+    bool changed{}; //!< If the state has ever changed, the dwell time doesn't apply before the first change
+
+  public:
+    explicit GovernorPolicy(const adrenotools_governor_config &config)
+        : config{config},
+          alpha{config.smoothing_frames > 1 ? 2.0f / static_cast<float>(config.smoothing_frames + 1) : 1.0f} {}
+
+    bool IsTurbo() const {
+        return turbo;
+    }
+
+    /**
+     * @return If the turbo state changed
+     */
+    bool Update(const adrenotools_governor_frame &frame) {
+        auto frameTime{static_cast<float>(frame.frame_time_ns)};
+        if (!primed) {
+            smoothedFrameTime = frameTime;
+            smoothedBusy = frame.gpu_busy;
+            primed = true;
+        } else {
+            smoothedFrameTime += alpha * (frameTime - smoothedFrameTime);
+            smoothedBusy += alpha * (frame.gpu_busy - smoothedBusy);
+        }
+
+        auto budget{static_cast<float>(config.frame_budget_ns)};
+        uint64_t sinceChange{frame.timestamp_ns - lastChange};
+        bool dwelled{!changed || sinceChange >= config.min_dwell_ns};
+
+        bool target{turbo};
+        if (!turbo) {
+            bool gpuBound{smoothedBusy >= config.busy_threshold};
+            bool atRisk{smoothedFrameTime >= budget * config.boost_threshold};
+            bool missed{frame.frame_time_ns > config.frame_budget_ns && frame.gpu_busy >= config.busy_threshold};
+            bool emergencyDwelled{!changed || sinceChange >= config.emergency_dwell_ns};
+
+            // A GPU bound missed frame is worth boosting for sooner, but still only after the shorter emergency dwell so a release isn't immediately undone by one slow frame
+            target = gpuBound && ((atRisk && dwelled) || (missed && emergencyDwelled));
+        } else if (dwelled) {
+            target = smoothedFrameTime >= budget * config.release_threshold;
+        }
+
+        if (target == turbo)
+            return false;
+
+        turbo = target;
+        lastChange = frame.timestamp_ns;
+        changed = true;
+        return true;
+    }
+};
+
+struct adrenotools_governor {
+    adrenotools_kgsl_context *kgslCtx;
+    GovernorPolicy policy;
+
+    void Apply(bool turbo) const {
+        // Matches adrenotools_set_turbo, clearing power control pins the GPU at its maximum clocks
+        uint32_t enable{turbo ? 0U : 1U};
+        kgslCtx->SetProperty(KGSL_PROP_PWRCTRL, &enable, sizeof(enable));
+    }
+};
+
+static bool IsConfigValid(const adrenotools_governor_config &config) {
+    return config.frame_budget_ns && config.release_threshold < config.boost_threshold && config.emergency_dwell_ns <= config.min_dwell_ns;
+}
+
+adrenotools_governor *adrenotools_governor_create(adrenotools_kgsl_context *ctx, const adrenotools_governor_config *config) {
+    if (!ctx)
+        ctx = adrenotools_kgsl_context_get_default();
+
+    if (!ctx || !IsConfigValid(*config))
+        return nullptr;
+
+    auto governor{new (std::nothrow) adrenotools_governor{
+        .kgslCtx = ctx,
+        .policy = GovernorPolicy{*config},
+    }};
+
+    if (governor)
+        governor->Apply(false);
+
+    return governor;
+}
+
+void adrenotools_governor_destroy(adrenotools_governor *governor) {
+    if (governor->policy.IsTurbo())
+        governor->Apply(false);
+
+    delete governor;
+}
+
+bool adrenotools_governor_report_frame(adrenotools_governor *governor, const adrenotools_governor_frame *frame) {
+    if (governor->policy.Update(*frame))
+        governor->Apply(governor->policy.IsTurbo());
+
+    return governor->policy.IsTurbo();
+}
+
+uint32_t adrenotools_governor_simulate(const adrenotools_governor_config *config, const adrenotools_governor_frame *frames, uint32_t count, bool *turbo) {
+    if (!IsConfigValid(*config)) {
+        std::fill_n(turbo, count, false);
+        return 0;
+    }
+
+    GovernorPolicy policy{*config};
+
+    uint32_t changes{};
+    for (uint32_t i{}; i < count; i++) {
+        if (policy.Update(frames[i]))
+            changes++;
+
+        turbo[i] = policy.IsTurbo();
+    }
+
+    return changes;
+}
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <android/log.h>
+#include <elf_view.h>
+#include "driver_preloader.h"
+
+#define TAG "driver_preloader"
+#define LOGI(fmt, ...) __android_log_print(ANDROID_LOG_INFO, TAG, fmt, ##__VA_ARGS__)
+
+static constexpr size_t MaxPrefetchThreads{4};
+
+namespace {
+    struct Library {
+        std::string name;
+        std::vector<std::string> needed{}; //!< DT_NEEDED entries of the library
+        std::vector<size_t> dependents{}; //!< Libraries in the same directory that depend on this one
+        size_t pendingDependencies{}; //!< Dependencies in the same directory that must be loaded first
+    };
+}
+
+size_t PreloadDriverLibraries(const std::string &driverDir, const std::string &driverName, const android_dlextinfo &extinfo) {
+    // Only the driver's DT_NEEDED closure within the directory is preloaded, it may also contain libraries (e.g. other drivers) that the driver never loads
+    std::vector<Library> libraries;
+    std::unordered_map<std::string, size_t> indices;
+    std::unordered_set<std::string> visited{driverName};
+    std::vector<std::string> pending;
+    {
+        ElfView driverElf{(driverDir + driverName).c_str()};
+        if (!driverElf.IsValid())
+            return 0;
+
+        for (auto needed : driverElf.Needed())
+            pending.emplace_back(needed);
+    }
+
+    while (!pending.empty()) {
+        auto name{std::move(pending.back())};
+        pending.pop_back();
+        if (name.find('/') != std::string::npos || !visited.insert(name).second)
+            continue;
+
+        // Anything that isn't in the directory is resolved from the system by the linker as usual
+        ElfView elf{(driverDir + name).c_str()};
+        if (!elf.IsValid())
+            continue;
+
+        Library library{.name = name};
+        for (auto needed : elf.Needed()) {
+            library.needed.emplace_back(needed);
+            pending.emplace_back(needed);
+        }
+
+        indices.emplace(std::move(name), libraries.size());
+        libraries.push_back(std::move(library));
+    }
+
+    for (size_t i{}; i < libraries.size(); i++) {
+        for (const auto &needed : libraries[i].needed) {
+            auto it{indices.find(needed)};
+            if (it == indices.end() || it->second == i)
+                continue;
+
+            libraries[it->second].dependents.push_back(i);
+            libraries[i].pendingDependencies++;
+        }
+    }
+
+    // Kahn's algorithm, leaves come first so by the time a library is loaded its dependencies are already resident in the namespace
+    std::vector<size_t> order;
+    order.reserve(libraries.size());
+    for (size_t i{}; i < libraries.size(); i++)
+        if (!libraries[i].pendingDependencies)
+            order.push_back(i);
+
+    for (size_t next{}; next < order.size(); next++)
+        for (size_t dependent : libraries[order[next]].dependents)
+            if (--libraries[dependent].pendingDependencies == 0)
+                order.push_back(dependent);
+
+    if (order.size() != libraries.size())
+        LOGI("PreloadDriverLibraries: skipping %zu libraries with cyclic dependencies", libraries.size() - order.size());
+
+    // Workers read files into the page cache in load order while the calling thread links them
+    std::mutex mutex;
+    std::condition_variable prefetchedCv;
+    std::vector<bool> prefetched(order.size());
+    std::atomic<size_t> nextPrefetch{};
+
+    auto prefetchWorker{[&]() {
+        for (size_t i; (i = nextPrefetch.fetch_add(1, std::memory_order_relaxed)) < order.size();) {
+            int fd{open((driverDir + libraries[order[i]].name).c_str(), O_RDONLY | O_CLOEXEC)};
+            if (fd != -1) {
+                struct stat libStat{};
+                if (!fstat(fd, &libStat))
+                    readahead(fd, 0, static_cast<size_t>(libStat.st_size));
+                close(fd);
+            }
+
+            {
+                std::scoped_lock lock{mutex};
+                prefetched[i] = true;
+            }
+            prefetchedCv.notify_all();
+        }
+    }};
+
+    std::vector<std::thread> workers;
+    size_t workerCount{std::min<size_t>({MaxPrefetchThreads, std::max(std::thread::hardware_concurrency(), 1U), order.size()})};
+    workers.reserve(workerCount);
+    try {
+        for (size_t i{}; i < workerCount; i++)
+            workers.emplace_back(prefetchWorker);
+    } catch (const std::system_error &) {
+        // This runs inside the dlopen hook so exceptions must not escape, any workers that did start still prefetch everything
+        LOGI("PreloadDriverLibraries: failed to start prefetch workers, %zu running", workers.size());
+    }
+
+    // Without any workers libraries are loaded without prefetching
+    if (workers.empty())
+        std::fill(prefetched.begin(), prefetched.end(), true);
+
+    size_t loaded{};
+    for (size_t i{}; i < order.size(); i++) {
+        {
+            std::unique_lock lock{mutex};
+            prefetchedCv.wait(lock, [&]() { return prefetched[i]; });
+        }
+
+        const auto &name{libraries[order[i]].name};
+        // The handle is intentionally leaked, the driver will take its own reference when it loads the library by name
+        if (android_dlopen_ext(name.c_str(), RTLD_NOW, &extinfo))
+            loaded++;
+        else
+            LOGI("PreloadDriverLibraries: failed to preload %s: %s", name.c_str(), dlerror());
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    return loaded;
+}
@@ -0,0 +1,15 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <string>
+#include <android/dlext.h>
+
+/**
+ * @brief Loads the libraries in `driverDir` that the driver depends on, directly or indirectly, into the namespace in `extinfo`, dependencies before their dependents
+ * @note Bionic serialises dlopen under a global lock so loading itself happens on the calling thread, worker threads read the files into the page cache ahead of it so I/O overlaps with relocation
+ * @param driverName The driver library, this is skipped so the caller can load it with its own flags
+ * @return The number of libraries that were loaded
+ */
+size_t PreloadDriverLibraries(const std::string &driverDir, const std::string &driverName, const android_dlextinfo &extinfo);
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include "gpu_mapping_queue.h"
+#include "gpu_object_index.h"
+#include "gpu_object_reclaimer.h"
+
+/**
+ * @brief The state behind the mapping handle returned by adrenotools_open_libvulkan, shared between adrenotools and the GSL hooks
+ */
+struct GpuMappingHandle {
+    GpuMappingQueue queue; //!< Mappings waiting to be claimed by the allocation hook
+    GpuObjectIndex objects; //!< Every KGSL object created by adrenotools that's still alive, keyed by GPU address
+    std::atomic<GpuObjectReclaimer *> reclaimer{}; //!< If set, frees of imported objects are deferred to a background thread. This is never unset once set
+};
@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <adrenotools/priv.h>
+
+static constexpr uint64_t GslMappingFlags{0xc2600}; //!< Unknown flags, but they are required for imported mappings to work
+
+/**
+ * @brief A fixed-size lock-free pool of imported mappings waiting to be claimed by the GSL allocation hook
+ * @note Any number of threads may push and pop concurrently, pops are matched on the size, flags and tag of each pending mapping
+ * @note This is header-only as it's shared between adrenotools and hook_impl, which live in separate linker namespaces
+ */
+class GpuMappingQueue {
+  public:
+    static constexpr uint32_t SlotCount{256};
+
+  private:
+    enum class SlotState : uint32_t {
+        Free, //!< The slot can be claimed by a producer
+        Writing, //!< A producer is filling in the slot
+        Pending, //!< The slot holds a mapping waiting for a matching allocation
+        Claimed, //!< The mapping has been handed to the driver, the slot is being recycled
+    };
+
+    /**
+     * @brief Packs a slot state with its generation, the generation is bumped every time a slot is recycled so stale tickets and racing consumers can be detected
+     */
+    static constexpr uint64_t PackState(uint32_t generation, SlotState state) {
+        return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(state);
+    }
+
+    static constexpr uint32_t Generation(uint64_t packed) {
+        return static_cast<uint32_t>(packed >> 32);
+    }
+
+    static constexpr SlotState State(uint64_t packed) {
+        return static_cast<SlotState>(static_cast<uint32_t>(packed));
+    }
+
+    struct Slot {
+        std::atomic<uint64_t> state{PackState(0, SlotState::Free)};
+        std::atomic<uint32_t> consumedGeneration{UINT32_MAX}; //!< The last generation of this slot that was claimed by the hook rather than cancelled
+        adrenotools_gpu_mapping mapping{};
+        std::atomic<uint64_t> size{}; //!< A copy of `mapping.size` that consumers can match against before claiming the slot
+        std::atomic<uint64_t> flags{}; //!< A copy of `mapping.flags`, see `size`
+        std::atomic<uint64_t> tag{}; //!< If non-zero only allocations from the thread with this kernel TID can claim the mapping
+        uint32_t id{}; //!< The KGSL object ID backing the mapping
+        bool borrowed{}; //!< If the mapping is a view into an object owned by someone else (e.g. a sub-allocation) and must not be freed along with the VkDeviceMemory
+    };
+
+    std::array<Slot, SlotCount> slots{};
+    std::atomic<uint32_t> pushHint{}; //!< Rotating start index for producers to reduce contention on the first slots
+    std::atomic<uint32_t> pendingCount{};
+
+  public:
+    std::atomic<bool> hookReady{}; //!< Set by the hook once the GSL allocator has been hooked successfully
+
+    /**
+     * @brief Publishes a mapping so it can be claimed by a matching allocation
+     * @param ticket Set to an opaque value that can be passed to GetStatus to query if the mapping has been claimed
+     * @return false if all slots are in use
+     */
+    bool Push(const adrenotools_gpu_mapping &mapping, uint64_t tag, uint32_t id, bool borrowed, uint64_t &ticket) {
+        uint32_t start{pushHint.fetch_add(1, std::memory_order_relaxed)};
+        for (uint32_t i{}; i < SlotCount; i++) {
+            uint32_t index{(start + i) % SlotCount};
+            auto &slot{slots[index]};
+
+            uint64_t expected{slot.state.load(std::memory_order_relaxed)};
+            if (State(expected) != SlotState::Free)
+                continue;
+
+            uint32_t generation{Generation(expected)};
+            if (!slot.state.compare_exchange_strong(expected, PackState(generation, SlotState::Writing), std::memory_order_acquire, std::memory_order_relaxed))
+                continue;
+
+            slot.mapping = mapping;
+            slot.size.store(mapping.size, std::memory_order_relaxed);
+            slot.flags.store(mapping.flags, std::memory_order_relaxed);
+            slot.tag.store(tag, std::memory_order_relaxed);
+            slot.id = id;
+            slot.borrowed = borrowed;
+            pendingCount.fetch_add(1, std::memory_order_relaxed);
+            slot.state.store(PackState(generation, SlotState::Pending), std::memory_order_release);
+
+            ticket = (static_cast<uint64_t>(generation) << 32) | index;
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Claims the first pending mapping that matches an allocation
+     * @param callerTag The kernel TID of the allocating thread
+     * @param borrowed Set to if the claimed mapping must not be freed along with the driver allocation
+     * @return true if a mapping was claimed and written to `out`
+     */
+    bool Pop(uint64_t size, uint64_t flags, uint64_t callerTag, adrenotools_gpu_mapping &out, bool &borrowed) {
+        if (!pendingCount.load(std::memory_order_acquire))
+            return false;
+
+        for (auto &slot : slots) {
+            uint64_t expected{slot.state.load(std::memory_order_acquire)};
+            if (State(expected) != SlotState::Pending)
+                continue;
+
+            // The match keys are atomic as they may be rewritten by a producer recycling the slot, the CAS below fails if that happens as the generation will have changed. The mapping itself is only read once the slot is claimed
+            uint64_t slotFlags{slot.flags.load(std::memory_order_relaxed)};
+            uint64_t slotTag{slot.tag.load(std::memory_order_relaxed)};
+            if (slot.size.load(std::memory_order_relaxed) != size || (slotFlags & flags) != slotFlags || (slotTag && slotTag != callerTag))
+                continue;
+
+            uint32_t generation{Generation(expected)};
+            if (!slot.state.compare_exchange_strong(expected, PackState(generation, SlotState::Claimed), std::memory_order_acquire, std::memory_order_relaxed))
+                continue;
+
+            out = slot.mapping;
+            borrowed = slot.borrowed;
+            slot.consumedGeneration.store(generation, std::memory_order_relaxed);
+            pendingCount.fetch_sub(1, std::memory_order_relaxed);
+            slot.state.store(PackState(generation + 1, SlotState::Free), std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Withdraws a mapping that hasn't been claimed yet
+     * @param gpuAddr Set to the GPU address of the withdrawn mapping
+     * @param id Set to the KGSL object ID of the withdrawn mapping so the caller can free it
+     * @param borrowed Set to if the object is owned by someone else and shouldn't be freed
+     * @return false if the mapping has already been claimed
+     */
+    bool Cancel(uint64_t ticket, uint64_t &gpuAddr, uint32_t &id, bool &borrowed) {
+        uint32_t index{static_cast<uint32_t>(ticket)};
+        if (index >= SlotCount)
+            return false;
+
+        auto &slot{slots[index]};
+        uint32_t generation{static_cast<uint32_t>(ticket >> 32)};
+        uint64_t expected{PackState(generation, SlotState::Pending)};
+        if (!slot.state.compare_exchange_strong(expected, PackState(generation, SlotState::Claimed), std::memory_order_acquire, std::memory_order_relaxed))
+            return false;
+
+        gpuAddr = slot.mapping.gpu_addr;
+        id = slot.id;
+        borrowed = slot.borrowed;
+        pendingCount.fetch_sub(1, std::memory_order_relaxed);
+        slot.state.store(PackState(generation + 1, SlotState::Free), std::memory_order_release);
+        return true;
+    }
+
+    adrenotools_gpu_mapping_status GetStatus(uint64_t ticket) const {
+        uint32_t index{static_cast<uint32_t>(ticket)};
+        if (index >= SlotCount)
+            return ADRENOTOOLS_GPU_MAPPING_INVALID;
+
+        auto &slot{slots[index]};
+        uint32_t generation{static_cast<uint32_t>(ticket >> 32)};
+        uint64_t state{slot.state.load(std::memory_order_acquire)};
+        if (Generation(state) == generation) {
+            switch (State(state)) {
+                case SlotState::Free:
+                    return ADRENOTOOLS_GPU_MAPPING_INVALID;
+                case SlotState::Claimed:
+                    return ADRENOTOOLS_GPU_MAPPING_CONSUMED;
+                default:
+                    return ADRENOTOOLS_GPU_MAPPING_PENDING;
+            }
+        }
+
+        // The slot has since been recycled, only the most recent generation's outcome is retained
+        uint32_t consumedGeneration{slot.consumedGeneration.load(std::memory_order_relaxed)};
+        if (consumedGeneration == generation)
+            return ADRENOTOOLS_GPU_MAPPING_CONSUMED;
+
+        return Generation(state) > generation ? ADRENOTOOLS_GPU_MAPPING_EXPIRED : ADRENOTOOLS_GPU_MAPPING_INVALID;
+    }
+
+    /**
+     * @return If there are no mappings waiting to be claimed
+     */
+    bool IsDrained() const {
+        return !pendingCount.load(std::memory_order_acquire);
+    }
+};
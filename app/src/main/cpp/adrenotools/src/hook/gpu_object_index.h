@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief A lock-free open-addressing hash map from the GPU address of an object created by adrenotools to its KGSL object ID
+ * @note This lets the free hook release imported objects without first asking the kernel for their ID, it's bounded so callers must be able to fall back to IOCTL_KGSL_GPUMEM_GET_INFO when an insert fails
+ * @note This is header-only as it's shared between adrenotools and hook_impl, which live in separate linker namespaces
+ */
+class GpuObjectIndex {
+  public:
+    static constexpr uint32_t Capacity{16384}; //!< Must be a power of two
+    static constexpr uint32_t MaxProbes{64}; //!< Bounds the cost of lookups for addresses that aren't present
+
+    struct Object {
+        uint64_t gpuAddr;
+        uint64_t size;
+        void *hostPtr;
+        uint32_t id;
+    };
+
+  private:
+    static constexpr uint64_t EmptyKey{0};
+    static constexpr uint64_t TombstoneKey{UINT64_MAX}; //!< A removed entry, probing must continue past these
+    static constexpr uint64_t ReservedKey{UINT64_MAX - 1}; //!< An entry that's in the middle of being inserted
+
+    /**
+     * @note The payload is only written by Insert while the entry is reserved, `sequence` is odd while it's being written so readers can detect the entry being reused underneath them
+     */
+    struct Entry {
+        std::atomic<uint64_t> key{EmptyKey};
+        std::atomic<uint32_t> sequence{};
+        std::atomic<uint64_t> size{};
+        std::atomic<void *> hostPtr{};
+        std::atomic<uint32_t> id{};
+    };
+
+    std::array<Entry, Capacity> entries{};
+
+    static uint32_t Hash(uint64_t gpuAddr) {
+        // Objects are page aligned so the low bits carry no information
+        uint64_t hash{(gpuAddr >> 12) * 0x9E3779B97F4A7C15ULL};
+        return static_cast<uint32_t>(hash >> 32) & (Capacity - 1);
+    }
+
+    static void ReadPayload(const Entry &entry, uint64_t key, Object &object) {
+        object = {
+            .gpuAddr = key,
+            .size = entry.size.load(std::memory_order_relaxed),
+            .hostPtr = entry.hostPtr.load(std::memory_order_relaxed),
+            .id = entry.id.load(std::memory_order_relaxed),
+        };
+    }
+
+    /**
+     * @brief Reads the key and payload of an entry without claiming it, retrying until both belong to the same insertion
+     * @return The key of the entry, the payload is only meaningful if this is a valid address
+     */
+    static uint64_t Snapshot(const Entry &entry, Object &object) {
+        while (true) {
+            uint32_t sequence{entry.sequence.load(std::memory_order_acquire)};
+            uint64_t key{entry.key.load(std::memory_order_acquire)};
+            ReadPayload(entry, key, object);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!(sequence & 1) && entry.sequence.load(std::memory_order_relaxed) == sequence)
+                return key;
+        }
+    }
+
+  public:
+    /**
+     * @return false if no free entry could be found within MaxProbes of the address' home slot
+     */
+    bool Insert(uint64_t gpuAddr, uint32_t id, uint64_t size, void *hostPtr) {
+        uint32_t home{Hash(gpuAddr)};
+        for (uint32_t probe{}; probe < MaxProbes; probe++) {
+            auto &entry{entries[(home + probe) & (Capacity - 1)]};
+
+            uint64_t key{entry.key.load(std::memory_order_relaxed)};
+            if (key != EmptyKey && key != TombstoneKey)
+                continue;
+
+            if (!entry.key.compare_exchange_strong(key, ReservedKey, std::memory_order_acquire, std::memory_order_relaxed))
+                continue;
+
+            uint32_t sequence{entry.sequence.load(std::memory_order_relaxed)};
+            entry.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            entry.size.store(size, std::memory_order_relaxed);
+            entry.hostPtr.store(hostPtr, std::memory_order_relaxed);
+            entry.id.store(id, std::memory_order_relaxed);
+
+            entry.sequence.store(sequence + 2, std::memory_order_release);
+            entry.key.store(gpuAddr, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Looks up the object at `gpuAddr` without removing it
+     * @return If the object was present and has been written to `object`
+     */
+    bool Find(uint64_t gpuAddr, Object &object) const {
+        uint32_t home{Hash(gpuAddr)};
+        for (uint32_t probe{}; probe < MaxProbes; probe++) {
+            auto &entry{entries[(home + probe) & (Capacity - 1)]};
+
+            uint64_t key{Snapshot(entry, object)};
+            if (key == EmptyKey)
+                return false;
+            else if (key == gpuAddr)
+                return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Removes the object at `gpuAddr` from the index
+     * @return If the object was present and has been written to `object`
+     */
+    bool Remove(uint64_t gpuAddr, Object &object) {
+        uint32_t home{Hash(gpuAddr)};
+        for (uint32_t probe{}; probe < MaxProbes; probe++) {
+            auto &entry{entries[(home + probe) & (Capacity - 1)]};
+
+            uint64_t key{entry.key.load(std::memory_order_acquire)};
+            if (key == EmptyKey)
+                return false;
+            else if (key != gpuAddr)
+                continue;
+
+            // The entry is claimed before its payload is read as KGSL reuses GPU addresses, the object may have been removed and another inserted at the same address since the key was loaded
+            if (!entry.key.compare_exchange_strong(key, ReservedKey, std::memory_order_acquire, std::memory_order_relaxed))
+                return false;
+
+            ReadPayload(entry, gpuAddr, object);
+            entry.key.store(TombstoneKey, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Finds the object whose range contains `gpuAddr`
+     * @note This scans the entire index and is intended for debugging only
+     */
+    bool FindOwner(uint64_t gpuAddr, Object &object) const {
+        for (auto &entry : entries) {
+            uint64_t key{Snapshot(entry, object)};
+            if (key == EmptyKey || key == TombstoneKey || key == ReservedKey)
+                continue;
+
+            if (gpuAddr >= key && gpuAddr - key < object.size)
+                return true;
+        }
+
+        return false;
+    }
+};
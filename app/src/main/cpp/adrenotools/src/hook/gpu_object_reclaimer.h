@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <adrenotools/priv.h>
+#include "kgsl_device.h"
+
+/**
+ * @brief Moves frees of imported GPU objects off the driver's calling thread, queued objects are released in batches by a background thread
+ * @note Enqueue is header-only and safe to call from hook_impl, the reclaim thread itself lives in adrenotools
+ */
+class GpuObjectReclaimer {
+  public:
+    struct PendingFree {
+        uint64_t gpuAddr;
+        uint32_t id; //!< 0 if the ID is unknown and needs to be looked up by the reclaim thread
+    };
+
+  private:
+    /**
+     * @brief A bounded multi-producer multi-consumer queue cell, see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+     */
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        PendingFree value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    uint64_t mask;
+    alignas(64) std::atomic<uint64_t> enqueuePos{};
+    alignas(64) std::atomic<uint64_t> dequeuePos{};
+
+    int wakeFd; //!< eventfd used to wake the reclaim thread once a batch is ready
+    adrenotools_kgsl_context *kgslCtx;
+    adrenotools_reclaimer_config config;
+    std::atomic<bool> timestampFreeSupported{true}; //!< Cleared if the kernel rejects IOCTL_KGSL_CMDSTREAM_FREEMEMONTIMESTAMP_CTXTID
+    std::atomic<bool> stopping{};
+    std::thread thread;
+
+    /**
+     * @brief Releases a single object
+     * @param timestamp If non-zero, the object is freed once the configured context retires this timestamp rather than immediately
+     */
+    void Release(const PendingFree &pending, uint32_t timestamp);
+
+    void Run();
+
+  public:
+    /**
+     * @param config The configuration to use, `queue_depth` will be rounded up to a power of two
+     * @note This doesn't throw, IsValid must be checked after construction
+     */
+    GpuObjectReclaimer(adrenotools_kgsl_context *kgslCtx, const adrenotools_reclaimer_config &config);
+
+    ~GpuObjectReclaimer();
+
+    bool IsValid() const {
+        return cells && wakeFd >= 0 && thread.joinable();
+    }
+
+    /**
+     * @brief Queues an object to be freed by the reclaim thread
+     * @return false if the queue is full, in which case the caller should free the object itself
+     */
+    bool Enqueue(const PendingFree &pending) {
+        uint64_t pos{enqueuePos.load(std::memory_order_relaxed)};
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            uint64_t sequence{cell->sequence.load(std::memory_order_acquire)};
+            auto diff{static_cast<int64_t>(sequence - pos)};
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = pending;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        // Only wake the reclaim thread once per batch, otherwise it'll pick the object up at the next flush interval
+        if (((pos + 1) % config.batch_size) == 0) {
+            uint64_t one{1};
+            (void)!write(wakeFd, &one, sizeof(one));
+        }
+
+        return true;
+    }
+
+    bool Dequeue(PendingFree &pending) {
+        uint64_t pos{dequeuePos.load(std::memory_order_relaxed)};
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & mask];
+            uint64_t sequence{cell->sequence.load(std::memory_order_acquire)};
+            auto diff{static_cast<int64_t>(sequence - (pos + 1))};
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        pending = cell->value;
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Releases every queued object on the calling thread
+     * @return The number of objects released
+     */
+    uint32_t Flush();
+};
@@ -1,15 +1,20 @@
+#include <algorithm>
 #include <initializer_list>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <cstdio>
 #include <cstring>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <unistd.h>
 #include <android_linker_ns.h>
 #include <android/dlext.h>
 #include <android/log.h>
-#include "kgsl.h"
+#include "kgsl_device.h"
 #include "hook_impl_params.h"
+#include "driver_preloader.h"
 #include "hook_impl.h"
 
 #define TAG "hook_impl"
@@ -19,12 +24,23 @@ const HookImplParams *hook_params; //!< Bunch of info needed to load/patch the d
 int (*gsl_memory_alloc_pure_sym)(uint32_t, uint32_t, void *);
 int (*gsl_memory_alloc_pure_64_sym)(uint64_t, uint32_t, void *);
 int (*gsl_memory_free_pure_sym)(void *);
-int kgsl_fd;
 
 using gsl_memory_alloc_pure_t = decltype(gsl_memory_alloc_pure_sym);
 using gsl_memory_alloc_pure_64_t = decltype(gsl_memory_alloc_pure_64_sym);
 using gsl_memory_free_pure_t = decltype(gsl_memory_free_pure_sym);
 
+/**
+ * @brief A driver namespace along with the hooks loaded into it, kept for the lifetime of the process so reloading the same driver skips setting it up again
+ */
+struct DriverNamespace {
+    std::string filename; //!< The library name the loader requested
+    android_namespace_t *parentNs; //!< The namespace the loader requested the library be loaded into
+    android_namespace_t *driverNs;
+};
+
+static std::mutex driverNamespaceMutex;
+static std::vector<DriverNamespace> driverNamespaces;
+
 __attribute__((visibility("default"))) void init_hook_param(const void *param) {
     hook_params = reinterpret_cast<const HookImplParams *>(param);
 }
@@ -47,85 +63,128 @@ __attribute__((visibility("default"))) void *hook_android_dlopen_ext(const char
     if (!strstr(filename, "vulkan."))
         return android_dlopen_ext(filename, flags, extinfo);
 
+    auto loadTrace{hook_params->loadTrace};
+    LoadTrace::ScopedSpan dlopenSpan{loadTrace, "hook_android_dlopen_ext"};
+
     if (extinfo->library_namespace == nullptr || !(extinfo->flags & ANDROID_DLEXT_USE_NAMESPACE)) {
         LOGI("hook_android_dlopen_ext: hook failed: namespace not supplied!");
         return fallback();
     }
 
-    // customDriverDir will be empty if ADRENOTOOLS_DRIVER_CUSTOM isn't set therefore it's fine to have either way
-    auto driverNs{android_create_namespace(filename, hook_params->customDriverDir.c_str(),
-                                           hook_params->hookLibDir.c_str(), ANDROID_NAMESPACE_TYPE_SHARED,
-                                           nullptr, extinfo->library_namespace)};
-    if (!driverNs) {
-        LOGI("hook_android_dlopen_ext: hook failed: namespace not supplied!");
-        return fallback();
-    }
+    // Use our new namespace to load the vulkan driver
+    auto newExtinfo{*extinfo};
 
-    // We depend on libandroid which is unlikely to be in the supplied driver namespace so we have to link it over
-    android_link_namespaces(driverNs, nullptr, "libandroid.so");
+    {
+        // Reuse the namespace and hooks from an earlier load of the same driver, so reloading Vulkan only pays for the driver's own init
+        // Everything set up here (including preloaded and GSL libraries) stays loaded, only the driver itself is unloaded when the loader closes it
+        std::scoped_lock lock{driverNamespaceMutex};
+        auto cached{std::find_if(driverNamespaces.begin(), driverNamespaces.end(), [&](const DriverNamespace &entry) {
+            return entry.parentNs == extinfo->library_namespace && entry.filename == filename;
+        })};
+
+        if (cached != driverNamespaces.end()) {
+            LOGI("hook_android_dlopen_ext: reusing driver namespace");
+            newExtinfo.library_namespace = cached->driverNs;
+        } else {
+            android_namespace_t *driverNs;
+            {
+                LoadTrace::ScopedSpan span{loadTrace, "driver namespace creation"};
+
+                // customDriverDir will be empty if ADRENOTOOLS_DRIVER_CUSTOM isn't set therefore it's fine to have either way
+                driverNs = android_create_namespace(filename, hook_params->customDriverDir.c_str(),
+                                                    hook_params->hookLibDir.c_str(), ANDROID_NAMESPACE_TYPE_SHARED,
+                                                    nullptr, extinfo->library_namespace);
+                if (!driverNs) {
+                    LOGI("hook_android_dlopen_ext: hook failed: namespace not supplied!");
+                    return fallback();
+                }
 
-    // Preload ourself, a new instance will be created since we have different linker ancestory
-    // If we don't preload we get a weird issue where despite being in NEEDED of the hook lib the hook's symbols will overwrite ours and cause an infinite loop
-    auto hookImpl{linkernsbypass_namespace_dlopen("libhook_impl.so", RTLD_NOW, driverNs)};
-    if (!hookImpl)
-        return nullptr;
+                // We depend on libandroid which is unlikely to be in the supplied driver namespace so we have to link it over
+                android_link_namespaces(driverNs, nullptr, "libandroid.so");
+            }
 
-    // Pass parameters to ourself
-    auto initHookParam{reinterpret_cast<void (*)(const void *)>(dlsym(hookImpl, "init_hook_param"))};
-    if (!initHookParam)
-        return nullptr;
+            void *hookImpl;
+            {
+                LoadTrace::ScopedSpan span{loadTrace, "driver libhook_impl load"};
 
-    initHookParam(hook_params);
+                // Preload ourself, a new instance will be created since we have different linker ancestory
+                // If we don't preload we get a weird issue where despite being in NEEDED of the hook lib the hook's symbols will overwrite ours and cause an infinite loop
+                hookImpl = linkernsbypass_namespace_dlopen("libhook_impl.so", RTLD_NOW, driverNs);
+                if (!hookImpl)
+                    return nullptr;
+            }
 
-    if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_FILE_REDIRECT) {
-        if (!linkernsbypass_namespace_dlopen("libfile_redirect_hook.so", RTLD_GLOBAL, driverNs)) {
-            LOGI("hook_android_dlopen_ext: hook failed: failed to apply libfopen_redirect_hook!");
-            return fallback();
-        }
+            // Pass parameters to ourself
+            auto initHookParam{reinterpret_cast<void (*)(const void *)>(dlsym(hookImpl, "init_hook_param"))};
+            if (!initHookParam)
+                return nullptr;
 
-        LOGI("hook_android_dlopen_ext: applied libfile_redirect_hook");
-    }
+            initHookParam(hook_params);
 
-    // Use our new namespace to load the vulkan driver
-    auto newExtinfo{*extinfo};
-    newExtinfo.library_namespace = driverNs;
+            if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_FILE_REDIRECT) {
+                LoadTrace::ScopedSpan span{loadTrace, "libfile_redirect_hook load"};
+                if (!linkernsbypass_namespace_dlopen("libfile_redirect_hook.so", RTLD_GLOBAL, driverNs)) {
+                    LOGI("hook_android_dlopen_ext: hook failed: failed to apply libfopen_redirect_hook!");
+                    return fallback();
+                }
 
-    if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) {
-        if (!linkernsbypass_namespace_dlopen("libgsl_alloc_hook.so", RTLD_GLOBAL, driverNs)) {
-            LOGI("hook_android_dlopen_ext: hook failed: failed to apply libgsl_alloc_hook!");
-            return fallback();
-        }
+                LOGI("hook_android_dlopen_ext: applied libfile_redirect_hook");
+            }
 
-        auto libgslHandle{android_dlopen_ext("vkbgsl.so", RTLD_NOW, &newExtinfo)};
-        if (!libgslHandle) {
-            libgslHandle = android_dlopen_ext("notgsl.so", RTLD_NOW, &newExtinfo);
-            if (!libgslHandle)
-                libgslHandle = android_dlopen_ext("libgsl.so", RTLD_NOW, &newExtinfo);
-        }
+            newExtinfo.library_namespace = driverNs;
 
-        if (libgslHandle) {
-            gsl_memory_alloc_pure_sym = reinterpret_cast<decltype(gsl_memory_alloc_pure_sym)>(dlsym(libgslHandle, "gsl_memory_alloc_pure"));
-            gsl_memory_alloc_pure_64_sym = reinterpret_cast<decltype(gsl_memory_alloc_pure_64_sym)>(dlsym(libgslHandle, "gsl_memory_alloc_pure_64"));
-            gsl_memory_free_pure_sym = reinterpret_cast<decltype(gsl_memory_free_pure_sym)>(dlsym(libgslHandle, "gsl_memory_free_pure"));
-            if ((gsl_memory_alloc_pure_sym || gsl_memory_alloc_pure_64_sym) && gsl_memory_free_pure_sym) {
-                auto initGsl{reinterpret_cast<void (*)(gsl_memory_alloc_pure_t, gsl_memory_alloc_pure_64_t, gsl_memory_free_pure_t)>(dlsym(hookImpl, "init_gsl"))};
-                if (!initGsl)
+            if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) {
+                LoadTrace::ScopedSpan span{loadTrace, "libgsl_alloc_hook load"};
+                if (!linkernsbypass_namespace_dlopen("libgsl_alloc_hook.so", RTLD_GLOBAL, driverNs)) {
+                    LOGI("hook_android_dlopen_ext: hook failed: failed to apply libgsl_alloc_hook!");
                     return fallback();
+                }
+            }
 
-                initGsl(gsl_memory_alloc_pure_sym, gsl_memory_alloc_pure_64_sym, gsl_memory_free_pure_sym);
-                LOGI("hook_android_dlopen_ext: applied libgsl_alloc_hook");
-                hook_params->nextGpuMapping->gpu_addr = ADRENOTOOLS_GPU_MAPPING_SUCCEEDED_MAGIC;
+            // This must happen after all global hooks are loaded so the preloaded libraries bind to them
+            if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_PRELOAD) {
+                LoadTrace::ScopedSpan span{loadTrace, "driver library preload"};
+                auto preloaded{PreloadDriverLibraries(hook_params->customDriverDir, hook_params->customDriverName, newExtinfo)};
+                LOGI("hook_android_dlopen_ext: preloaded %zu driver libraries", preloaded);
             }
-        }
 
-        if (!((gsl_memory_alloc_pure_sym || gsl_memory_alloc_pure_64_sym) && gsl_memory_free_pure_sym))
-            LOGI("hook_android_dlopen_ext: hook failed: failed to apply libgsl_alloc_hook!");
+            if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_GPU_MAPPING_IMPORT) {
+                LoadTrace::ScopedSpan span{loadTrace, "GSL symbol lookup"};
+                auto libgslHandle{android_dlopen_ext("vkbgsl.so", RTLD_NOW, &newExtinfo)};
+                if (!libgslHandle) {
+                    libgslHandle = android_dlopen_ext("notgsl.so", RTLD_NOW, &newExtinfo);
+                    if (!libgslHandle)
+                        libgslHandle = android_dlopen_ext("libgsl.so", RTLD_NOW, &newExtinfo);
+                }
+
+                if (libgslHandle) {
+                    gsl_memory_alloc_pure_sym = reinterpret_cast<decltype(gsl_memory_alloc_pure_sym)>(dlsym(libgslHandle, "gsl_memory_alloc_pure"));
+                    gsl_memory_alloc_pure_64_sym = reinterpret_cast<decltype(gsl_memory_alloc_pure_64_sym)>(dlsym(libgslHandle, "gsl_memory_alloc_pure_64"));
+                    gsl_memory_free_pure_sym = reinterpret_cast<decltype(gsl_memory_free_pure_sym)>(dlsym(libgslHandle, "gsl_memory_free_pure"));
+                    if ((gsl_memory_alloc_pure_sym || gsl_memory_alloc_pure_64_sym) && gsl_memory_free_pure_sym) {
+                        auto initGsl{reinterpret_cast<void (*)(gsl_memory_alloc_pure_t, gsl_memory_alloc_pure_64_t, gsl_memory_free_pure_t)>(dlsym(hookImpl, "init_gsl"))};
+                        if (!initGsl)
+                            return fallback();
+
+                        initGsl(gsl_memory_alloc_pure_sym, gsl_memory_alloc_pure_64_sym, gsl_memory_free_pure_sym);
+                        LOGI("hook_android_dlopen_ext: applied libgsl_alloc_hook");
+                        hook_params->mappingHandle->queue.hookReady.store(true, std::memory_order_release);
+                    }
+                }
+
+                if (!((gsl_memory_alloc_pure_sym || gsl_memory_alloc_pure_64_sym) && gsl_memory_free_pure_sym))
+                    LOGI("hook_android_dlopen_ext: hook failed: failed to apply libgsl_alloc_hook!");
+            }
+
+            driverNamespaces.push_back({.filename = filename, .parentNs = extinfo->library_namespace, .driverNs = driverNs});
+        }
     }
 
     // TODO: If there is already an instance of a Vulkan driver loaded hooks won't be applied, this will only be the case for skiavk generally
     // To fix this we would need to search /proc/self/maps for the file to a loaded instance of the library in order to read it to patch the soname and load it uniquely
     if (hook_params->featureFlags & ADRENOTOOLS_DRIVER_CUSTOM) {
         LOGI("hook_android_dlopen_ext: loading custom driver: %s%s", hook_params->customDriverDir.c_str(), hook_params->customDriverName.c_str());
+        LoadTrace::ScopedSpan span{loadTrace, "custom driver load"};
         void *handle{android_dlopen_ext(hook_params->customDriverName.c_str(), flags, &newExtinfo)};
         if (!handle) {
             LOGI("hook_android_dlopen_ext: hook failed: failed to load custom driver: %s!", dlerror());
@@ -135,6 +194,7 @@ __attribute__((visibility("default"))) void *hook_android_dlopen_ext(const char
         return handle;
     } else {
         LOGI("hook_android_dlopen_ext: loading default driver: %s", filename);
+        LoadTrace::ScopedSpan span{loadTrace, "default driver load"};
         return android_dlopen_ext(filename, flags, &newExtinfo);
     }
 }
@@ -145,10 +205,9 @@ __attribute__((visibility("default"))) void *hook_android_load_sphal_library(con
     // https://android.googlesource.com/platform/system/core/+/master/libvndksupport/linker.cpp
     for (const char *name : {"sphal", "vendor", "default"}) {
         if (auto vendorNs{android_get_exported_namespace(name)}) {
-            android_dlextinfo dlextinfo{
-                .flags = ANDROID_DLEXT_USE_NAMESPACE,
-                .library_namespace = vendorNs,
-            };
+            android_dlextinfo dlextinfo{};
+            dlextinfo.flags = ANDROID_DLEXT_USE_NAMESPACE;
+            dlextinfo.library_namespace = vendorNs;
 
             return hook_android_dlopen_ext(filename, flags, &dlextinfo);
         }
@@ -157,6 +216,21 @@ __attribute__((visibility("default"))) void *hook_android_load_sphal_library(con
     return nullptr;
 }
 
+#ifndef __ANDROID__
+__attribute__((visibility("default"))) void *hook_dlopen(const char *filename, int flags) {
+    // The main executable isn't in any namespace
+    if (!filename)
+        return android_dlopen_ext(filename, flags, nullptr);
+
+    // Handle this like Android's loader requesting a driver from the namespace it was loaded into
+    android_dlextinfo dlextinfo{};
+    dlextinfo.flags = ANDROID_DLEXT_USE_NAMESPACE;
+    dlextinfo.library_namespace = hook_params->hookNs;
+
+    return hook_android_dlopen_ext(filename, flags, &dlextinfo);
+}
+#endif
+
 __attribute__((visibility("default"))) FILE *hook_fopen(const char *filename, const char *mode) {
     if (!strncmp("/proc", filename, 5) || !strncmp("/sys", filename, 4)) {
         LOGI("hook_fopen: passthrough: %s", filename);
@@ -170,6 +244,7 @@ __attribute__((visibility("default"))) FILE *hook_fopen(const char *filename, co
 }
 
 static constexpr uintptr_t GslMemDescImportedPrivMagic{0xdeadb33f};
+static constexpr uintptr_t GslMemDescBorrowedPrivMagic{0xdeadb34f}; //!< An imported view into memory owned elsewhere (e.g. a sub-allocation), freeing it is a no-op
 struct GslMemDesc {
     void *hostptr;
     uint64_t gpuaddr;
@@ -180,16 +255,14 @@ struct GslMemDesc {
 
 __attribute__((visibility("default"))) int hook_gsl_memory_alloc_pure_64(uint64_t size, uint32_t flags, void *memDesc) {
     auto gslMemDesc{reinterpret_cast<GslMemDesc *>(memDesc)};
-    if (hook_params->nextGpuMapping && hook_params->nextGpuMapping->size == size && (hook_params->nextGpuMapping->flags & flags) == hook_params->nextGpuMapping->flags) {
-        auto &nextMapping{*hook_params->nextGpuMapping};
-
-        gslMemDesc->hostptr = nextMapping.host_ptr;
-        gslMemDesc->gpuaddr = nextMapping.gpu_addr;
-        gslMemDesc->size = nextMapping.size;
-        gslMemDesc->flags = nextMapping.flags;
-        gslMemDesc->priv = GslMemDescImportedPrivMagic;
-        hook_params->nextGpuMapping->size = 0;
-        hook_params->nextGpuMapping->gpu_addr = ADRENOTOOLS_GPU_MAPPING_SUCCEEDED_MAGIC;
+    adrenotools_gpu_mapping mapping;
+    bool borrowed;
+    if (hook_params->mappingHandle && hook_params->mappingHandle->queue.Pop(size, flags, static_cast<uint64_t>(gettid()), mapping, borrowed)) {
+        gslMemDesc->hostptr = mapping.host_ptr;
+        gslMemDesc->gpuaddr = mapping.gpu_addr;
+        gslMemDesc->size = mapping.size;
+        gslMemDesc->flags = mapping.flags;
+        gslMemDesc->priv = borrowed ? GslMemDescBorrowedPrivMagic : GslMemDescImportedPrivMagic;
         return 0;
     } else {
         if (gsl_memory_alloc_pure_64_sym)
@@ -202,24 +275,37 @@ __attribute__((visibility("default"))) int hook_gsl_memory_alloc_pure_64(uint64_
 __attribute__((visibility("default"))) int hook_gsl_memory_free_pure(void *memDesc) {
     auto gslMemDesc{reinterpret_cast<GslMemDesc *>(memDesc)};
 
-    if (gslMemDesc->priv == GslMemDescImportedPrivMagic) {
-        if (!kgsl_fd)
-            kgsl_fd = open("/dev/kgsl-3d0", O_RDWR);
-
-        kgsl_gpumem_get_info info{
-            .gpuaddr = gslMemDesc->gpuaddr
-        };
-
-        if (ioctl(kgsl_fd, IOCTL_KGSL_GPUMEM_GET_INFO, &info) < 0) {
-            LOGI("IOCTL_KGSL_GPUMEM_GET_INFO failed");
+    if (gslMemDesc->priv == GslMemDescBorrowedPrivMagic) {
+        return 0;
+    } else if (gslMemDesc->priv == GslMemDescImportedPrivMagic) {
+        auto kgslCtx{hook_params->kgslContext};
+        if (!kgslCtx) {
+            LOGI("hook_gsl_memory_free_pure: no KGSL context");
             return 0;
         }
 
-        kgsl_gpuobj_free args{
-            .id = info.id,
-        };
+        // Objects imported by adrenotools are indexed by GPU address, only objects that didn't fit in the index need a kernel lookup
+        GpuObjectIndex::Object object{};
+        uint32_t id{};
+        if (hook_params->mappingHandle && hook_params->mappingHandle->objects.Remove(gslMemDesc->gpuaddr, object))
+            id = object.id;
+
+        // Hand the free (and the ID lookup if needed) to the reclaim thread if it's enabled, keeping the ioctls off the driver's calling thread
+        if (auto reclaimer{hook_params->mappingHandle ? hook_params->mappingHandle->reclaimer.load(std::memory_order_acquire) : nullptr})
+            if (reclaimer->Enqueue({.gpuAddr = gslMemDesc->gpuaddr, .id = id}))
+                return 0;
+
+        if (!id) {
+            kgsl_gpumem_get_info info{};
+            if (!kgslCtx->GetGpumemInfo(gslMemDesc->gpuaddr, info)) {
+                LOGI("IOCTL_KGSL_GPUMEM_GET_INFO failed");
+                return 0;
+            }
+
+            id = info.id;
+        }
 
-        if (ioctl(kgsl_fd, IOCTL_KGSL_GPUOBJ_FREE, &args) < 0)
+        if (!kgslCtx->FreeGpuobj(id))
             LOGI("IOCTL_KGSL_GPUOBJ_FREE failed");
 
         return 0;
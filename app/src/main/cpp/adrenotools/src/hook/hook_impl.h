@@ -18,6 +18,10 @@ void *hook_android_dlopen_ext(const char *filename, int flags, const android_dle
 
 void *hook_android_load_sphal_library(const char *filename, int flags);
 
+#ifndef __ANDROID__
+void *hook_dlopen(const char *filename, int flags);
+#endif
+
 FILE *hook_fopen(const char *filename, const char *mode);
 
 int hook_gsl_memory_alloc_pure_64(uint64_t size, uint32_t flags, void *memDesc);
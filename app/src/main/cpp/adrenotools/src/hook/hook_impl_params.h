@@ -4,7 +4,11 @@
 #pragma once
 
 #include <string>
+#include <android_linker_ns.h>
 #include <adrenotools/priv.h>
+#include <adrenotools/kgsl_context.h>
+#include "gpu_mapping_handle.h"
+#include "load_trace.h"
 
 /**
  * @brief Holds the parameters needed for all hooks
@@ -17,15 +21,22 @@ struct HookImplParams {
     std::string customDriverDir;
     std::string customDriverName;
     std::string fileRedirectDir;
-    adrenotools_gpu_mapping *nextGpuMapping;
+    GpuMappingHandle *mappingHandle; //!< Mappings waiting to be claimed by the GSL allocation hook and the objects backing them
+    adrenotools_kgsl_context *kgslContext; //!< The KGSL context shared with adrenotools, may be nullptr if the device couldn't be opened
+    LoadTrace *loadTrace; //!< Timings of each driver load stage, reported by adrenotools_get_load_report
+    android_namespace_t *hookNs; //!< The namespace libvulkan is loaded into, host loaders don't pass it along when loading drivers like Android's does
 
     HookImplParams(int featureFlags, const char *tmpLibDir, const char *hookLibDir, const char *customDriverDir,
-                  const char *customDriverName, const char *fileRedirectDir, adrenotools_gpu_mapping *nextGpuMapping)
+                  const char *customDriverName, const char *fileRedirectDir, GpuMappingHandle *mappingHandle,
+                  adrenotools_kgsl_context *kgslContext, LoadTrace *loadTrace, android_namespace_t *hookNs)
         : featureFlags(featureFlags),
           tmpLibDir(tmpLibDir ? tmpLibDir : ""),
           hookLibDir(hookLibDir),
           customDriverDir(customDriverDir ? customDriverDir : ""),
           customDriverName(customDriverName ? customDriverName : ""),
           fileRedirectDir(fileRedirectDir ? fileRedirectDir : ""),
-          nextGpuMapping(nextGpuMapping) {}
+          mappingHandle(mappingHandle),
+          kgslContext(kgslContext),
+          loadTrace(loadTrace),
+          hookNs(hookNs) {}
 };
@@ -10,6 +10,11 @@
 #include <linux/types.h>
 #include <linux/ioctl.h>
 
+/* Bionic's kernel headers define this away, glibc hosts only get it from the kernel's own (non-exported) compiler headers */
+#ifndef __user
+#define __user
+#endif
+
 /*
  * The KGSL version has proven not to be very useful in userspace if features
  * are cherry picked into other trees out of order so it is frozen as of 3.14.
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <adrenotools/kgsl_context.h>
+#include "kgsl.h"
+
+/**
+ * @brief RAII wrapper over a KGSL device fd and the ioctls adrenotools uses
+ * @note This is header-only as it's shared between adrenotools and hook_impl, which live in separate linker namespaces
+ */
+class KgslDevice {
+  private:
+    int fd{-1};
+    adrenotools_kgsl_ioctl_fn ioctlFn{}; //!< If set all ioctls are forwarded here instead of `fd`
+    void *ioctlUserData{};
+
+  public:
+    explicit KgslDevice(const char *devicePath = ADRENOTOOLS_KGSL_DEVICE_PATH)
+        : fd{open(devicePath ? devicePath : ADRENOTOOLS_KGSL_DEVICE_PATH, O_RDWR | O_CLOEXEC)} {}
+
+    KgslDevice(adrenotools_kgsl_ioctl_fn ioctlFn, void *ioctlUserData) : ioctlFn{ioctlFn}, ioctlUserData{ioctlUserData} {}
+
+    KgslDevice(const KgslDevice &) = delete;
+    KgslDevice &operator=(const KgslDevice &) = delete;
+
+    ~KgslDevice() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool IsValid() const {
+        return fd >= 0 || ioctlFn;
+    }
+
+    int Ioctl(unsigned long request, void *arg) const {
+        if (ioctlFn)
+            return ioctlFn(ioctlUserData, request, arg);
+
+        return ioctl(fd, request, arg);
+    }
+
+    /**
+     * @brief Imports a CPU mapped region of memory as a new GPU object
+     */
+    bool ImportUserMem(void *hostPtr, uint64_t size, uint64_t flags, uint32_t &id) const {
+        kgsl_gpuobj_import_useraddr addr{
+            .virtaddr = reinterpret_cast<uint64_t>(hostPtr),
+        };
+
+        kgsl_gpuobj_import userMemImport{};
+        userMemImport.priv = reinterpret_cast<uint64_t>(&addr);
+        userMemImport.priv_len = size;
+        userMemImport.flags = flags;
+        userMemImport.type = KGSL_USER_MEM_TYPE_ADDR;
+
+        if (Ioctl(IOCTL_KGSL_GPUOBJ_IMPORT, &userMemImport))
+            return false;
+
+        id = userMemImport.id;
+        return true;
+    }
+
+    /**
+     * @param mmapSize Set to the size that must be passed to mmap in order to map the object
+     */
+    bool AllocGpuobj(uint64_t size, uint64_t flags, uint32_t &id, uint64_t &mmapSize) const {
+        kgsl_gpuobj_alloc gpuobjAlloc{};
+        gpuobjAlloc.size = size;
+        gpuobjAlloc.flags = flags;
+
+        if (Ioctl(IOCTL_KGSL_GPUOBJ_ALLOC, &gpuobjAlloc))
+            return false;
+
+        id = gpuobjAlloc.id;
+        mmapSize = gpuobjAlloc.mmapsize;
+        return true;
+    }
+
+    bool GetGpuobjInfo(uint32_t id, kgsl_gpuobj_info &info) const {
+        info = {};
+        info.id = id;
+        return !Ioctl(IOCTL_KGSL_GPUOBJ_INFO, &info);
+    }
+
+    bool FreeGpuobj(uint32_t id) const {
+        kgsl_gpuobj_free args{};
+        args.id = id;
+
+        return !Ioctl(IOCTL_KGSL_GPUOBJ_FREE, &args);
+    }
+
+    /**
+     * @brief Looks up the object that backs the given GPU address
+     */
+    bool GetGpumemInfo(uint64_t gpuAddr, kgsl_gpumem_get_info &info) const {
+        info = {};
+        info.gpuaddr = static_cast<unsigned long>(gpuAddr);
+        return !Ioctl(IOCTL_KGSL_GPUMEM_GET_INFO, &info);
+    }
+
+    /**
+     * @brief Performs cache maintenance on a list of object ranges in a single call
+     */
+    bool SyncGpuobjs(const kgsl_gpuobj_sync_obj *objs, uint32_t count) const {
+        kgsl_gpuobj_sync args{
+            .objs = reinterpret_cast<uint64_t>(objs),
+            .obj_len = sizeof(kgsl_gpuobj_sync_obj),
+            .count = count,
+        };
+
+        return !Ioctl(IOCTL_KGSL_GPUOBJ_SYNC, &args);
+    }
+
+    /**
+     * @brief Performs cache maintenance on a list of entire objects in a single call, this predates IOCTL_KGSL_GPUOBJ_SYNC
+     * @param op A mask of KGSL_GPUMEM_CACHE_* values
+     */
+    bool SyncCacheBulk(uint32_t *ids, uint32_t count, uint32_t op) const {
+        kgsl_gpumem_sync_cache_bulk args{};
+        args.id_list = ids;
+        args.count = count;
+        args.op = op;
+
+        return !Ioctl(IOCTL_KGSL_GPUMEM_SYNC_CACHE_BULK, &args);
+    }
+
+    /**
+     * @brief Reserves a hardware counter in `groupId` and assigns `countable` to it
+     */
+    bool PerfcounterGet(uint32_t groupId, uint32_t countable) const {
+        kgsl_perfcounter_get args{};
+        args.groupid = groupId;
+        args.countable = countable;
+
+        return !Ioctl(IOCTL_KGSL_PERFCOUNTER_GET, &args);
+    }
+
+    bool PerfcounterPut(uint32_t groupId, uint32_t countable) const {
+        kgsl_perfcounter_put args{};
+        args.groupid = groupId;
+        args.countable = countable;
+
+        return !Ioctl(IOCTL_KGSL_PERFCOUNTER_PUT, &args);
+    }
+
+    /**
+     * @param maxCounters Set to the number of hardware counters in the group
+     */
+    bool PerfcounterQuery(uint32_t groupId, uint32_t &maxCounters) const {
+        kgsl_perfcounter_query args{};
+        args.groupid = groupId;
+
+        if (Ioctl(IOCTL_KGSL_PERFCOUNTER_QUERY, &args))
+            return false;
+
+        maxCounters = args.max_counters;
+        return true;
+    }
+
+    /**
+     * @brief Reads the current values of a list of previously reserved counters in a single call
+     */
+    bool PerfcounterRead(kgsl_perfcounter_read_group *reads, uint32_t count) const {
+        kgsl_perfcounter_read args{};
+        args.reads = reads;
+        args.count = count;
+
+        return !Ioctl(IOCTL_KGSL_PERFCOUNTER_READ, &args);
+    }
+
+    bool SetProperty(unsigned int type, void *value, unsigned int size) const {
+        kgsl_device_getproperty prop{
+            .type = type,
+            .value = value,
+            .sizebytes = size,
+        };
+
+        return !Ioctl(IOCTL_KGSL_SETPROPERTY, &prop);
+    }
+
+    /**
+     * @brief Reserves a range of GPU virtual address space with no physical backing
+     */
+    bool SparseVirtAlloc(uint64_t size, uint64_t pageSize, uint32_t &id, uint64_t &gpuAddr) const {
+        kgsl_sparse_virt_alloc args{};
+        args.size = size;
+        args.pagesize = pageSize;
+
+        if (Ioctl(IOCTL_KGSL_SPARSE_VIRT_ALLOC, &args))
+            return false;
+
+        id = args.id;
+        gpuAddr = args.gpuaddr;
+        return true;
+    }
+
+    bool SparseVirtFree(uint32_t id) const {
+        kgsl_sparse_virt_free args{
+            .id = id,
+        };
+
+        return !Ioctl(IOCTL_KGSL_SPARSE_VIRT_FREE, &args);
+    }
+
+    /**
+     * @brief Allocates physical memory that can be bound into sparse virtual ranges, it has no GPU address of its own
+     */
+    bool SparsePhysAlloc(uint64_t size, uint64_t pageSize, uint32_t &id) const {
+        kgsl_sparse_phys_alloc args{};
+        args.size = size;
+        args.pagesize = pageSize;
+
+        if (Ioctl(IOCTL_KGSL_SPARSE_PHYS_ALLOC, &args))
+            return false;
+
+        id = args.id;
+        return true;
+    }
+
+    bool SparsePhysFree(uint32_t id) const {
+        kgsl_sparse_phys_free args{
+            .id = id,
+        };
+
+        return !Ioctl(IOCTL_KGSL_SPARSE_PHYS_FREE, &args);
+    }
+
+    /**
+     * @brief Binds or unbinds a list of ranges of the sparse virtual object `virtId` in a single call
+     */
+    bool SparseBind(uint32_t virtId, const kgsl_sparse_binding_object *bindings, uint32_t count) const {
+        kgsl_sparse_bind args{
+            .list = reinterpret_cast<uint64_t>(bindings),
+            .id = virtId,
+            .size = sizeof(kgsl_sparse_binding_object),
+            .count = count,
+        };
+
+        return !Ioctl(IOCTL_KGSL_SPARSE_BIND, &args);
+    }
+
+    /**
+     * @brief Maps the GPU object at `gpuAddr` into the CPU address space
+     * @return The mapped address or nullptr on failure
+     */
+    void *Map(void *hostPtr, uint64_t size, uint64_t gpuAddr, int mapFlags) const {
+        if (fd < 0)
+            return nullptr;
+
+        void *ptr{mmap(hostPtr, size, PROT_READ | PROT_WRITE, MAP_SHARED | mapFlags, fd, static_cast<off_t>(gpuAddr))};
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+};
+
+struct adrenotools_kgsl_context : KgslDevice {
+    using KgslDevice::KgslDevice;
+};
@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief A fixed-size record of timed spans covering the stages of loading a driver, spans beyond the capacity are dropped
+ * @note This is header-only as it's shared between adrenotools and hook_impl, which live in separate linker namespaces
+ */
+class LoadTrace {
+  public:
+    static constexpr uint32_t MaxSpans{64};
+    static constexpr uint32_t InvalidSpan{UINT32_MAX};
+
+    struct Span {
+        char name[48];
+        uint64_t startNs;
+        std::atomic<uint64_t> endNs; //!< Zero while the span is still open
+        uint32_t tid;
+    };
+
+    /**
+     * @brief Ends a span when it goes out of scope
+     */
+    class ScopedSpan {
+      private:
+        LoadTrace *trace;
+        uint32_t index;
+
+      public:
+        /**
+         * @param trace The trace to record into, may be nullptr in which case nothing is recorded
+         */
+        ScopedSpan(LoadTrace *trace, const char *name) : trace{trace}, index{trace ? trace->Begin(name) : InvalidSpan} {}
+
+        ScopedSpan(const ScopedSpan &) = delete;
+        ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+        ~ScopedSpan() {
+            if (trace)
+                trace->End(index);
+        }
+    };
+
+  private:
+    std::array<Span, MaxSpans> spans{};
+    std::atomic<uint32_t> reserved{}; //!< The number of span slots that have been handed out, this may exceed MaxSpans
+    std::atomic<uint32_t> published{}; //!< The number of leading spans that have been fully initialised by Begin
+
+  public:
+    static uint64_t Now() {
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    }
+
+    /**
+     * @return The index of the new span to pass to End, or InvalidSpan if the trace is full
+     */
+    uint32_t Begin(const char *name) {
+        uint32_t index{reserved.fetch_add(1, std::memory_order_relaxed)};
+        if (index >= MaxSpans)
+            return InvalidSpan;
+
+        auto &span{spans[index]};
+        strncpy(span.name, name, sizeof(span.name) - 1);
+        span.tid = static_cast<uint32_t>(gettid());
+        span.startNs = Now();
+
+        // Publish in order so readers never see a partially written span
+        uint32_t expected{index};
+        while (!published.compare_exchange_weak(expected, index + 1, std::memory_order_release, std::memory_order_relaxed))
+            expected = index;
+
+        return index;
+    }
+
+    void End(uint32_t index) {
+        if (index < MaxSpans)
+            spans[index].endNs.store(Now(), std::memory_order_release);
+    }
+
+    uint32_t GetSpanCount() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+    const Span &GetSpan(uint32_t index) const {
+        return spans[index];
+    }
+
+    /**
+     * @return The number of spans that couldn't be recorded as the trace was full
+     */
+    uint32_t GetDroppedCount() const {
+        uint32_t count{reserved.load(std::memory_order_relaxed)};
+        return count > MaxSpans ? count - MaxSpans : 0;
+    }
+};
@@ -1,9 +1,16 @@
 #include "hook_impl.h"
 
+#ifdef __ANDROID__
 __attribute__((visibility("default"))) void *android_dlopen_ext(const char *filename, int flags, const android_dlextinfo *extinfo) {
 	return hook_android_dlopen_ext(filename, flags, extinfo);
 }
+#else
+// Host Vulkan loaders open drivers with plain dlopen
+__attribute__((visibility("default"))) void *dlopen(const char *filename, int flags) {
+	return hook_dlopen(filename, flags);
+}
+#endif
 
 __attribute__((visibility("default"))) void *android_load_sphal_library(const char *filename, int flags) {
 	return hook_android_load_sphal_library(filename, flags);
-}
\ No newline at end of file
+}
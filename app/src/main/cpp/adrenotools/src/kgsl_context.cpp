@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include "hook/kgsl_device.h"
+#include <adrenotools/kgsl_context.h>
+
+static std::atomic<adrenotools_kgsl_context *> overrideContext; //!< The context set by adrenotools_kgsl_context_set_default, if any
+static std::atomic<adrenotools_kgsl_context *> defaultContext; //!< The lazily opened device context, only set once opening succeeded
+static std::mutex defaultContextMutex; //!< Serialises opening defaultContext
+
+adrenotools_kgsl_context *adrenotools_kgsl_context_open(const char *devicePath) {
+    auto ctx{new (std::nothrow) adrenotools_kgsl_context{devicePath}};
+    if (ctx && !ctx->IsValid()) {
+        delete ctx;
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+adrenotools_kgsl_context *adrenotools_kgsl_context_open_fake(adrenotools_kgsl_ioctl_fn ioctlFn, void *userData) {
+    if (!ioctlFn)
+        return nullptr;
+
+    return new (std::nothrow) adrenotools_kgsl_context{ioctlFn, userData};
+}
+
+void adrenotools_kgsl_context_close(adrenotools_kgsl_context *ctx) {
+    delete ctx;
+}
+
+int adrenotools_kgsl_context_ioctl(adrenotools_kgsl_context *ctx, unsigned long request, void *arg) {
+    return ctx->Ioctl(request, arg);
+}
+
+adrenotools_kgsl_context *adrenotools_kgsl_context_get_default() {
+    if (auto ctx{overrideContext.load(std::memory_order_acquire)})
+        return ctx;
+
+    if (auto ctx{defaultContext.load(std::memory_order_acquire)})
+        return ctx;
+
+    // Opened once and kept for the lifetime of the process, the hooks may hold onto this long after any API call. Failures aren't cached so a later call can retry
+    std::scoped_lock lock{defaultContextMutex};
+    auto ctx{defaultContext.load(std::memory_order_relaxed)};
+    if (!ctx) {
+        ctx = adrenotools_kgsl_context_open(ADRENOTOOLS_KGSL_DEVICE_PATH);
+        defaultContext.store(ctx, std::memory_order_release);
+    }
+
+    return ctx;
+}
+
+void adrenotools_kgsl_context_set_default(adrenotools_kgsl_context *ctx) {
+    overrideContext.store(ctx, std::memory_order_release);
+}
@@ -0,0 +1,694 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <android/api-level.h>
+#include <adrenotools/package.h>
+
+static constexpr size_t BufferSize{64 * 1024}; //!< The size of the buffers compressed and decompressed data is streamed through, this bounds the memory used to install a package of any size
+static constexpr size_t MaxMetaSize{64 * 1024}; //!< meta.json is read into memory to be parsed, anything larger than this is rejected
+static constexpr size_t MaxJsonDepth{32};
+
+static constexpr uint32_t EndOfCentralDirectorySignature{0x06054B50};
+static constexpr uint32_t CentralDirectoryHeaderSignature{0x02014B50};
+static constexpr uint32_t LocalHeaderSignature{0x04034B50};
+static constexpr size_t EndOfCentralDirectorySize{22};
+static constexpr size_t CentralDirectoryHeaderSize{46};
+static constexpr size_t LocalHeaderSize{30};
+static constexpr size_t MaxCommentSize{0xFFFF};
+
+static constexpr uint16_t MethodStore{0};
+static constexpr uint16_t MethodDeflate{8};
+static constexpr uint16_t FlagEncrypted{1 << 0};
+
+static constexpr const char *TempSuffix{".adpkg-tmp"}; //!< Appended to files while they're being extracted, so a partial install never replaces a working driver
+static constexpr const char *BackupSuffix{".adpkg-old"}; //!< Appended to files replaced by the install until it succeeds, so they can be restored if a later file fails to be renamed into place
+
+namespace {
+    /**
+     * @brief A file in the package, as described by the zip's central directory
+     */
+    struct ZipEntry {
+        std::string name;
+        uint16_t flags;
+        uint16_t method;
+        uint32_t crc;
+        uint32_t compressedSize;
+        uint32_t uncompressedSize;
+        uint32_t localHeaderOffset;
+    };
+
+    /**
+     * @brief The fields of meta.json adrenotools needs, see the schema in tools/ADPKG.md
+     */
+    struct PackageMeta {
+        std::map<std::string, std::string, std::less<>> strings; //!< Top-level string fields
+        std::map<std::string, double, std::less<>> numbers; //!< Top-level number fields
+    };
+
+    /**
+     * @brief A minimal JSON parser for meta.json, the whole document is validated but only top-level string and number fields are kept
+     */
+    class MetaParser {
+      private:
+        std::string_view json;
+        size_t pos{};
+
+        void SkipWhitespace() {
+            while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\n' || json[pos] == '\r'))
+                pos++;
+        }
+
+        bool Consume(char c) {
+            SkipWhitespace();
+            if (pos >= json.size() || json[pos] != c)
+                return false;
+
+            pos++;
+            return true;
+        }
+
+        char Peek() {
+            SkipWhitespace();
+            return pos < json.size() ? json[pos] : '\0';
+        }
+
+        bool ParseHex(uint32_t &value) {
+            if (json.size() - pos < 4)
+                return false;
+
+            value = 0;
+            for (size_t i{}; i < 4; i++) {
+                char c{json[pos++]};
+                value <<= 4;
+                if (c >= '0' && c <= '9')
+                    value |= static_cast<uint32_t>(c - '0');
+                else if (c >= 'a' && c <= 'f')
+                    value |= static_cast<uint32_t>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F')
+                    value |= static_cast<uint32_t>(c - 'A' + 10);
+                else
+                    return false;
+            }
+
+            return true;
+        }
+
+        static void AppendUtf8(std::string &out, uint32_t codepoint) {
+            if (codepoint < 0x80) {
+                out.push_back(static_cast<char>(codepoint));
+            } else if (codepoint < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+                out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+            } else if (codepoint < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+            }
+        }
+
+        bool ParseString(std::string &out) {
+            if (!Consume('"'))
+                return false;
+
+            out.clear();
+            while (pos < json.size()) {
+                char c{json[pos++]};
+                if (c == '"')
+                    return true;
+
+                if (static_cast<unsigned char>(c) < 0x20)
+                    return false;
+
+                if (c != '\\') {
+                    out.push_back(c);
+                    continue;
+                }
+
+                if (pos >= json.size())
+                    return false;
+
+                switch (char escape{json[pos++]}) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        out.push_back(escape);
+                        break;
+                    case 'b':
+                        out.push_back('\b');
+                        break;
+                    case 'f':
+                        out.push_back('\f');
+                        break;
+                    case 'n':
+                        out.push_back('\n');
+                        break;
+                    case 'r':
+                        out.push_back('\r');
+                        break;
+                    case 't':
+                        out.push_back('\t');
+                        break;
+                    case 'u': {
+                        uint32_t codepoint{};
+                        if (!ParseHex(codepoint))
+                            return false;
+
+                        // Characters outside the BMP are encoded as a surrogate pair
+                        if (codepoint >= 0xD800 && codepoint < 0xDC00) {
+                            uint32_t low{};
+                            if (json.substr(pos, 2) != "\\u")
+                                return false;
+
+                            pos += 2;
+                            if (!ParseHex(low) || low < 0xDC00 || low >= 0xE000)
+                                return false;
+
+                            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        } else if (codepoint >= 0xDC00 && codepoint < 0xE000) {
+                            return false;
+                        }
+
+                        AppendUtf8(out, codepoint);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            return false;
+        }
+
+        bool ParseNumber(double &out) {
+            SkipWhitespace();
+            size_t start{pos};
+            auto digits{[&]() {
+                size_t digitsStart{pos};
+                while (pos < json.size() && json[pos] >= '0' && json[pos] <= '9')
+                    pos++;
+
+                return pos > digitsStart;
+            }};
+
+            if (pos < json.size() && json[pos] == '-')
+                pos++;
+
+            // Leading zeros aren't allowed
+            if (pos < json.size() && json[pos] == '0')
+                pos++;
+            else if (!digits())
+                return false;
+
+            if (pos < json.size() && json[pos] == '.') {
+                pos++;
+                if (!digits())
+                    return false;
+            }
+
+            if (pos < json.size() && (json[pos] == 'e' || json[pos] == 'E')) {
+                pos++;
+                if (pos < json.size() && (json[pos] == '+' || json[pos] == '-'))
+                    pos++;
+
+                if (!digits())
+                    return false;
+            }
+
+            out = strtod(std::string{json.substr(start, pos - start)}.c_str(), nullptr);
+            return true;
+        }
+
+        bool SkipValue(size_t depth) {
+            if (depth > MaxJsonDepth)
+                return false;
+
+            std::string string;
+            double number{};
+            switch (Peek()) {
+                case '"':
+                    return ParseString(string);
+                case '{':
+                    pos++;
+                    if (Consume('}'))
+                        return true;
+
+                    do {
+                        if (!ParseString(string) || !Consume(':') || !SkipValue(depth + 1))
+                            return false;
+                    } while (Consume(','));
+
+                    return Consume('}');
+                case '[':
+                    pos++;
+                    if (Consume(']'))
+                        return true;
+
+                    do {
+                        if (!SkipValue(depth + 1))
+                            return false;
+                    } while (Consume(','));
+
+                    return Consume(']');
+                case 't':
+                    return ParseLiteral("true");
+                case 'f':
+                    return ParseLiteral("false");
+                case 'n':
+                    return ParseLiteral("null");
+                default:
+                    return ParseNumber(number);
+            }
+        }
+
+        bool ParseLiteral(std::string_view literal) {
+            if (json.substr(pos, literal.size()) != literal)
+                return false;
+
+            pos += literal.size();
+            return true;
+        }
+
+      public:
+        explicit MetaParser(std::string_view json) : json{json} {}
+
+        bool Parse(PackageMeta &meta) {
+            if (!Consume('{'))
+                return false;
+
+            if (!Consume('}')) {
+                do {
+                    std::string key;
+                    if (!ParseString(key) || !Consume(':'))
+                        return false;
+
+                    if (Peek() == '"') {
+                        std::string value;
+                        if (!ParseString(value))
+                            return false;
+
+                        meta.strings.insert_or_assign(std::move(key), std::move(value));
+                    } else if (Peek() == '-' || (Peek() >= '0' && Peek() <= '9')) {
+                        double value{};
+                        if (!ParseNumber(value))
+                            return false;
+
+                        meta.numbers.insert_or_assign(std::move(key), value);
+                    } else if (!SkipValue(1)) {
+                        return false;
+                    }
+                } while (Consume(','));
+
+                if (!Consume('}'))
+                    return false;
+            }
+
+            SkipWhitespace();
+            return pos == json.size();
+        }
+    };
+}
+
+template<typename T>
+static T ReadLe(const uint8_t *data) {
+    T value{};
+    memcpy(&value, data, sizeof(T)); // Both arm64 and x86_64 hosts are little endian like zip
+    return value;
+}
+
+static bool ReadFully(int fd, void *buffer, size_t size, off_t offset) {
+    auto bytes{static_cast<uint8_t *>(buffer)};
+    while (size) {
+        auto bytesRead{pread(fd, bytes, size, offset)};
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+
+        bytes += bytesRead;
+        size -= static_cast<size_t>(bytesRead);
+        offset += bytesRead;
+    }
+
+    return true;
+}
+
+static bool WriteFully(int fd, const uint8_t *data, size_t size) {
+    while (size) {
+        auto written{write(fd, data, size)};
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Reads the zip's central directory, only the entry headers are read and never the file data
+ */
+static bool ReadZipEntries(int fd, std::vector<ZipEntry> &entries) {
+    struct stat zipStat{};
+    if (fstat(fd, &zipStat) || static_cast<size_t>(zipStat.st_size) < EndOfCentralDirectorySize)
+        return false;
+
+    // The end of central directory record is followed by a comment of up to 64KiB, so search backwards for it through the tail of the file
+    auto zipSize{static_cast<size_t>(zipStat.st_size)};
+    size_t tailSize{std::min(zipSize, EndOfCentralDirectorySize + MaxCommentSize)};
+    std::vector<uint8_t> tail(tailSize);
+    if (!ReadFully(fd, tail.data(), tailSize, static_cast<off_t>(zipSize - tailSize)))
+        return false;
+
+    const uint8_t *eocd{};
+    for (size_t i{tailSize - EndOfCentralDirectorySize + 1}; i-- > 0;) {
+        if (ReadLe<uint32_t>(&tail[i]) == EndOfCentralDirectorySignature && i + EndOfCentralDirectorySize + ReadLe<uint16_t>(&tail[i + 20]) == tailSize) {
+            eocd = &tail[i];
+            break;
+        }
+    }
+
+    if (!eocd)
+        return false;
+
+    // Multi-disk archives aren't supported, and 0xFFFF/0xFFFFFFFF mean the real values are in a zip64 record, which also isn't
+    auto entryCount{ReadLe<uint16_t>(eocd + 10)};
+    auto directorySize{ReadLe<uint32_t>(eocd + 12)};
+    auto directoryOffset{ReadLe<uint32_t>(eocd + 16)};
+    if (ReadLe<uint16_t>(eocd + 4) || ReadLe<uint16_t>(eocd + 6) || entryCount != ReadLe<uint16_t>(eocd + 8) || entryCount == 0xFFFF || directoryOffset == 0xFFFFFFFF)
+        return false;
+
+    if (static_cast<uint64_t>(directoryOffset) + directorySize > zipSize)
+        return false;
+
+    off_t offset{directoryOffset};
+    entries.reserve(entryCount);
+    std::set<std::string, std::less<>> names; //!< Duplicate names are rejected as they'd be extracted to the same file
+    for (uint16_t i{}; i < entryCount; i++) {
+        uint8_t header[CentralDirectoryHeaderSize];
+        if (!ReadFully(fd, header, sizeof(header), offset) || ReadLe<uint32_t>(header) != CentralDirectoryHeaderSignature)
+            return false;
+
+        auto nameLength{ReadLe<uint16_t>(header + 28)};
+        ZipEntry entry{
+            .name = std::string(nameLength, '\0'),
+            .flags = ReadLe<uint16_t>(header + 8),
+            .method = ReadLe<uint16_t>(header + 10),
+            .crc = ReadLe<uint32_t>(header + 16),
+            .compressedSize = ReadLe<uint32_t>(header + 20),
+            .uncompressedSize = ReadLe<uint32_t>(header + 24),
+            .localHeaderOffset = ReadLe<uint32_t>(header + 42),
+        };
+
+        if (!ReadFully(fd, entry.name.data(), nameLength, offset + static_cast<off_t>(CentralDirectoryHeaderSize)))
+            return false;
+
+        if (!names.insert(entry.name).second)
+            return false;
+
+        offset += static_cast<off_t>(CentralDirectoryHeaderSize + nameLength + ReadLe<uint16_t>(header + 30) + ReadLe<uint16_t>(header + 32));
+        entries.push_back(std::move(entry));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Streams the decompressed contents of `entry` to `sink` in chunks of at most BufferSize bytes, verifying them against the entry's size and CRC
+ * @param sink Called with each chunk of data, returns false to abort
+ */
+template<typename Sink>
+static adrenotools_package_status ExtractEntry(int fd, const ZipEntry &entry, std::vector<uint8_t> &inBuffer, std::vector<uint8_t> &outBuffer, Sink sink) {
+    if (entry.flags & FlagEncrypted || (entry.method != MethodStore && entry.method != MethodDeflate))
+        return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+    // The local header's name and extra field lengths can differ from the central directory's, so the data offset comes from it
+    uint8_t localHeader[LocalHeaderSize];
+    if (!ReadFully(fd, localHeader, sizeof(localHeader), entry.localHeaderOffset) || ReadLe<uint32_t>(localHeader) != LocalHeaderSignature)
+        return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+    off_t offset{static_cast<off_t>(entry.localHeaderOffset + LocalHeaderSize + ReadLe<uint16_t>(localHeader + 26) + ReadLe<uint16_t>(localHeader + 28))};
+    uint32_t remaining{entry.compressedSize};
+    uLong crc{crc32(0, nullptr, 0)};
+    uint64_t totalSize{};
+
+    if (entry.method == MethodStore) {
+        if (entry.compressedSize != entry.uncompressedSize)
+            return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+        while (remaining) {
+            size_t chunkSize{std::min<size_t>(remaining, inBuffer.size())};
+            if (!ReadFully(fd, inBuffer.data(), chunkSize, offset))
+                return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+            crc = crc32(crc, inBuffer.data(), static_cast<uInt>(chunkSize));
+            if (!sink(inBuffer.data(), chunkSize))
+                return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+            offset += static_cast<off_t>(chunkSize);
+            remaining -= static_cast<uint32_t>(chunkSize);
+            totalSize += chunkSize;
+        }
+    } else {
+        // Zip stores raw deflate streams without a zlib header
+        z_stream stream{};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+            return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+        auto status{[&]() {
+            int result{Z_OK};
+            while (result != Z_STREAM_END) {
+                if (!stream.avail_in) {
+                    if (!remaining)
+                        return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE; // The stream is truncated
+
+                    size_t chunkSize{std::min<size_t>(remaining, inBuffer.size())};
+                    if (!ReadFully(fd, inBuffer.data(), chunkSize, offset))
+                        return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+                    offset += static_cast<off_t>(chunkSize);
+                    remaining -= static_cast<uint32_t>(chunkSize);
+                    stream.next_in = inBuffer.data();
+                    stream.avail_in = static_cast<uInt>(chunkSize);
+                }
+
+                stream.next_out = outBuffer.data();
+                stream.avail_out = static_cast<uInt>(outBuffer.size());
+                result = inflate(&stream, Z_NO_FLUSH);
+                if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                    return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+                size_t produced{outBuffer.size() - stream.avail_out};
+                totalSize += produced;
+                if (totalSize > entry.uncompressedSize)
+                    return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+                crc = crc32(crc, outBuffer.data(), static_cast<uInt>(produced));
+                if (produced && !sink(outBuffer.data(), produced))
+                    return ADRENOTOOLS_PACKAGE_ERROR_IO;
+            }
+
+            return ADRENOTOOLS_PACKAGE_SUCCESS;
+        }()};
+
+        inflateEnd(&stream);
+        if (status != ADRENOTOOLS_PACKAGE_SUCCESS)
+            return status;
+    }
+
+    if (totalSize != entry.uncompressedSize || crc != entry.crc)
+        return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+    return ADRENOTOOLS_PACKAGE_SUCCESS;
+}
+
+/**
+ * @return If `name` is a file at the root of the package, rather than a directory or something in one
+ */
+static bool IsRootFile(std::string_view name) {
+    return !name.empty() && name != "." && name != ".." && name.find('/') == std::string_view::npos && name.find('\\') == std::string_view::npos;
+}
+
+/**
+ * @brief Checks meta.json's fields, all string fields are checked to be reasonable (e.g. no embedded nulls) even though only some are used
+ */
+static bool ValidateMeta(const PackageMeta &meta) {
+    auto minApi{meta.numbers.find("minApi")};
+    if (minApi == meta.numbers.end() || minApi->second < 0 || minApi->second > UINT32_MAX || std::floor(minApi->second) != minApi->second)
+        return false;
+
+    auto libraryName{meta.strings.find("libraryName")};
+    if (libraryName == meta.strings.end() || !IsRootFile(libraryName->second) || libraryName->second.size() >= sizeof(adrenotools_package::custom_driver_name))
+        return false;
+
+    for (const auto &[key, value] : meta.strings)
+        if (value.find('\0') != std::string::npos)
+            return false;
+
+    return true;
+}
+
+enum adrenotools_package_status adrenotools_install_package(const char *packagePath, const char *driverDir, struct adrenotools_package *package) {
+    std::string dir{driverDir};
+    if (dir.empty())
+        return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+    if (dir.back() != '/')
+        dir.push_back('/');
+
+    if (dir.size() >= sizeof(adrenotools_package::custom_driver_dir))
+        return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+    int zipFd{open(packagePath, O_RDONLY | O_CLOEXEC)};
+    if (zipFd == -1)
+        return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+    /**
+     * @brief A file that has been renamed into place
+     */
+    struct InstalledFile {
+        std::string name;
+        bool replaced; //!< If a previous version of the file was moved aside to `name + BackupSuffix`
+    };
+
+    std::vector<std::string> tempFiles; //!< Extracted files that haven't been renamed into place yet, these are removed if the install fails
+    std::vector<InstalledFile> installedFiles; //!< Files that have been renamed into place, these are rolled back if the install fails
+    int dirFd{-1};
+
+    auto status{[&]() {
+        std::vector<ZipEntry> entries;
+        if (!ReadZipEntries(zipFd, entries))
+            return ADRENOTOOLS_PACKAGE_ERROR_INVALID_ARCHIVE;
+
+        std::vector<uint8_t> inBuffer(BufferSize), outBuffer(BufferSize);
+
+        // meta.json is validated before anything is written, so an unusable package never touches the driver directory
+        auto metaEntry{std::find_if(entries.begin(), entries.end(), [](const ZipEntry &entry) { return entry.name == "meta.json"; })};
+        if (metaEntry == entries.end() || metaEntry->uncompressedSize > MaxMetaSize)
+            return ADRENOTOOLS_PACKAGE_ERROR_INVALID_META;
+
+        std::string metaJson;
+        metaJson.reserve(metaEntry->uncompressedSize);
+        auto metaStatus{ExtractEntry(zipFd, *metaEntry, inBuffer, outBuffer, [&](const uint8_t *data, size_t size) {
+            metaJson.append(reinterpret_cast<const char *>(data), size);
+            return true;
+        })};
+        if (metaStatus != ADRENOTOOLS_PACKAGE_SUCCESS)
+            return metaStatus;
+
+        PackageMeta meta;
+        if (!MetaParser{metaJson}.Parse(meta) || !ValidateMeta(meta))
+            return ADRENOTOOLS_PACKAGE_ERROR_INVALID_META;
+
+        auto minApi{static_cast<uint32_t>(meta.numbers["minApi"])};
+        const auto &libraryName{meta.strings["libraryName"]};
+        if (minApi > static_cast<uint32_t>(android_get_device_api_level()))
+            return ADRENOTOOLS_PACKAGE_ERROR_UNSUPPORTED_API;
+
+        if (std::none_of(entries.begin(), entries.end(), [&](const ZipEntry &entry) { return entry.name == libraryName; }))
+            return ADRENOTOOLS_PACKAGE_ERROR_MISSING_LIBRARY;
+
+        if (mkdir(dir.c_str(), S_IRWXU) && errno != EEXIST)
+            return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+        dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd == -1)
+            return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+        for (const auto &entry : entries) {
+            if (!IsRootFile(entry.name))
+                continue;
+
+            auto tempName{entry.name + TempSuffix};
+            int fileFd{openat(dirFd, tempName.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR)};
+            if (fileFd == -1)
+                return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+            tempFiles.push_back(std::move(tempName));
+            auto entryStatus{ExtractEntry(zipFd, entry, inBuffer, outBuffer, [&](const uint8_t *data, size_t size) {
+                return WriteFully(fileFd, data, size);
+            })};
+
+            close(fileFd);
+            if (entryStatus != ADRENOTOOLS_PACKAGE_SUCCESS)
+                return entryStatus;
+        }
+
+        // Previous versions are moved aside rather than overwritten, so they can be restored if any rename fails
+        while (!tempFiles.empty()) {
+            const auto &tempName{tempFiles.back()};
+            auto name{tempName.substr(0, tempName.size() - strlen(TempSuffix))};
+            auto backupName{name + BackupSuffix};
+            bool replaced{!renameat(dirFd, name.c_str(), dirFd, backupName.c_str())};
+            if (!replaced && errno != ENOENT)
+                return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+            if (renameat(dirFd, tempName.c_str(), dirFd, name.c_str())) {
+                if (replaced)
+                    renameat(dirFd, backupName.c_str(), dirFd, name.c_str());
+                return ADRENOTOOLS_PACKAGE_ERROR_IO;
+            }
+
+            installedFiles.push_back({.name = std::move(name), .replaced = replaced});
+            tempFiles.pop_back();
+        }
+
+        // A single sync once everything is in place makes both the extracted files and the renames durable
+        if (syncfs(dirFd))
+            return ADRENOTOOLS_PACKAGE_ERROR_IO;
+
+        if (package) {
+            *package = {};
+            snprintf(package->custom_driver_dir, sizeof(package->custom_driver_dir), "%s", dir.c_str());
+            snprintf(package->custom_driver_name, sizeof(package->custom_driver_name), "%s", libraryName.c_str());
+            snprintf(package->name, sizeof(package->name), "%s", meta.strings["name"].c_str());
+            snprintf(package->driver_version, sizeof(package->driver_version), "%s", meta.strings["driverVersion"].c_str());
+            package->min_api = minApi;
+        }
+
+        return ADRENOTOOLS_PACKAGE_SUCCESS;
+    }()};
+
+    for (const auto &tempName : tempFiles)
+        unlinkat(dirFd, tempName.c_str(), 0);
+
+    for (auto file{installedFiles.rbegin()}; file != installedFiles.rend(); file++) {
+        auto backupName{file->name + BackupSuffix};
+        if (status == ADRENOTOOLS_PACKAGE_SUCCESS) {
+            if (file->replaced)
+                unlinkat(dirFd, backupName.c_str(), 0);
+        } else if (file->replaced) {
+            renameat(dirFd, backupName.c_str(), dirFd, file->name.c_str());
+        } else {
+            unlinkat(dirFd, file->name.c_str(), 0);
+        }
+    }
+
+    if (dirFd != -1)
+        close(dirFd);
+
+    close(zipFd);
+    return status;
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "hook/kgsl_device.h"
+#include <adrenotools/perfcounter.h>
+
+struct adrenotools_perfcounter_sampler {
+    adrenotools_kgsl_context *kgslCtx;
+    std::vector<kgsl_perfcounter_read_group> reads{}; //!< Reused for every sample so the sampling thread never allocates
+    uint32_t intervalUs;
+
+    /**
+     * @brief A single-producer single-consumer ring of samples, each sample is a timestamp followed by one value per counter
+     */
+    std::unique_ptr<uint64_t[]> ring{};
+    uint64_t mask{};
+    alignas(64) std::atomic<uint64_t> writePos{};
+    alignas(64) std::atomic<uint64_t> readPos{};
+    std::atomic<uint64_t> dropped{};
+
+    int wakeFd{-1}; //!< eventfd used to interrupt the sampling thread's sleep when stopping
+    std::atomic<bool> stopping{};
+    std::thread thread{};
+
+    size_t SampleStride() const {
+        return reads.size() + 1;
+    }
+
+    bool Sample() {
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if (!kgslCtx->PerfcounterRead(reads.data(), static_cast<uint32_t>(reads.size()))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint64_t pos{writePos.load(std::memory_order_relaxed)};
+        if (pos - readPos.load(std::memory_order_acquire) > mask) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        auto sample{&ring[(pos & mask) * SampleStride()]};
+        sample[0] = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+        for (size_t i{}; i < reads.size(); i++)
+            sample[i + 1] = reads[i].value;
+
+        writePos.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Run() {
+        pollfd pollFd{
+            .fd = wakeFd,
+            .events = POLLIN,
+            .revents = 0,
+        };
+
+        timespec interval{
+            .tv_sec = intervalUs / 1000000,
+            .tv_nsec = static_cast<long>(intervalUs % 1000000) * 1000,
+        };
+
+        while (!stopping.load(std::memory_order_acquire)) {
+            Sample();
+            ppoll(&pollFd, 1, &interval, nullptr);
+        }
+    }
+
+    void ReleaseCounters(size_t count) {
+        for (size_t i{}; i < count; i++)
+            kgslCtx->PerfcounterPut(reads[i].groupid, reads[i].countable);
+    }
+};
+
+bool adrenotools_perfcounter_query_group(adrenotools_kgsl_context *ctx, uint32_t group, uint32_t *maxCounters) {
+    if (!ctx)
+        ctx = adrenotools_kgsl_context_get_default();
+
+    return ctx && ctx->PerfcounterQuery(group, *maxCounters);
+}
+
+adrenotools_perfcounter_sampler *adrenotools_perfcounter_sampler_create(adrenotools_kgsl_context *ctx, const adrenotools_perfcounter_sampler_config *config) {
+    if (!ctx)
+        ctx = adrenotools_kgsl_context_get_default();
+
+    if (!ctx || !config->counter_count)
+        return nullptr;
+
+    std::unique_ptr<adrenotools_perfcounter_sampler> sampler{new (std::nothrow) adrenotools_perfcounter_sampler{
+        .kgslCtx = ctx,
+        .intervalUs = config->interval_us,
+    }};
+    if (!sampler)
+        return nullptr;
+
+    // Allocation and thread creation failures are reported as exceptions, which must not cross the C ABI
+    try {
+        sampler->reads.reserve(config->counter_count);
+    } catch (const std::bad_alloc &) {
+        return nullptr;
+    }
+
+    for (uint32_t i{}; i < config->counter_count; i++) {
+        const auto &counter{config->counters[i]};
+        if (!ctx->PerfcounterGet(counter.group, counter.countable)) {
+            sampler->ReleaseCounters(sampler->reads.size());
+            return nullptr;
+        }
+
+        sampler->reads.push_back({
+            .groupid = counter.group,
+            .countable = counter.countable,
+            .value = 0,
+        });
+    }
+
+    uint64_t capacity{std::max<uint64_t>(config->capacity, 2)};
+    capacity = 1ULL << (64 - __builtin_clzll(capacity - 1));
+    sampler->ring.reset(new (std::nothrow) uint64_t[capacity * sampler->SampleStride()]{});
+    if (!sampler->ring) {
+        sampler->ReleaseCounters(sampler->reads.size());
+        return nullptr;
+    }
+
+    sampler->mask = capacity - 1;
+
+    if (config->interval_us) {
+        sampler->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (sampler->wakeFd < 0) {
+            sampler->ReleaseCounters(sampler->reads.size());
+            return nullptr;
+        }
+
+        try {
+            sampler->thread = std::thread{&adrenotools_perfcounter_sampler::Run, sampler.get()};
+        } catch (const std::system_error &) {
+            close(sampler->wakeFd);
+            sampler->ReleaseCounters(sampler->reads.size());
+            return nullptr;
+        }
+    }
+
+    return sampler.release();
+}
+
+void adrenotools_perfcounter_sampler_destroy(adrenotools_perfcounter_sampler *sampler) {
+    if (sampler->thread.joinable()) {
+        sampler->stopping.store(true, std::memory_order_release);
+        uint64_t one{1};
+        (void)!write(sampler->wakeFd, &one, sizeof(one));
+        sampler->thread.join();
+    }
+
+    if (sampler->wakeFd >= 0)
+        close(sampler->wakeFd);
+
+    sampler->ReleaseCounters(sampler->reads.size());
+    delete sampler;
+}
+
+bool adrenotools_perfcounter_sampler_sample(adrenotools_perfcounter_sampler *sampler) {
+    // The ring only supports a single producer
+    if (sampler->thread.joinable())
+        return false;
+
+    return sampler->Sample();
+}
+
+uint32_t adrenotools_perfcounter_sampler_drain(adrenotools_perfcounter_sampler *sampler, uint64_t *timestamps, uint64_t *values, uint32_t maxSamples) {
+    uint64_t pos{sampler->readPos.load(std::memory_order_relaxed)};
+    uint64_t available{sampler->writePos.load(std::memory_order_acquire) - pos};
+    auto count{static_cast<uint32_t>(std::min<uint64_t>(available, maxSamples))};
+
+    size_t counterCount{sampler->reads.size()};
+    for (uint32_t i{}; i < count; i++) {
+        auto sample{&sampler->ring[((pos + i) & sampler->mask) * sampler->SampleStride()]};
+        timestamps[i] = sample[0];
+        std::copy_n(sample + 1, counterCount, values + i * counterCount);
+    }
+
+    sampler->readPos.store(pos + count, std::memory_order_release);
+    return count;
+}
+
+uint64_t adrenotools_perfcounter_sampler_get_dropped(adrenotools_perfcounter_sampler *sampler) {
+    return sampler->dropped.load(std::memory_order_relaxed);
+}
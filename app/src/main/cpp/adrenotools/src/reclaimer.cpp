@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <system_error>
+#include <poll.h>
+#include "hook/gpu_object_reclaimer.h"
+
+GpuObjectReclaimer::GpuObjectReclaimer(adrenotools_kgsl_context *kgslCtx, const adrenotools_reclaimer_config &config)
+    : wakeFd{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)},
+      kgslCtx{kgslCtx},
+      config{config} {
+    uint64_t depth{std::max<uint64_t>(config.queue_depth, 2)};
+    depth = 1ULL << (64 - __builtin_clzll(depth - 1));
+
+    // Construction failures are reported through IsValid as this is created from the C API
+    cells.reset(new (std::nothrow) Cell[depth]);
+    if (!cells)
+        return;
+
+    for (uint64_t i{}; i < depth; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = depth - 1;
+
+    this->config.batch_size = std::max<uint32_t>(config.batch_size, 1);
+    this->config.flush_interval_ms = std::max<uint32_t>(config.flush_interval_ms, 1);
+
+    if (wakeFd < 0)
+        return;
+
+    try {
+        thread = std::thread{&GpuObjectReclaimer::Run, this};
+    } catch (const std::system_error &) {}
+}
+
+GpuObjectReclaimer::~GpuObjectReclaimer() {
+    if (thread.joinable()) {
+        stopping.store(true, std::memory_order_release);
+        uint64_t one{1};
+        (void)!write(wakeFd, &one, sizeof(one));
+        thread.join();
+    }
+
+    if (wakeFd >= 0)
+        close(wakeFd);
+}
+
+void GpuObjectReclaimer::Release(const PendingFree &pending, uint32_t timestamp) {
+    if (timestamp) {
+        kgsl_cmdstream_freememontimestamp_ctxtid freeArgs{
+            .context_id = config.timestamp_context_id,
+            .gpuaddr = static_cast<unsigned long>(pending.gpuAddr),
+            .type = KGSL_TIMESTAMP_RETIRED,
+            .timestamp = timestamp,
+        };
+
+        if (!kgslCtx->Ioctl(IOCTL_KGSL_CMDSTREAM_FREEMEMONTIMESTAMP_CTXTID, &freeArgs))
+            return;
+
+        // Older kernels only support this for legacy allocations, fall back to immediate frees from now on
+        if (errno == ENOTTY || errno == EINVAL)
+            timestampFreeSupported.store(false, std::memory_order_relaxed);
+    }
+
+    uint32_t id{pending.id};
+    if (!id) {
+        kgsl_gpumem_get_info info{};
+        if (!kgslCtx->GetGpumemInfo(pending.gpuAddr, info))
+            return;
+
+        id = info.id;
+    }
+
+    kgslCtx->FreeGpuobj(id);
+}
+
+uint32_t GpuObjectReclaimer::Flush() {
+    // All objects in a batch share a single timestamp, taken as the last work queued on the context at the time of the flush
+    uint32_t timestamp{};
+    if (config.timestamp_context_id && timestampFreeSupported.load(std::memory_order_relaxed)) {
+        kgsl_cmdstream_readtimestamp_ctxtid readArgs{};
+        readArgs.context_id = config.timestamp_context_id;
+        readArgs.type = KGSL_TIMESTAMP_QUEUED;
+
+        if (!kgslCtx->Ioctl(IOCTL_KGSL_CMDSTREAM_READTIMESTAMP_CTXTID, &readArgs))
+            timestamp = readArgs.timestamp;
+    }
+
+    uint32_t released{};
+    PendingFree pending;
+    while (Dequeue(pending)) {
+        Release(pending, timestamp);
+        released++;
+    }
+
+    return released;
+}
+
+void GpuObjectReclaimer::Run() {
+    pollfd pollFd{
+        .fd = wakeFd,
+        .events = POLLIN,
+        .revents = 0,
+    };
+
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (poll(&pollFd, 1, static_cast<int>(config.flush_interval_ms)) > 0) {
+            uint64_t count;
+            (void)!read(wakeFd, &count, sizeof(count));
+        }
+
+        Flush();
+    }
+
+    // Don't leak anything that was queued while shutting down
+    Flush();
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include "hook/kgsl_device.h"
+#include <adrenotools/sparse.h>
+
+struct adrenotools_sparse_resource {
+    adrenotools_kgsl_context *kgslCtx;
+    uint64_t size;
+    uint64_t pageSize;
+    uint32_t virtId;
+    uint64_t gpuAddr;
+
+    /**
+     * @brief A physical object bound to a virtual page and the offset of the page within it
+     */
+    struct ResidentPage {
+        uint32_t physId;
+        uint64_t physOffset;
+    };
+
+    /**
+     * @brief A physical object allocated by a single commit call
+     */
+    struct PhysObject {
+        uint64_t size;
+        uint64_t boundPages; //!< The object is freed once none of its pages are bound anymore
+    };
+
+    std::mutex mutex{};
+    std::unordered_map<uint64_t, ResidentPage> residentPages{}; //!< Maps virtual page indices to the physical memory bound to them
+    std::unordered_map<uint32_t, PhysObject> physObjects{};
+    uint64_t physBytes{}; //!< The total size of all physical objects
+
+    /**
+     * @brief Collects the sorted, deduplicated virtual page indices covered by `ranges`
+     * @return False if any range is unaligned or out of bounds
+     */
+    bool CollectPages(const adrenotools_sparse_range *ranges, uint32_t count, std::vector<uint64_t> &pages) const {
+        for (uint32_t i{}; i < count; i++) {
+            const auto &range{ranges[i]};
+            if ((range.offset | range.size) & (pageSize - 1) || range.offset > size || range.size > size - range.offset)
+                return false;
+
+            for (uint64_t page{range.offset / pageSize}; page < (range.offset + range.size) / pageSize; page++)
+                pages.push_back(page);
+        }
+
+        std::sort(pages.begin(), pages.end());
+        pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+        return true;
+    }
+
+    /**
+     * @brief Adds a single page binding, merging it into the previous one if both the virtual and physical ranges are contiguous
+     * @note Pages must be added in ascending order for runs to be merged
+     */
+    void AddBinding(std::vector<kgsl_sparse_binding_object> &bindings, uint64_t virtPage, const ResidentPage &phys, uint64_t flags) const {
+        uint64_t virtOffset{virtPage * pageSize};
+        if (!bindings.empty()) {
+            auto &last{bindings.back()};
+            if (last.id == phys.physId && last.flags == flags && last.virtoffset + last.size == virtOffset && last.physoffset + last.size == phys.physOffset) {
+                last.size += pageSize;
+                return;
+            }
+        }
+
+        bindings.push_back({
+            .virtoffset = virtOffset,
+            .physoffset = phys.physOffset,
+            .size = pageSize,
+            .flags = flags,
+            .id = phys.physId,
+        });
+    }
+};
+
+adrenotools_sparse_resource *adrenotools_sparse_reserve(uint64_t size, uint64_t pageSize) {
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx || !size || pageSize < static_cast<uint64_t>(getpagesize()) || (pageSize & (pageSize - 1)))
+        return nullptr;
+
+    size = (size + pageSize - 1) & ~(pageSize - 1);
+
+    uint32_t virtId{};
+    uint64_t gpuAddr{};
+    if (!kgslCtx->SparseVirtAlloc(size, pageSize, virtId, gpuAddr))
+        return nullptr;
+
+    auto resource{new (std::nothrow) adrenotools_sparse_resource{
+        .kgslCtx = kgslCtx,
+        .size = size,
+        .pageSize = pageSize,
+        .virtId = virtId,
+        .gpuAddr = gpuAddr,
+    }};
+
+    if (!resource)
+        kgslCtx->SparseVirtFree(virtId);
+
+    return resource;
+}
+
+void adrenotools_sparse_release(adrenotools_sparse_resource *resource) {
+    // Freeing the virtual object implicitly unbinds everything from it
+    resource->kgslCtx->SparseVirtFree(resource->virtId);
+
+    for (auto &[id, object] : resource->physObjects)
+        resource->kgslCtx->SparsePhysFree(id);
+
+    delete resource;
+}
+
+uint64_t adrenotools_sparse_get_gpu_addr(adrenotools_sparse_resource *resource) {
+    return resource->gpuAddr;
+}
+
+uint64_t adrenotools_sparse_get_resident_size(adrenotools_sparse_resource *resource) {
+    std::scoped_lock lock{resource->mutex};
+    return resource->physBytes;
+}
+
+bool adrenotools_sparse_commit(adrenotools_sparse_resource *resource, const adrenotools_sparse_range *ranges, uint32_t count) {
+    std::vector<uint64_t> pages;
+    if (!resource->CollectPages(ranges, count, pages))
+        return false;
+
+    std::scoped_lock lock{resource->mutex};
+
+    pages.erase(std::remove_if(pages.begin(), pages.end(), [&](uint64_t page) { return resource->residentPages.contains(page); }), pages.end());
+    if (pages.empty())
+        return true;
+
+    // All pages in a call share one physical object, so a commit only takes one allocation and one bind regardless of the number of pages
+    uint64_t physSize{pages.size() * resource->pageSize};
+    uint32_t physId{};
+    if (!resource->kgslCtx->SparsePhysAlloc(physSize, resource->pageSize, physId))
+        return false;
+
+    std::vector<kgsl_sparse_binding_object> bindings;
+    for (size_t i{}; i < pages.size(); i++)
+        resource->AddBinding(bindings, pages[i], {physId, i * resource->pageSize}, KGSL_SPARSE_BIND);
+
+    if (!resource->kgslCtx->SparseBind(resource->virtId, bindings.data(), static_cast<uint32_t>(bindings.size()))) {
+        resource->kgslCtx->SparsePhysFree(physId);
+        return false;
+    }
+
+    for (size_t i{}; i < pages.size(); i++)
+        resource->residentPages[pages[i]] = {physId, i * resource->pageSize};
+
+    resource->physObjects[physId] = {physSize, pages.size()};
+    resource->physBytes += physSize;
+    return true;
+}
+
+bool adrenotools_sparse_decommit(adrenotools_sparse_resource *resource, const adrenotools_sparse_range *ranges, uint32_t count) {
+    std::vector<uint64_t> pages;
+    if (!resource->CollectPages(ranges, count, pages))
+        return false;
+
+    std::scoped_lock lock{resource->mutex};
+
+    std::vector<kgsl_sparse_binding_object> bindings;
+    std::vector<decltype(resource->residentPages)::iterator> unbound;
+    for (uint64_t page : pages) {
+        auto it{resource->residentPages.find(page)};
+        if (it == resource->residentPages.end())
+            continue;
+
+        resource->AddBinding(bindings, page, it->second, KGSL_SPARSE_UNBIND);
+        unbound.push_back(it);
+    }
+
+    if (bindings.empty())
+        return true;
+
+    if (!resource->kgslCtx->SparseBind(resource->virtId, bindings.data(), static_cast<uint32_t>(bindings.size())))
+        return false;
+
+    // Physical objects are freed once all of their pages have been decommitted, committing and decommitting with the same ranges keeps memory use tracking the resident set
+    for (auto it : unbound) {
+        auto object{resource->physObjects.find(it->second.physId)};
+        if (!--object->second.boundPages) {
+            resource->kgslCtx->SparsePhysFree(object->first);
+            resource->physBytes -= object->second.size;
+            resource->physObjects.erase(object);
+        }
+
+        resource->residentPages.erase(it);
+    }
+
+    return true;
+}
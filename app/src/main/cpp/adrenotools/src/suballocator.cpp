@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include "hook/kgsl_device.h"
+#include "hook/gpu_mapping_handle.h"
+#include "tlsf.h"
+#include <adrenotools/suballocator.h>
+
+static constexpr uint64_t SubAllocGranularity{0x1000}; //!< Sub-allocations are always page aligned, this keeps the driver's assumptions about imported memory valid
+static constexpr uint64_t MaxAlignment{0x10000}; //!< Blocks start at this alignment on both the CPU and GPU, so TLSF offsets aligned up to it are also aligned in absolute terms
+static constexpr uint32_t MaxAlignmentLog2{16};
+static_assert(MaxAlignment == 1ULL << MaxAlignmentLog2);
+
+struct adrenotools_suballocator {
+    /**
+     * @brief A single KGSL object that is mapped on both the CPU and GPU
+     */
+    struct Block {
+        uint8_t *hostPtr; //!< The MaxAlignment aligned start of the block's usable range
+        uint64_t gpuAddr; //!< The MaxAlignment aligned start of the block's usable range
+        uint64_t size; //!< The size of the usable range
+        uint64_t padding; //!< The bytes between the start of the KGSL object and its usable range
+        uint64_t mapSize; //!< The size of the KGSL object's CPU mapping
+        uint32_t id;
+    };
+
+    GpuMappingHandle *mappingHandle; //!< May be nullptr if GPU mapping import isn't in use
+    adrenotools_kgsl_context *kgslCtx;
+    uint64_t blockSize;
+
+    std::mutex mutex{};
+    TlsfAllocator tlsf{SubAllocGranularity};
+    std::vector<Block> blocks{}; //!< Indexed by TLSF region, removed blocks have a size of zero
+
+    /**
+     * @brief Allocates a KGSL object, asking the kernel to align it to MaxAlignment
+     * @param padding Set to the bytes needed to reach a MaxAlignment aligned GPU address from the start of the object, the alignment is only a hint
+     */
+    bool AllocObject(uint64_t size, uint32_t &id, uint64_t &mmapSize, uint64_t &gpuAddr, uint64_t &padding) {
+        if (!kgslCtx->AllocGpuobj(size, KGSL_CACHEMODE_WRITEBACK << KGSL_CACHEMODE_SHIFT | KGSL_MEMFLAGS_IOCOHERENT | MaxAlignmentLog2 << KGSL_MEMALIGN_SHIFT, id, mmapSize))
+            return false;
+
+        kgsl_gpuobj_info info{};
+        if (!kgslCtx->GetGpuobjInfo(id, info)) {
+            kgslCtx->FreeGpuobj(id);
+            return false;
+        }
+
+        gpuAddr = info.gpuaddr;
+        padding = ((gpuAddr + MaxAlignment - 1) & ~(MaxAlignment - 1)) - gpuAddr;
+        return true;
+    }
+
+    /**
+     * @brief Maps a KGSL object on the CPU such that `hostPtr + padding` is MaxAlignment aligned, matching the GPU address at the same offset
+     */
+    uint8_t *MapObject(uint64_t mmapSize, uint64_t gpuAddr, uint64_t padding) {
+        // mmap only guarantees page alignment, so reserve enough address space to place the mapping at any alignment within it
+        uint64_t reserveSize{mmapSize + MaxAlignment};
+        auto reserved{reinterpret_cast<uint8_t *>(mmap(nullptr, reserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0))};
+        if (reserved == MAP_FAILED)
+            return nullptr;
+
+        auto reservedAddr{reinterpret_cast<uintptr_t>(reserved)};
+        auto hostPtr{reinterpret_cast<uint8_t *>(((reservedAddr + padding + MaxAlignment - 1) & ~(MaxAlignment - 1)) - padding)};
+        if (!kgslCtx->Map(hostPtr, mmapSize, gpuAddr, MAP_FIXED)) {
+            munmap(reserved, reserveSize);
+            return nullptr;
+        }
+
+        if (auto head{static_cast<size_t>(hostPtr - reserved)})
+            munmap(reserved, head);
+        if (auto tail{static_cast<size_t>(reserved + reserveSize - (hostPtr + mmapSize))})
+            munmap(hostPtr + mmapSize, tail);
+
+        return hostPtr;
+    }
+
+    /**
+     * @brief Reserves and maps a new block with at least `size` usable bytes
+     * @return If the block could be added
+     */
+    bool AddBlock(uint64_t size) {
+        uint32_t id{};
+        uint64_t mmapSize{}, gpuAddr{}, padding{};
+        if (!AllocObject(size, id, mmapSize, gpuAddr, padding))
+            return false;
+
+        // The kernel ignored the alignment hint, make room to align the usable range within a larger object instead
+        if (padding) {
+            kgslCtx->FreeGpuobj(id);
+            if (!AllocObject(size + MaxAlignment - SubAllocGranularity, id, mmapSize, gpuAddr, padding))
+                return false;
+        }
+
+        auto hostPtr{MapObject(mmapSize, gpuAddr, padding)};
+        if (!hostPtr) {
+            kgslCtx->FreeGpuobj(id);
+            return false;
+        }
+
+        uint64_t usableSize{(mmapSize - padding) & ~(SubAllocGranularity - 1)};
+        uint32_t region{tlsf.AddRegion(usableSize)};
+        if (region >= blocks.size())
+            blocks.resize(region + 1);
+
+        blocks[region] = {
+            .hostPtr = hostPtr + padding,
+            .gpuAddr = gpuAddr + padding,
+            .size = usableSize,
+            .padding = padding,
+            .mapSize = mmapSize,
+            .id = id,
+        };
+
+        // Only used to answer adrenotools_find_imported_range queries, the free hook never sees block base addresses
+        if (mappingHandle)
+            mappingHandle->objects.Insert(gpuAddr, id, mmapSize, hostPtr);
+
+        return true;
+    }
+
+    void ReleaseBlock(Block &block) {
+        if (mappingHandle) {
+            GpuObjectIndex::Object object;
+            mappingHandle->objects.Remove(block.gpuAddr - block.padding, object);
+        }
+
+        munmap(block.hostPtr - block.padding, block.mapSize);
+        kgslCtx->FreeGpuobj(block.id);
+        block = {};
+    }
+};
+
+// The TLSF node index and the block index are packed into adrenotools_suballocation::priv
+static uint64_t PackPriv(uint32_t region, uint32_t node) {
+    return (static_cast<uint64_t>(region) << 32) | node;
+}
+
+adrenotools_suballocator *adrenotools_suballocator_create(void *handle, uint64_t blockSize) {
+    auto kgslCtx{adrenotools_kgsl_context_get_default()};
+    if (!kgslCtx || !blockSize)
+        return nullptr;
+
+    return new (std::nothrow) adrenotools_suballocator{
+        .mappingHandle = reinterpret_cast<GpuMappingHandle *>(handle),
+        .kgslCtx = kgslCtx,
+        .blockSize = (blockSize + SubAllocGranularity - 1) & ~(SubAllocGranularity - 1),
+    };
+}
+
+void adrenotools_suballocator_destroy(adrenotools_suballocator *allocator) {
+    for (auto &block : allocator->blocks)
+        if (block.size)
+            allocator->ReleaseBlock(block);
+
+    delete allocator;
+}
+
+bool adrenotools_suballocator_alloc(adrenotools_suballocator *allocator, uint64_t size, uint64_t alignment, adrenotools_suballocation *allocation) {
+    if (!size || (alignment & (alignment - 1)) || alignment > MaxAlignment)
+        return false;
+
+    alignment = std::max(alignment, SubAllocGranularity);
+
+    std::scoped_lock lock{allocator->mutex};
+
+    TlsfAllocator::Allocation range{};
+    if (!allocator->tlsf.Allocate(size, alignment, range)) {
+        // Block offsets are only aligned to the granularity, so make sure a dedicated block leaves enough room to align within it
+        uint64_t minBlockSize{((size + SubAllocGranularity - 1) & ~(SubAllocGranularity - 1)) + alignment - SubAllocGranularity};
+        if (!allocator->AddBlock(std::max(allocator->blockSize, minBlockSize)))
+            return false;
+
+        if (!allocator->tlsf.Allocate(size, alignment, range))
+            return false;
+    }
+
+    auto &block{allocator->blocks[range.region]};
+    *allocation = {
+        .host_ptr = block.hostPtr + range.offset,
+        .gpu_addr = block.gpuAddr + range.offset,
+        .size = size,
+        .priv = PackPriv(range.region, range.node),
+    };
+    return true;
+}
+
+void adrenotools_suballocator_free(adrenotools_suballocator *allocator, const adrenotools_suballocation *allocation) {
+    std::scoped_lock lock{allocator->mutex};
+    allocator->tlsf.Free(static_cast<uint32_t>(allocation->priv));
+}
+
+uint64_t adrenotools_suballocator_trim(adrenotools_suballocator *allocator) {
+    std::scoped_lock lock{allocator->mutex};
+
+    uint64_t released{};
+    for (uint32_t region{}; region < allocator->blocks.size(); region++) {
+        auto &block{allocator->blocks[region]};
+        if (!block.size || !allocator->tlsf.IsRegionEmpty(region))
+            continue;
+
+        released += block.mapSize;
+        allocator->tlsf.RemoveRegion(region);
+        allocator->ReleaseBlock(block);
+    }
+
+    return released;
+}
+
+void adrenotools_suballocator_get_stats(adrenotools_suballocator *allocator, adrenotools_suballocator_stats *stats) {
+    std::scoped_lock lock{allocator->mutex};
+
+    auto tlsfStats{allocator->tlsf.GetStats()};
+    *stats = {
+        .block_count = static_cast<uint32_t>(std::count_if(allocator->blocks.begin(), allocator->blocks.end(), [](const auto &block) { return block.size != 0; })),
+        .allocation_count = tlsfStats.allocationCount,
+        .free_range_count = tlsfStats.freeRangeCount,
+        .reserved_bytes = tlsfStats.totalBytes,
+        .allocated_bytes = tlsfStats.totalBytes - tlsfStats.freeBytes,
+        .free_bytes = tlsfStats.freeBytes,
+        .largest_free_bytes = tlsfStats.largestFreeBytes,
+        .fragmentation = tlsfStats.freeBytes ? 1.0f - static_cast<float>(tlsfStats.largestFreeBytes) / static_cast<float>(tlsfStats.freeBytes) : 0.0f,
+    };
+}
+
+bool adrenotools_suballocator_import(adrenotools_suballocator *allocator, const adrenotools_suballocation *allocation, uint64_t tag, uint64_t *ticket) {
+    if (!allocator->mappingHandle)
+        return false;
+
+    uint32_t id;
+    {
+        std::scoped_lock lock{allocator->mutex};
+        id = allocator->blocks[static_cast<uint32_t>(allocation->priv >> 32)].id;
+    }
+
+    adrenotools_gpu_mapping mapping{
+        .host_ptr = allocation->host_ptr,
+        .gpu_addr = allocation->gpu_addr,
+        .size = allocation->size,
+        .flags = GslMappingFlags,
+    };
+
+    return allocator->mappingHandle->queue.Push(mapping, tag, id, true, *ticket);
+}
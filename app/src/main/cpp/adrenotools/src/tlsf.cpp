@@ -0,0 +1,268 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <algorithm>
+#include "tlsf.h"
+
+static uint32_t Log2Floor(uint64_t value) {
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+}
+
+TlsfAllocator::TlsfAllocator(uint64_t granularity) : granularityLog2{Log2Floor(granularity)} {
+    for (auto &list : freeLists)
+        list.fill(InvalidIndex);
+}
+
+void TlsfAllocator::MapSize(uint64_t size, uint32_t &fl, uint32_t &sl) {
+    // Sizes below SlCount get their own exact lists in the first level
+    if (size < SlCount) {
+        fl = 0;
+        sl = static_cast<uint32_t>(size);
+    } else {
+        uint32_t log2{Log2Floor(size)};
+        fl = log2 - SlLog2 + 1;
+        sl = static_cast<uint32_t>(size >> (log2 - SlLog2)) ^ SlCount;
+    }
+}
+
+uint32_t TlsfAllocator::NewNode(const Node &node) {
+    if (unusedNodes != InvalidIndex) {
+        uint32_t index{unusedNodes};
+        unusedNodes = nodes[index].nextFree;
+        nodes[index] = node;
+        return index;
+    }
+
+    nodes.push_back(node);
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void TlsfAllocator::ReleaseNode(uint32_t index) {
+    nodes[index].nextFree = unusedNodes;
+    unusedNodes = index;
+}
+
+void TlsfAllocator::InsertFree(uint32_t index) {
+    auto &node{nodes[index]};
+    uint32_t fl, sl;
+    MapSize(node.size, fl, sl);
+
+    auto &head{freeLists[fl][sl]};
+    node.free = true;
+    node.prevFree = InvalidIndex;
+    node.nextFree = head;
+    if (head != InvalidIndex)
+        nodes[head].prevFree = index;
+    head = index;
+
+    flBitmap |= 1ULL << fl;
+    slBitmaps[fl] |= 1U << sl;
+    freeUnits += node.size;
+    freeRangeCount++;
+}
+
+void TlsfAllocator::RemoveFree(uint32_t index) {
+    auto &node{nodes[index]};
+    uint32_t fl, sl;
+    MapSize(node.size, fl, sl);
+
+    if (node.prevFree != InvalidIndex)
+        nodes[node.prevFree].nextFree = node.nextFree;
+    else
+        freeLists[fl][sl] = node.nextFree;
+
+    if (node.nextFree != InvalidIndex)
+        nodes[node.nextFree].prevFree = node.prevFree;
+
+    if (freeLists[fl][sl] == InvalidIndex) {
+        slBitmaps[fl] &= ~(1U << sl);
+        if (!slBitmaps[fl])
+            flBitmap &= ~(1ULL << fl);
+    }
+
+    node.free = false;
+    freeUnits -= node.size;
+    freeRangeCount--;
+}
+
+uint32_t TlsfAllocator::FindFree(uint64_t size) {
+    // Round the size up to the next list boundary so that any node in the found list is large enough
+    if (size >= SlCount)
+        size += (1ULL << (Log2Floor(size) - SlLog2)) - 1;
+
+    uint32_t fl, sl;
+    MapSize(size, fl, sl);
+    if (fl >= FlCount)
+        return InvalidIndex;
+
+    uint32_t slMap{slBitmaps[fl] & (~0U << sl)};
+    if (!slMap) {
+        uint64_t flMap{fl + 1 < 64 ? flBitmap & (~0ULL << (fl + 1)) : 0};
+        if (!flMap)
+            return InvalidIndex;
+
+        fl = static_cast<uint32_t>(__builtin_ctzll(flMap));
+        slMap = slBitmaps[fl];
+    }
+
+    sl = static_cast<uint32_t>(__builtin_ctz(slMap));
+    return freeLists[fl][sl];
+}
+
+void TlsfAllocator::SplitTail(uint32_t index, uint64_t size) {
+    auto &node{nodes[index]};
+    if (node.size == size)
+        return;
+
+    Node tail{
+        .offset = node.offset + size,
+        .size = node.size - size,
+        .region = node.region,
+        .prevPhys = index,
+        .nextPhys = node.nextPhys,
+    };
+    node.size = size;
+
+    uint32_t tailIndex{NewNode(tail)}; // May reallocate `nodes`, `node` must not be used past here
+    if (tail.nextPhys != InvalidIndex)
+        nodes[tail.nextPhys].prevPhys = tailIndex;
+    nodes[index].nextPhys = tailIndex;
+
+    // Merge with the following node if it's free so neighbouring free nodes never exist
+    uint32_t next{nodes[tailIndex].nextPhys};
+    if (next != InvalidIndex && nodes[next].free) {
+        RemoveFree(next);
+        nodes[tailIndex].size += nodes[next].size;
+        nodes[tailIndex].nextPhys = nodes[next].nextPhys;
+        if (nodes[next].nextPhys != InvalidIndex)
+            nodes[nodes[next].nextPhys].prevPhys = tailIndex;
+        ReleaseNode(next);
+    }
+
+    InsertFree(tailIndex);
+}
+
+uint32_t TlsfAllocator::AddRegion(uint64_t size) {
+    uint64_t units{size >> granularityLog2};
+    auto region{static_cast<uint32_t>(regionSizes.size())};
+    regionSizes.push_back(units);
+
+    uint32_t index{NewNode({
+        .offset = 0,
+        .size = units,
+        .region = region,
+        .prevPhys = InvalidIndex,
+        .nextPhys = InvalidIndex,
+    })};
+
+    totalUnits += units;
+    InsertFree(index);
+    regionHeads.push_back(index);
+    return region;
+}
+
+bool TlsfAllocator::IsRegionEmpty(uint32_t region) const {
+    auto &head{nodes[regionHeads[region]]};
+    return head.free && head.size == regionSizes[region];
+}
+
+void TlsfAllocator::RemoveRegion(uint32_t region) {
+    uint32_t head{regionHeads[region]};
+    RemoveFree(head);
+    ReleaseNode(head);
+
+    totalUnits -= regionSizes[region];
+    regionSizes[region] = 0;
+    regionHeads[region] = InvalidIndex;
+}
+
+bool TlsfAllocator::Allocate(uint64_t size, uint64_t alignment, Allocation &allocation) {
+    uint64_t units{std::max<uint64_t>((size + (1ULL << granularityLog2) - 1) >> granularityLog2, 1)};
+    uint64_t alignUnits{std::max<uint64_t>(alignment >> granularityLog2, 1)};
+
+    // Over-allocate by enough to be able to align the start of the allocation within the found node
+    uint32_t index{FindFree(units + alignUnits - 1)};
+    if (index == InvalidIndex)
+        return false;
+
+    RemoveFree(index);
+
+    uint64_t alignedOffset{(nodes[index].offset + alignUnits - 1) & ~(alignUnits - 1)};
+    if (uint64_t padding{alignedOffset - nodes[index].offset}) {
+        // Keep the padding in the original node so region heads stay stable, then carve the aligned allocation out after it
+        Node aligned{
+            .offset = alignedOffset,
+            .size = nodes[index].size - padding,
+            .region = nodes[index].region,
+            .prevPhys = index,
+            .nextPhys = nodes[index].nextPhys,
+        };
+
+        uint32_t alignedIndex{NewNode(aligned)};
+        if (aligned.nextPhys != InvalidIndex)
+            nodes[aligned.nextPhys].prevPhys = alignedIndex;
+        nodes[index].nextPhys = alignedIndex;
+        nodes[index].size = padding;
+        InsertFree(index);
+
+        index = alignedIndex;
+    }
+
+    SplitTail(index, units);
+
+    allocationCount++;
+    allocation = {
+        .region = nodes[index].region,
+        .offset = nodes[index].offset << granularityLog2,
+        .size = nodes[index].size << granularityLog2,
+        .node = index,
+    };
+    return true;
+}
+
+void TlsfAllocator::Free(uint32_t index) {
+    allocationCount--;
+
+    // Absorb the following node first, then let the preceding node absorb us so the lowest node always survives
+    uint32_t next{nodes[index].nextPhys};
+    if (next != InvalidIndex && nodes[next].free) {
+        RemoveFree(next);
+        nodes[index].size += nodes[next].size;
+        nodes[index].nextPhys = nodes[next].nextPhys;
+        if (nodes[next].nextPhys != InvalidIndex)
+            nodes[nodes[next].nextPhys].prevPhys = index;
+        ReleaseNode(next);
+    }
+
+    uint32_t prev{nodes[index].prevPhys};
+    if (prev != InvalidIndex && nodes[prev].free) {
+        RemoveFree(prev);
+        nodes[prev].size += nodes[index].size;
+        nodes[prev].nextPhys = nodes[index].nextPhys;
+        if (nodes[index].nextPhys != InvalidIndex)
+            nodes[nodes[index].nextPhys].prevPhys = prev;
+        ReleaseNode(index);
+        index = prev;
+    }
+
+    InsertFree(index);
+}
+
+TlsfAllocator::Stats TlsfAllocator::GetStats() const {
+    uint64_t largestFree{};
+    if (flBitmap) {
+        // Only the highest non-empty first level list can hold the largest node
+        uint32_t fl{Log2Floor(flBitmap)};
+        for (uint32_t sl{}; sl < SlCount; sl++)
+            for (uint32_t index{freeLists[fl][sl]}; index != InvalidIndex; index = nodes[index].nextFree)
+                largestFree = std::max(largestFree, nodes[index].size);
+    }
+
+    return {
+        .totalBytes = totalUnits << granularityLog2,
+        .freeBytes = freeUnits << granularityLog2,
+        .largestFreeBytes = largestFree << granularityLog2,
+        .freeRangeCount = freeRangeCount,
+        .allocationCount = allocationCount,
+    };
+}
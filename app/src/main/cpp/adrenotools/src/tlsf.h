@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A two-level segregated fit allocator that hands out ranges from a set of externally owned regions, allocation and freeing are O(1)
+ * @note All sizes and offsets are in units of `granularity` bytes, which must be a power of two
+ * @note This isn't thread-safe, callers are expected to provide their own locking
+ */
+class TlsfAllocator {
+  public:
+    static constexpr uint32_t InvalidIndex{UINT32_MAX};
+
+    /**
+     * @brief A range handed out by Allocate, `node` must be passed back to Free
+     */
+    struct Allocation {
+        uint32_t region;
+        uint64_t offset; //!< Byte offset of the allocation inside the region
+        uint64_t size; //!< Size in bytes of the range reserved for the allocation, this may be larger than the requested size
+        uint32_t node;
+    };
+
+    struct Stats {
+        uint64_t totalBytes; //!< The combined size of all regions
+        uint64_t freeBytes;
+        uint64_t largestFreeBytes;
+        uint32_t freeRangeCount;
+        uint32_t allocationCount;
+    };
+
+  private:
+    static constexpr uint32_t SlLog2{5}; //!< log2 of the number of second level lists per first level
+    static constexpr uint32_t SlCount{1U << SlLog2};
+    static constexpr uint32_t FlCount{64 - SlLog2};
+
+    struct Node {
+        uint64_t offset; //!< In units of granularity
+        uint64_t size; //!< In units of granularity
+        uint32_t region;
+        uint32_t prevPhys; //!< The node directly before this one in the region
+        uint32_t nextPhys;
+        uint32_t prevFree{InvalidIndex}; //!< Links within the segregated free list, only valid if `free` is set
+        uint32_t nextFree{InvalidIndex};
+        bool free{};
+    };
+
+    uint32_t granularityLog2;
+    std::vector<Node> nodes;
+    uint32_t unusedNodes{InvalidIndex}; //!< Singly-linked list of node slots available for reuse, chained through nextFree
+    std::vector<uint64_t> regionSizes; //!< In units of granularity, zero for removed regions
+    std::vector<uint32_t> regionHeads; //!< The node at offset 0 of each region, this is never merged away
+
+    uint64_t flBitmap{};
+    std::array<uint32_t, FlCount> slBitmaps{};
+    std::array<std::array<uint32_t, SlCount>, FlCount> freeLists;
+
+    uint64_t totalUnits{};
+    uint64_t freeUnits{};
+    uint32_t freeRangeCount{};
+    uint32_t allocationCount{};
+
+    static void MapSize(uint64_t size, uint32_t &fl, uint32_t &sl);
+
+    uint32_t NewNode(const Node &node);
+
+    void ReleaseNode(uint32_t index);
+
+    void InsertFree(uint32_t index);
+
+    void RemoveFree(uint32_t index);
+
+    /**
+     * @brief Finds a free node that's guaranteed to be able to hold `size` units
+     */
+    uint32_t FindFree(uint64_t size);
+
+    /**
+     * @brief Splits the tail of `index` after `size` units into a new free node
+     */
+    void SplitTail(uint32_t index, uint64_t size);
+
+  public:
+    explicit TlsfAllocator(uint64_t granularity);
+
+    /**
+     * @brief Adds a new region that allocations can be served from
+     * @return The index of the region
+     */
+    uint32_t AddRegion(uint64_t size);
+
+    /**
+     * @return If no allocations are currently served from the region
+     */
+    bool IsRegionEmpty(uint32_t region) const;
+
+    /**
+     * @brief Removes an empty region, the index will not be reused
+     */
+    void RemoveRegion(uint32_t region);
+
+    /**
+     * @param alignment The required alignment of the allocation offset in bytes, must be a power of two
+     * @return If the allocation succeeded, it can only fail if no region has a large enough free range
+     */
+    bool Allocate(uint64_t size, uint64_t alignment, Allocation &allocation);
+
+    void Free(uint32_t node);
+
+    Stats GetStats() const;
+};
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright © 2021 Billy Laws
+
+#include <cstdio>
+#include <vector>
+#include <adrenotools/driver_check.h>
+
+static void PrintIssue(void *, adrenotools_driver_issue_type type, const char *library, const char *name) {
+    switch (type) {
+        case ADRENOTOOLS_DRIVER_ISSUE_INVALID_LIBRARY:
+            printf("invalid library: %s\n", library);
+            break;
+        case ADRENOTOOLS_DRIVER_ISSUE_MISSING_LIBRARY:
+            printf("missing library: %s (needed by %s)\n", name, library);
+            break;
+        case ADRENOTOOLS_DRIVER_ISSUE_UNDEFINED_SYMBOL:
+            printf("undefined symbol: %s (referenced by %s)\n", name, library);
+            break;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <driver dir> <driver name> [search dir...]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<const char *> searchPaths(argv + 3, argv + argc);
+    bool ok{adrenotools_check_driver_with_search_paths(argv[1], argv[2], searchPaths.data(), static_cast<uint32_t>(searchPaths.size()), PrintIssue, nullptr)};
+    if (ok)
+        printf("%s: no issues found\n", argv[2]);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,434 @@
+#include "driver_bench.h"
+
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+	const uint32_t c_numInstanceIterations = 8u;
+	const uint32_t c_numAllocations = 256u;
+	const VkDeviceSize c_allocationSize = 1024u * 1024u;
+	const uint32_t c_numPipelineIterations = 16u;
+
+	/** SPIR-V 1.0 for the following compute shader. The specialization constant is changed
+		on every compile so drivers can't serve the pipeline from their internal caches.
+
+	@code
+		layout( local_size_x = 64 ) in;
+		layout( constant_id = 0 ) const uint c_scale = 0;
+		layout( set = 0, binding = 0 ) buffer Buf { uint data[]; };
+		void main() { data[gl_GlobalInvocationID.x] = gl_GlobalInvocationID.x * c_scale; }
+	@endcode
+	*/
+	const uint32_t c_computeShader[] = {
+		// Header: magic, version 1.0, generator, bound, schema
+		0x07230203u, 0x00010000u, 0u, 23u, 0u,
+		// OpCapability Shader
+		( 2u << 16u ) | 17u, 1u,
+		// OpMemoryModel Logical GLSL450
+		( 3u << 16u ) | 14u, 0u, 1u,
+		// OpEntryPoint GLCompute %17 "main" %6
+		( 6u << 16u ) | 15u, 5u, 17u, 0x6E69616Du, 0u, 6u,
+		// OpExecutionMode %17 LocalSize 64 1 1
+		( 6u << 16u ) | 16u, 17u, 17u, 64u, 1u, 1u,
+		// OpDecorate %6 BuiltIn GlobalInvocationId
+		( 4u << 16u ) | 71u, 6u, 11u, 28u,
+		// OpDecorate %8 ArrayStride 4
+		( 4u << 16u ) | 71u, 8u, 6u, 4u,
+		// OpMemberDecorate %9 0 Offset 0
+		( 5u << 16u ) | 72u, 9u, 0u, 35u, 0u,
+		// OpDecorate %9 BufferBlock
+		( 3u << 16u ) | 71u, 9u, 3u,
+		// OpDecorate %11 DescriptorSet 0
+		( 4u << 16u ) | 71u, 11u, 34u, 0u,
+		// OpDecorate %11 Binding 0
+		( 4u << 16u ) | 71u, 11u, 33u, 0u,
+		// OpDecorate %16 SpecId 0
+		( 4u << 16u ) | 71u, 16u, 1u, 0u,
+		// %1 = OpTypeVoid
+		( 2u << 16u ) | 19u, 1u,
+		// %2 = OpTypeFunction %1
+		( 3u << 16u ) | 33u, 2u, 1u,
+		// %3 = OpTypeInt 32 0
+		( 4u << 16u ) | 21u, 3u, 32u, 0u,
+		// %4 = OpTypeVector %3 3
+		( 4u << 16u ) | 23u, 4u, 3u, 3u,
+		// %5 = OpTypePointer Input %4
+		( 4u << 16u ) | 32u, 5u, 1u, 4u,
+		// %6 = OpVariable %5 Input
+		( 4u << 16u ) | 59u, 5u, 6u, 1u,
+		// %7 = OpTypePointer Input %3
+		( 4u << 16u ) | 32u, 7u, 1u, 3u,
+		// %8 = OpTypeRuntimeArray %3
+		( 3u << 16u ) | 29u, 8u, 3u,
+		// %9 = OpTypeStruct %8
+		( 3u << 16u ) | 30u, 9u, 8u,
+		// %10 = OpTypePointer Uniform %9
+		( 4u << 16u ) | 32u, 10u, 2u, 9u,
+		// %11 = OpVariable %10 Uniform
+		( 4u << 16u ) | 59u, 10u, 11u, 2u,
+		// %12 = OpTypePointer Uniform %3
+		( 4u << 16u ) | 32u, 12u, 2u, 3u,
+		// %13 = OpTypeInt 32 1
+		( 4u << 16u ) | 21u, 13u, 32u, 1u,
+		// %14 = OpConstant %13 0
+		( 4u << 16u ) | 43u, 13u, 14u, 0u,
+		// %15 = OpConstant %3 0
+		( 4u << 16u ) | 43u, 3u, 15u, 0u,
+		// %16 = OpSpecConstant %3 0
+		( 4u << 16u ) | 50u, 3u, 16u, 0u,
+		// %17 = OpFunction %1 None %2
+		( 5u << 16u ) | 54u, 1u, 17u, 0u, 2u,
+		// %18 = OpLabel
+		( 2u << 16u ) | 248u, 18u,
+		// %19 = OpAccessChain %7 %6 %15
+		( 5u << 16u ) | 65u, 7u, 19u, 6u, 15u,
+		// %20 = OpLoad %3 %19
+		( 4u << 16u ) | 61u, 3u, 20u, 19u,
+		// %21 = OpIMul %3 %20 %16
+		( 5u << 16u ) | 132u, 3u, 21u, 20u, 16u,
+		// %22 = OpAccessChain %12 %11 %14 %20
+		( 6u << 16u ) | 65u, 12u, 22u, 11u, 14u, 20u,
+		// OpStore %22 %21
+		( 3u << 16u ) | 62u, 22u, 21u,
+		// OpReturn
+		( 1u << 16u ) | 253u,
+		// OpFunctionEnd
+		( 1u << 16u ) | 56u,
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	double msSince( Clock::time_point start )
+	{
+		return std::chrono::duration<double, std::milli>( Clock::now() - start ).count();
+	}
+
+	/// Runs the workload stages that need a device. Returns false and sets outResult.error on failure.
+	bool benchDevice( VkInstance instance, VkPhysicalDevice physicalDevice,
+					  PFN_vkGetInstanceProcAddr getInstanceProcAddr, DriverBenchResult &outResult )
+	{
+#define LOAD_INSTANCE_FUNC( name ) \
+	PFN_##name name = reinterpret_cast<PFN_##name>( getInstanceProcAddr( instance, #name ) )
+		LOAD_INSTANCE_FUNC( vkGetPhysicalDeviceQueueFamilyProperties );
+		LOAD_INSTANCE_FUNC( vkGetPhysicalDeviceMemoryProperties );
+		LOAD_INSTANCE_FUNC( vkCreateDevice );
+		LOAD_INSTANCE_FUNC( vkGetDeviceProcAddr );
+#undef LOAD_INSTANCE_FUNC
+
+		uint32_t numQueueFamilies = 0u;
+		vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &numQueueFamilies, nullptr );
+		std::vector<VkQueueFamilyProperties> queueFamilies( numQueueFamilies );
+		vkGetPhysicalDeviceQueueFamilyProperties( physicalDevice, &numQueueFamilies,
+												  queueFamilies.data() );
+
+		uint32_t queueFamilyIdx = 0u;
+		while( queueFamilyIdx < numQueueFamilies &&
+			   !( queueFamilies[queueFamilyIdx].queueFlags & VK_QUEUE_COMPUTE_BIT ) )
+		{
+			++queueFamilyIdx;
+		}
+		if( queueFamilyIdx == numQueueFamilies )
+		{
+			outResult.error = "no compute queue";
+			return false;
+		}
+
+		const float queuePriority = 1.0f;
+		VkDeviceQueueCreateInfo queueCreateInfo = {};
+		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = queueFamilyIdx;
+		queueCreateInfo.queueCount = 1u;
+		queueCreateInfo.pQueuePriorities = &queuePriority;
+
+		VkDeviceCreateInfo deviceCreateInfo = {};
+		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		deviceCreateInfo.queueCreateInfoCount = 1u;
+		deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+
+		VkDevice device = VK_NULL_HANDLE;
+		Clock::time_point start = Clock::now();
+		if( vkCreateDevice( physicalDevice, &deviceCreateInfo, nullptr, &device ) != VK_SUCCESS )
+		{
+			outResult.error = "vkCreateDevice";
+			return false;
+		}
+		outResult.deviceCreateMs = msSince( start );
+
+#define LOAD_DEVICE_FUNC( name ) \
+	PFN_##name name = reinterpret_cast<PFN_##name>( vkGetDeviceProcAddr( device, #name ) )
+		LOAD_DEVICE_FUNC( vkDestroyDevice );
+		LOAD_DEVICE_FUNC( vkAllocateMemory );
+		LOAD_DEVICE_FUNC( vkFreeMemory );
+		LOAD_DEVICE_FUNC( vkCreateShaderModule );
+		LOAD_DEVICE_FUNC( vkDestroyShaderModule );
+		LOAD_DEVICE_FUNC( vkCreateDescriptorSetLayout );
+		LOAD_DEVICE_FUNC( vkDestroyDescriptorSetLayout );
+		LOAD_DEVICE_FUNC( vkCreatePipelineLayout );
+		LOAD_DEVICE_FUNC( vkDestroyPipelineLayout );
+		LOAD_DEVICE_FUNC( vkCreateComputePipelines );
+		LOAD_DEVICE_FUNC( vkDestroyPipeline );
+#undef LOAD_DEVICE_FUNC
+
+		// Memory allocation throughput. Prefer device local memory as that's what real workloads
+		// allocate the most of.
+		VkPhysicalDeviceMemoryProperties memProps;
+		vkGetPhysicalDeviceMemoryProperties( physicalDevice, &memProps );
+		uint32_t memTypeIdx = 0u;
+		for( uint32_t i = 0u; i < memProps.memoryTypeCount; ++i )
+		{
+			if( memProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT )
+			{
+				memTypeIdx = i;
+				break;
+			}
+		}
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = c_allocationSize;
+		allocInfo.memoryTypeIndex = memTypeIdx;
+
+		std::vector<VkDeviceMemory> allocations;
+		allocations.reserve( c_numAllocations );
+		start = Clock::now();
+		for( uint32_t i = 0u; i < c_numAllocations; ++i )
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			if( vkAllocateMemory( device, &allocInfo, nullptr, &memory ) != VK_SUCCESS )
+				break;
+			allocations.push_back( memory );
+		}
+		for( VkDeviceMemory memory : allocations )
+			vkFreeMemory( device, memory, nullptr );
+		const double allocSeconds = msSince( start ) / 1000.0;
+
+		if( allocations.size() != c_numAllocations )
+			outResult.error = "vkAllocateMemory";
+		else if( allocSeconds > 0 )
+		{
+			outResult.allocationsPerSecond = c_numAllocations / allocSeconds;
+			outResult.allocationMiBPerSecond =
+				c_numAllocations * double( c_allocationSize ) / ( 1024.0 * 1024.0 ) / allocSeconds;
+		}
+
+		// Pipeline compile time
+		VkShaderModuleCreateInfo moduleCreateInfo = {};
+		moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		moduleCreateInfo.codeSize = sizeof( c_computeShader );
+		moduleCreateInfo.pCode = c_computeShader;
+
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0u;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		binding.descriptorCount = 1u;
+		binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+		setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		setLayoutCreateInfo.bindingCount = 1u;
+		setLayoutCreateInfo.pBindings = &binding;
+
+		VkShaderModule shaderModule = VK_NULL_HANDLE;
+		VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+
+		if( outResult.error.empty() &&
+			vkCreateShaderModule( device, &moduleCreateInfo, nullptr, &shaderModule ) != VK_SUCCESS )
+		{
+			outResult.error = "vkCreateShaderModule";
+		}
+		if( outResult.error.empty() &&
+			vkCreateDescriptorSetLayout( device, &setLayoutCreateInfo, nullptr, &setLayout ) !=
+				VK_SUCCESS )
+		{
+			outResult.error = "vkCreateDescriptorSetLayout";
+		}
+
+		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutCreateInfo.setLayoutCount = 1u;
+		pipelineLayoutCreateInfo.pSetLayouts = &setLayout;
+
+		if( outResult.error.empty() &&
+			vkCreatePipelineLayout( device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout ) !=
+				VK_SUCCESS )
+		{
+			outResult.error = "vkCreatePipelineLayout";
+		}
+
+		if( outResult.error.empty() )
+		{
+			VkSpecializationMapEntry specEntry = {};
+			specEntry.constantID = 0u;
+			specEntry.offset = 0u;
+			specEntry.size = sizeof( uint32_t );
+
+			double totalCompileMs = 0;
+			for( uint32_t i = 0u; i < c_numPipelineIterations && outResult.error.empty(); ++i )
+			{
+				const uint32_t specValue = i + 1u;
+				VkSpecializationInfo specInfo = {};
+				specInfo.mapEntryCount = 1u;
+				specInfo.pMapEntries = &specEntry;
+				specInfo.dataSize = sizeof( specValue );
+				specInfo.pData = &specValue;
+
+				VkComputePipelineCreateInfo pipelineCreateInfo = {};
+				pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+				pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+				pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+				pipelineCreateInfo.stage.module = shaderModule;
+				pipelineCreateInfo.stage.pName = "main";
+				pipelineCreateInfo.stage.pSpecializationInfo = &specInfo;
+				pipelineCreateInfo.layout = pipelineLayout;
+
+				VkPipeline pipeline = VK_NULL_HANDLE;
+				start = Clock::now();
+				if( vkCreateComputePipelines( device, VK_NULL_HANDLE, 1u, &pipelineCreateInfo, nullptr,
+											  &pipeline ) != VK_SUCCESS )
+				{
+					outResult.error = "vkCreateComputePipelines";
+					break;
+				}
+				totalCompileMs += msSince( start );
+				vkDestroyPipeline( device, pipeline, nullptr );
+			}
+
+			if( outResult.error.empty() )
+				outResult.pipelineCompileMs = totalCompileMs / c_numPipelineIterations;
+		}
+
+		if( pipelineLayout )
+			vkDestroyPipelineLayout( device, pipelineLayout, nullptr );
+		if( setLayout )
+			vkDestroyDescriptorSetLayout( device, setLayout, nullptr );
+		if( shaderModule )
+			vkDestroyShaderModule( device, shaderModule, nullptr );
+		vkDestroyDevice( device, nullptr );
+
+		return outResult.error.empty();
+	}
+}  // namespace
+
+DriverBenchResult runDriverBench( const char *label, PFN_vkGetInstanceProcAddr getInstanceProcAddr )
+{
+	DriverBenchResult result;
+	result.label = label;
+
+	PFN_vkCreateInstance vkCreateInstance = reinterpret_cast<PFN_vkCreateInstance>(
+		getInstanceProcAddr( VK_NULL_HANDLE, "vkCreateInstance" ) );
+	if( !vkCreateInstance )
+	{
+		result.error = "vkGetInstanceProcAddr";
+		return result;
+	}
+
+	VkApplicationInfo appInfo = {};
+	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	appInfo.pApplicationName = "AdrenoToolsDriverBench";
+	appInfo.applicationVersion = 1;
+	appInfo.pEngineName = "AdrenoToolsDriverBench";
+	appInfo.engineVersion = 1;
+	appInfo.apiVersion = VK_API_VERSION_1_0;
+
+	VkInstanceCreateInfo instanceCreateInfo = {};
+	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instanceCreateInfo.pApplicationInfo = &appInfo;
+
+	// The first instance creation also loads the driver, so it is included in the average
+	// the same way an app would pay for it.
+	VkInstance instance = VK_NULL_HANDLE;
+	PFN_vkDestroyInstance vkDestroyInstance = nullptr;
+	double totalInstanceMs = 0;
+	for( uint32_t i = 0u; i < c_numInstanceIterations; ++i )
+	{
+		if( instance )
+			vkDestroyInstance( instance, nullptr );
+
+		const Clock::time_point start = Clock::now();
+		if( vkCreateInstance( &instanceCreateInfo, nullptr, &instance ) != VK_SUCCESS )
+		{
+			result.error = "vkCreateInstance";
+			return result;
+		}
+		totalInstanceMs += msSince( start );
+
+		vkDestroyInstance = reinterpret_cast<PFN_vkDestroyInstance>(
+			getInstanceProcAddr( instance, "vkDestroyInstance" ) );
+	}
+	result.instanceCreateMs = totalInstanceMs / c_numInstanceIterations;
+
+	PFN_vkEnumeratePhysicalDevices vkEnumeratePhysicalDevices =
+		reinterpret_cast<PFN_vkEnumeratePhysicalDevices>(
+			getInstanceProcAddr( instance, "vkEnumeratePhysicalDevices" ) );
+	PFN_vkGetPhysicalDeviceProperties vkGetPhysicalDeviceProperties =
+		reinterpret_cast<PFN_vkGetPhysicalDeviceProperties>(
+			getInstanceProcAddr( instance, "vkGetPhysicalDeviceProperties" ) );
+
+	const Clock::time_point start = Clock::now();
+	uint32_t numDevices = 0u;
+	vkEnumeratePhysicalDevices( instance, &numDevices, nullptr );
+	std::vector<VkPhysicalDevice> physicalDevices( numDevices );
+	vkEnumeratePhysicalDevices( instance, &numDevices, physicalDevices.data() );
+	result.deviceEnumerateMs = msSince( start );
+	result.numDevices = numDevices;
+
+	if( numDevices == 0u )
+		result.error = "no devices";
+	else
+	{
+		VkPhysicalDeviceProperties deviceProps;
+		vkGetPhysicalDeviceProperties( physicalDevices[0], &deviceProps );
+		result.deviceName = deviceProps.deviceName;
+
+		benchDevice( instance, physicalDevices[0], getInstanceProcAddr, result );
+	}
+
+	vkDestroyInstance( instance, nullptr );
+	return result;
+}
+
+std::string formatDriverBenchReport( const std::vector<DriverBenchResult> &results )
+{
+	const int c_labelWidth = 22;
+	const int c_columnWidth = 24;
+
+	std::string report;
+	char cell[128];
+
+	const auto addRow = [&]( const char *rowLabel, auto &&formatCell ) {
+		snprintf( cell, sizeof( cell ), "%-*s", c_labelWidth, rowLabel );
+		report += cell;
+		for( const DriverBenchResult &result : results )
+		{
+			formatCell( result );
+			report += cell;
+		}
+		report += '\n';
+	};
+	const auto addTextRow = [&]( const char *rowLabel, std::string DriverBenchResult::*member ) {
+		addRow( rowLabel, [&]( const DriverBenchResult &result ) {
+			// Truncate long device names so the columns stay aligned
+			snprintf( cell, sizeof( cell ), " %-*.*s", c_columnWidth - 1, c_columnWidth - 1,
+					  ( result.*member ).empty() ? "-" : ( result.*member ).c_str() );
+		} );
+	};
+	const auto addNumberRow = [&]( const char *rowLabel, double DriverBenchResult::*member ) {
+		addRow( rowLabel, [&]( const DriverBenchResult &result ) {
+			snprintf( cell, sizeof( cell ), " %*.3f", c_columnWidth - 1, result.*member );
+		} );
+	};
+
+	addTextRow( "", &DriverBenchResult::label );
+	addTextRow( "Device", &DriverBenchResult::deviceName );
+	addTextRow( "Failed at", &DriverBenchResult::error );
+	addNumberRow( "Instance create (ms)", &DriverBenchResult::instanceCreateMs );
+	addNumberRow( "Enumerate (ms)", &DriverBenchResult::deviceEnumerateMs );
+	addNumberRow( "Device create (ms)", &DriverBenchResult::deviceCreateMs );
+	addNumberRow( "Allocations/s", &DriverBenchResult::allocationsPerSecond );
+	addNumberRow( "Allocation MiB/s", &DriverBenchResult::allocationMiBPerSecond );
+	addNumberRow( "Pipeline compile (ms)", &DriverBenchResult::pipelineCompileMs );
+
+	return report;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifndef VK_NO_PROTOTYPES
+#	define VK_NO_PROTOTYPES
+#endif
+#include <vulkan/vulkan.h>
+
+/// Timings of the benchmark workload on a single driver. All times are in milliseconds.
+struct DriverBenchResult
+{
+	std::string label;
+	std::string deviceName;
+	/// Empty if every stage ran. Otherwise the stage that failed, stages after it weren't run.
+	std::string error;
+
+	uint32_t numDevices = 0u;
+	double   instanceCreateMs = 0;  ///< Average of several vkCreateInstance calls
+	double   deviceEnumerateMs = 0;
+	double   deviceCreateMs = 0;
+	double   allocationsPerSecond = 0;  ///< vkAllocateMemory + vkFreeMemory pairs per second
+	double   allocationMiBPerSecond = 0;
+	double   pipelineCompileMs = 0;  ///< Average of several uncached compute pipeline compiles
+};
+
+/** Runs the same workload on a driver: instance creation, device enumeration,
+	memory allocation throughput and pipeline compile time.
+
+	Only the first physical device is benchmarked.
+@param label
+	Name of the driver to show in the report.
+@param getInstanceProcAddr
+	vkGetInstanceProcAddr of the Vulkan library to benchmark. This is all that is used,
+	so libraries loaded through adrenotools or dlmopen can be benchmarked side by side
+	in the same process.
+@return
+	The timings. error is set if a stage failed.
+*/
+DriverBenchResult runDriverBench( const char *label, PFN_vkGetInstanceProcAddr getInstanceProcAddr );
+
+/// Formats the results as a table with one column per driver, so they can be compared side by side.
+std::string formatDriverBenchReport( const std::vector<DriverBenchResult> &results );
@@ -0,0 +1,183 @@
+/** Host runner for the driver benchmark, so the harness can be exercised on Linux against a CPU
+	Vulkan implementation (e.g. lavapipe) standing in for the Android drivers.
+
+	Usage:
+		driver-bench label=library[:icd.json] [label=library[:icd.json] ...]
+		driver-bench label=@/path/to/driver.so ...
+
+	The second form loads the driver through adrenotools_open_libvulkan as a custom driver,
+	using its host backend. This needs a build with DRIVER_BENCH_ADRENOTOOLS defined, linked
+	against the host build of adrenotools, and ADRENOTOOLS_HOOK_DIR set to the directory
+	holding the hook libraries.
+
+	library must export vkGetInstanceProcAddr (a Vulkan loader such as libvulkan.so.1)
+	or vk_icdGetInstanceProcAddr (a Mesa ICD used directly). When an ICD manifest is given,
+	the loader is restricted to that driver.
+
+	Each library is loaded with dlmopen into its own link map, the host equivalent of the
+	linker namespaces adrenotools loads drivers into on Android, so several loaders and drivers
+	can be benchmarked side by side in one process.
+*/
+
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "driver_bench.h"
+
+#ifdef DRIVER_BENCH_ADRENOTOOLS
+#	include <unistd.h>
+#	include <adrenotools/driver.h>
+
+/** Loads the system Vulkan loader through adrenotools with driverPath as the custom driver.
+@param driverPath
+	Full path to the driver (e.g. libvulkan_lvp.so).
+@param manifestPath [out]
+	Set to the temporary ICD manifest the loader is pointed at. The loader reads it when the
+	instance is created, so the caller must unlink it after the benchmark.
+@return
+	The loaded libvulkan, or nullptr on failure.
+*/
+static void *openThroughAdrenotools( const std::string &driverPath, std::string &manifestPath )
+{
+	const char *hookDir = getenv( "ADRENOTOOLS_HOOK_DIR" );
+	if( !hookDir )
+	{
+		fprintf( stderr, "ADRENOTOOLS_HOOK_DIR must be set to load drivers through adrenotools\n" );
+		return nullptr;
+	}
+
+	const size_t nameStart = driverPath.rfind( '/' ) + 1u;
+	const std::string driverDir = driverPath.substr( 0u, nameStart );
+	const std::string driverName = driverPath.substr( nameStart );
+
+	// The loader is pointed at a placeholder driver, named like the vulkan.<board>.so the Android
+	// loader asks for, which the hooks then replace with the custom driver
+	char manifestTemplate[] = "/tmp/driver-bench-icd-XXXXXX";
+	const int manifestFd = mkstemp( manifestTemplate );
+	if( manifestFd == -1 )
+		return nullptr;
+	manifestPath = manifestTemplate;
+
+	const char manifest[] =
+		"{ \"file_format_version\": \"1.0.0\", "
+		"\"ICD\": { \"library_path\": \"vulkan.adrenotools.so\", \"api_version\": \"1.3.0\" } }\n";
+	const bool written = write( manifestFd, manifest, sizeof( manifest ) - 1u ) ==
+						 static_cast<ssize_t>( sizeof( manifest ) - 1u );
+	close( manifestFd );
+	if( !written )
+		return nullptr;
+
+	setenv( "VK_DRIVER_FILES", manifestTemplate, 1 );
+	setenv( "VK_ICD_FILENAMES", manifestTemplate, 1 );
+
+	return adrenotools_open_libvulkan( RTLD_NOW, ADRENOTOOLS_DRIVER_CUSTOM, nullptr, hookDir,
+									   driverDir.c_str(), driverName.c_str(), nullptr, nullptr );
+}
+#endif
+
+int main( int argc, char **argv )
+{
+	if( argc < 2 )
+	{
+		fprintf( stderr, "Usage: %s label=library[:icd.json] [label=library[:icd.json] ...]\n",
+				 argv[0] );
+		return 1;
+	}
+
+	std::vector<DriverBenchResult> results;
+	for( int i = 1; i < argc; ++i )
+	{
+		const std::string arg = argv[i];
+		const size_t labelEnd = arg.find( '=' );
+		if( labelEnd == std::string::npos )
+		{
+			fprintf( stderr, "Expected label=library, got: %s\n", arg.c_str() );
+			return 1;
+		}
+
+		const std::string label = arg.substr( 0u, labelEnd );
+		std::string library = arg.substr( labelEnd + 1u );
+		const bool viaAdrenotools = !library.empty() && library[0] == '@';
+		const size_t icdStart = library.find( ':' );
+		if( viaAdrenotools )
+		{
+#ifdef DRIVER_BENCH_ADRENOTOOLS
+			library.erase( 0u, 1u );
+#else
+			fprintf( stderr, "%s: built without DRIVER_BENCH_ADRENOTOOLS\n", label.c_str() );
+			return 1;
+#endif
+		}
+		else if( icdStart != std::string::npos )
+		{
+			// The loader reads these when the instance is created, which happens below before the
+			// next driver's manifest is set
+			const std::string icdManifest = library.substr( icdStart + 1u );
+			setenv( "VK_DRIVER_FILES", icdManifest.c_str(), 1 );
+			setenv( "VK_ICD_FILENAMES", icdManifest.c_str(), 1 );
+			library.resize( icdStart );
+		}
+
+		void *module = nullptr;
+		std::string tempManifest;
+#ifdef DRIVER_BENCH_ADRENOTOOLS
+		if( viaAdrenotools )
+			module = openThroughAdrenotools( library, tempManifest );
+		else
+#endif
+		{
+			module = dlmopen( LM_ID_NEWLM, library.c_str(), RTLD_NOW | RTLD_LOCAL );
+			if( !module )
+			{
+				// Link maps are a scarce resource in glibc, fall back to sharing the global one
+				module = dlopen( library.c_str(), RTLD_NOW | RTLD_LOCAL );
+			}
+		}
+		if( !module )
+		{
+#ifdef DRIVER_BENCH_ADRENOTOOLS
+			if( !tempManifest.empty() )
+				unlink( tempManifest.c_str() );
+#endif
+			fprintf( stderr, "Could not load %s: %s\n", library.c_str(), dlerror() );
+			DriverBenchResult result;
+			result.label = label;
+			result.error = "dlopen";
+			results.push_back( result );
+			continue;
+		}
+
+		void *getInstanceProcAddr = dlsym( module, "vkGetInstanceProcAddr" );
+		if( !getInstanceProcAddr )
+			getInstanceProcAddr = dlsym( module, "vk_icdGetInstanceProcAddr" );
+
+		if( !getInstanceProcAddr )
+		{
+			DriverBenchResult result;
+			result.label = label;
+			result.error = "vkGetInstanceProcAddr";
+			results.push_back( result );
+		}
+		else
+		{
+			results.push_back( runDriverBench(
+				label.c_str(), reinterpret_cast<PFN_vkGetInstanceProcAddr>( getInstanceProcAddr ) ) );
+		}
+
+#ifdef DRIVER_BENCH_ADRENOTOOLS
+		if( !tempManifest.empty() )
+			unlink( tempManifest.c_str() );
+#endif
+
+		// Modules are kept loaded until exit, as drivers often don't survive being unloaded
+	}
+
+	printf( "%s", formatDriverBenchReport( results ).c_str() );
+	return 0;
+}
@@ -7,10 +7,18 @@
 
 #include <sys/stat.h>
 
+#include <chrono>
+#include <future>
+
 #define VK_NO_PROTOTYPES
 #include <dlfcn.h>
 #include <vulkan/vulkan.h>
 #include "adrenotools/include/adrenotools/driver.h"
+#include "adrenotools/include/adrenotools/package.h"
+#include "driver_bench/driver_bench.h"
+
+/// Runs benchmarkDrivers() once the replacement driver has been loaded
+#define RUN_DRIVER_BENCH
 
 /** Copies a file from one folder into another. Dst folder must exist.
 	e.g.
@@ -32,14 +40,22 @@ void copyFile( const std::string &srcFolder, const std::string &dstFolder, const
 	{
 		const size_t sizeBytes = inputFile.getFileSize( false );
 		inputFile.seek( 0, sds::fstream::beg );
-		std::vector<char> fileData;
-		fileData.resize( sizeBytes );
-		inputFile.read( fileData.data(), sizeBytes );
 
 		sds::fstream outputFile( dstFolder + filename, sds::fstream::OutputDiscard );
 		if( outputFile.is_open() )
 		{
-			outputFile.write( fileData.data(), sizeBytes );
+			// Copied in chunks so drivers tens of MBs in size don't need as much heap
+			std::vector<char> chunk( std::min<size_t>( sizeBytes, 1u << 20u ) );
+			size_t bytesLeft = sizeBytes;
+			while( bytesLeft > 0u )
+			{
+				const size_t bytesRead =
+					inputFile.read( chunk.data(), std::min( bytesLeft, chunk.size() ) );
+				if( bytesRead == 0u )
+					break;
+				outputFile.write( chunk.data(), bytesRead );
+				bytesLeft -= bytesRead;
+			}
 		}
 		else
 		{
@@ -156,7 +172,7 @@ void loadOriginalVulkan()
 	dlclose( module );
 }
 
-/** Loads Vulkan using driver injection.
+/** Starts loading Vulkan using driver injection on a background thread.
 @param path
 	Folder where the *.so of driverName is stored in.
 	This path must be internal to the app, otherwise there will be permission errors.
@@ -164,32 +180,120 @@ void loadOriginalVulkan()
 	This folder MUST be the one returned by getNativeLibraryDir().
 @param driverName
 	Name of the driver library, e.g. "libvulkan_freedreno.so", "vulkan.msm8937.so", etc.
+@return
+	The request to poll with adrenotools_open_request_get_status() and pass to
+	finishReplaceDriver() once it completes.
 */
-void replaceDriver( const std::string &path, const char *hooksDir, const char *driverName )
+adrenotools_open_request *replaceDriverAsync( const std::string &path, const char *hooksDir,
+											  const char *driverName )
 {
 	mkdir( ( path + "temp" ).c_str(), S_IRWXU | S_IRWXG );
 
 	// String nativeLibDir = getApplicationLibraryDir( appInfo );
 	// std::string nativeLibDir = GetJavaString( env, jNativeLibDir );
 
-	void *libVulkan = adrenotools_open_libvulkan( RTLD_NOW | RTLD_LOCAL, ADRENOTOOLS_DRIVER_CUSTOM,
-												  ( path + "temp" ).c_str(),  //
-												  hooksDir,                   //
-												  path.c_str(),               //
-												  driverName, nullptr, nullptr );
+	adrenotools_open_request *request = adrenotools_open_libvulkan_async(
+		RTLD_NOW | RTLD_LOCAL, ADRENOTOOLS_DRIVER_CUSTOM | ADRENOTOOLS_DRIVER_PRELOAD,
+		( path + "temp" ).c_str(),  //
+		hooksDir,                   //
+		path.c_str(),               //
+		driverName, nullptr, nullptr, nullptr, nullptr );
+	if( !request )
+	{
+		__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer",
+							 "Could not start loading vulkan library!\n" );
+	}
+	return request;
+}
+
+/// Tests the driver loaded by a completed replaceDriverAsync() request and destroys the request.
+void finishReplaceDriver( adrenotools_open_request *request )
+{
+	const adrenotools_open_status status = adrenotools_open_request_get_status( request );
+	void *libVulkan = adrenotools_open_request_get_libvulkan( request );
 	if( !libVulkan )
 	{
-		if( !libVulkan )
-		{
-			__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer",
-								 "Could not load vulkan library : %s!\n", dlerror() );
-		}
+		const char *error = adrenotools_open_request_get_error( request );
+		__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer",
+							 "Could not load vulkan library (status %i): %s!\n", (int)status,
+							 error ? error : "no linker error" );
 	}
 	else
 	{
 		__android_log_print( ANDROID_LOG_INFO, "DriverReplacer", "DRIVER REPLACEMENT LOADED" );
 		testVulkan( libVulkan );
+		dlclose( libVulkan );
 	}
+	adrenotools_open_request_destroy( request );
+}
+
+/// A replacement driver to benchmark with benchmarkDrivers()
+struct BenchDriver
+{
+	std::string label;
+	/// Folder where the *.so of driverName is stored in, see replaceDriverAsync().
+	/// Each driver needs its own folder, as ADRENOTOOLS_DRIVER_PRELOAD loads everything in it.
+	std::string path;
+	std::string driverName;
+};
+
+/** Loads the system driver and every driver in drivers side by side, each into its own
+	namespaces, and runs the same benchmark workload on all of them.
+@remarks
+	This blocks until every driver has been benchmarked, so it should run on a worker thread
+	rather than the event loop.
+@param hooksDir
+	This folder MUST be the one returned by getNativeLibraryDir().
+@return
+	The results formatted as a table with one column per driver.
+*/
+std::string benchmarkDrivers( const std::string &hooksDir, const std::vector<BenchDriver> &drivers )
+{
+	std::vector<DriverBenchResult> results;
+	std::vector<void *> modules;
+
+	void *systemVulkan = dlopen( "libvulkan.so", RTLD_NOW | RTLD_LOCAL );
+	if( systemVulkan )
+	{
+		modules.push_back( systemVulkan );
+		results.push_back( runDriverBench(
+			"system", reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+						  dlsym( systemVulkan, "vkGetInstanceProcAddr" ) ) ) );
+	}
+
+	for( const BenchDriver &driver : drivers )
+	{
+		mkdir( ( driver.path + "temp" ).c_str(), S_IRWXU | S_IRWXG );
+
+		// Every driver is kept loaded until all have been benchmarked, so they're really side by side
+		void *libVulkan = adrenotools_open_libvulkan(
+			RTLD_NOW | RTLD_LOCAL, ADRENOTOOLS_DRIVER_CUSTOM | ADRENOTOOLS_DRIVER_PRELOAD,
+			( driver.path + "temp" ).c_str(),  //
+			hooksDir.c_str(),                  //
+			driver.path.c_str(),               //
+			driver.driverName.c_str(), nullptr, nullptr );
+		if( !libVulkan )
+		{
+			__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer",
+								 "Could not load %s for benchmarking: %s!\n",
+								 driver.driverName.c_str(), dlerror() );
+			DriverBenchResult result;
+			result.label = driver.label;
+			result.error = "adrenotools_open_libvulkan";
+			results.push_back( result );
+			continue;
+		}
+
+		modules.push_back( libVulkan );
+		results.push_back( runDriverBench(
+			driver.label.c_str(), reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+									  dlsym( libVulkan, "vkGetInstanceProcAddr" ) ) ) );
+	}
+
+	for( void *module : modules )
+		dlclose( module );
+
+	return formatDriverBenchReport( results );
 }
 
 extern "C" {
@@ -316,28 +420,49 @@ void android_main( struct android_app *pApp )
 								  "notllvm-glnext.so", "notllvm-qgl.so" };
 #	endif
 
-	for( size_t i = 0u; i < sizeof( filesToCopy ) / sizeof( filesToCopy[0] ); ++i )
-		copyFile( srcFolder, dstFolder, filesToCopy[i] );
+#endif
 
-	for( size_t i = 0u; i < sizeof( filesToCopy ) / sizeof( filesToCopy[0] ); ++i )
+	// An ADPKG zip (see adrenotools/tools/ADPKG.md) in the SRC folder is streamed straight into
+	// its own internal folder, otherwise the loose libraries are copied from the SRC folder
+	std::string driverFolder = dstFolder;
+	adrenotools_package package = {};
+	const adrenotools_package_status packageStatus = adrenotools_install_package(
+		( srcFolder + "driver.adpkg.zip" ).c_str(), ( dstFolder + "adpkg" ).c_str(), &package );
+	if( packageStatus == ADRENOTOOLS_PACKAGE_SUCCESS )
 	{
-		void *lib =
-			dlopen( ( std::string( dstFolder ) + filesToCopy[i] ).c_str(), RTLD_NOW | RTLD_LOCAL );
-		if( !lib )
-		{
-			__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer", "Could not load %s!. Reason: %s",
-								 filesToCopy[i], dlerror() );
-		}
-		else
+		__android_log_print( ANDROID_LOG_INFO, "DriverReplacer", "Installed package %s (%s)\n",
+							 package.name, package.driver_version );
+		driverFolder = package.custom_driver_dir;
+		vulkanLibName = package.custom_driver_name;
+	}
+	else
+	{
+		// ADRENOTOOLS_PACKAGE_ERROR_IO most likely just means there is no package
+		if( packageStatus != ADRENOTOOLS_PACKAGE_ERROR_IO )
 		{
-			__android_log_print( ANDROID_LOG_INFO, "DriverReplacer", "Loaded %s!", filesToCopy[i] );
+			__android_log_print( ANDROID_LOG_ERROR, "DriverReplacer",
+								 "Could not install driver.adpkg.zip, error %d\n", packageStatus );
 		}
-	}
+
+#ifdef USE_QUALCOMM_DRIVER
+		for( size_t i = 0u; i < sizeof( filesToCopy ) / sizeof( filesToCopy[0] ); ++i )
+			copyFile( srcFolder, dstFolder, filesToCopy[i] );
+
+		// These get loaded into the driver's namespace by ADRENOTOOLS_DRIVER_PRELOAD in replaceDriver()
 #endif
+		copyFile( srcFolder, dstFolder, vulkanLibName );
+	}
 
 	loadOriginalVulkan();
-	copyFile( srcFolder, dstFolder, vulkanLibName );
-	replaceDriver( dstFolder, nativeLibraryDir.c_str(), vulkanLibName );
+	// The driver is loaded in the background so the event loop (and e.g. a splash screen) can run
+	// meanwhile. It is loaded twice like an engine recreating Vulkan would, the second load reuses
+	// the namespaces and hooks set up by the first so only the driver itself is initialized again
+	adrenotools_open_request *driverRequest =
+		replaceDriverAsync( driverFolder, nativeLibraryDir.c_str(), vulkanLibName );
+	int driverLoadsLeft = 2;
+	// Set once the driver loads are done, the benchmark runs on a worker thread so the event loop
+	// keeps running and the report is logged from here once it's ready
+	std::future<std::string> benchReport;
 
 	// Register an event handler for Android events
 	pApp->onAppCmd = handle_cmd;
@@ -360,6 +485,42 @@ void android_main( struct android_app *pApp )
 				pSource->process( pApp, pSource );
 			}
 		}
+
+		if( driverRequest &&
+			adrenotools_open_request_get_status( driverRequest ) != ADRENOTOOLS_OPEN_PENDING )
+		{
+			finishReplaceDriver( driverRequest );
+			driverRequest = nullptr;
+			if( --driverLoadsLeft > 0 )
+			{
+				driverRequest =
+					replaceDriverAsync( driverFolder, nativeLibraryDir.c_str(), vulkanLibName );
+			}
+#ifdef RUN_DRIVER_BENCH
+			else
+			{
+				// Add more entries to compare several drivers, e.g.
+				// { "ad0667", dstFolder + "ad0667/", "vulkan.ad0667.so" }
+				benchReport = std::async(
+					std::launch::async, benchmarkDrivers, nativeLibraryDir,
+					std::vector<BenchDriver>{ { vulkanLibName, driverFolder, vulkanLibName } } );
+			}
+#endif
+		}
+
+		if( benchReport.valid() &&
+			benchReport.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready )
+		{
+			__android_log_print( ANDROID_LOG_INFO, "DriverReplacer",
+								 "====== DRIVER BENCHMARK ======\n%s", benchReport.get().c_str() );
+		}
 	} while( !pApp->destroyRequested );
+
+	// Cancels the load if it is still in progress
+	if( driverRequest )
+		adrenotools_open_request_destroy( driverRequest );
+	// A benchmark still in progress is waited on, it can't be cancelled
+	if( benchReport.valid() )
+		benchReport.wait();
 }
 }